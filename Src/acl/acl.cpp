@@ -0,0 +1,251 @@
+#include "../include/acl.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include <fstream>
+#include <chrono>
+using namespace std;
+
+// 第i位(从最高位数起)
+static inline int Bit(uint64_t hi, uint64_t lo, int i) {
+    return i < 64 ? (hi >> (63 - i)) & 1 : (lo >> (127 - i)) & 1;
+}
+
+// 保留前len位
+static inline void Mask(uint64_t* hi, uint64_t* lo, int len) {
+    if (len <= 0) { *hi = 0; *lo = 0; }
+    else if (len < 64) { *hi &= ~0ull << (64 - len); *lo = 0; }
+    else if (len == 64) { *lo = 0; }
+    else if (len < 128) { *lo &= ~0ull << (128 - len); }
+}
+
+// 两个键相同的前缀位数(不超过maxLen)
+static inline int Common(uint64_t ahi, uint64_t alo, uint64_t bhi, uint64_t blo, int maxLen) {
+    int n;
+    if (ahi != bhi) { n = __builtin_clzll(ahi ^ bhi); }
+    else if (alo != blo) { n = 64 + __builtin_clzll(alo ^ blo); }
+    else { n = 128; }
+    return n < maxLen ? n : maxLen;
+}
+
+Acl::Acl() : m_pending(nullptr), m_generation(0) {}
+
+Acl::~Acl() {
+    delete m_pending.exchange(nullptr);
+}
+
+// "10.0.0.0/8"、"2001:db8::/32"，不写长度表示单个地址; IPv4映射到 ::ffff:0:0/96
+bool Acl::_Parse_Cidr(const string& text, Key* key, int* len) {
+    string addr = text;
+    int prefix = -1;
+    size_t slash = text.find('/');
+    if (slash != string::npos) {
+        addr = text.substr(0, slash);
+        const char* num = text.c_str() + slash + 1;
+        char* end = nullptr;
+        long val = strtol(num, &end, 10);
+        if (end == num || *end != '\0' || val < 0) { return false; }
+        prefix = static_cast<int>(val);
+    }
+    struct in_addr v4;
+    struct in6_addr v6;
+    if (inet_pton(AF_INET, addr.c_str(), &v4) == 1) {
+        if (prefix > 32) { return false; }
+        key->hi = 0;
+        key->lo = 0x0000ffff00000000ull | ntohl(v4.s_addr);
+        *len = 96 + (prefix < 0 ? 32 : prefix);
+    } else if (inet_pton(AF_INET6, addr.c_str(), &v6) == 1) {
+        if (prefix > 128) { return false; }
+        key->hi = key->lo = 0;
+        for (int i = 0; i < 8; i++) {
+            key->hi = (key->hi << 8) | v6.s6_addr[i];
+            key->lo = (key->lo << 8) | v6.s6_addr[i + 8];
+        }
+        *len = prefix < 0 ? 128 : prefix;
+    } else {
+        return false;
+    }
+    Mask(&key->hi, &key->lo, *len);
+    return true;
+}
+
+// 插入一条前缀; 同一前缀再次插入时覆盖原来的动作
+void Acl::_Insert(Table* table, const Key& key, int len, int action) {
+    vector<Node>& nodes = table->nodes;
+    uint32_t cur = 0;
+    for (;;) {
+        // 不变式: key的前nodes[cur].len位与cur节点的前缀相同，且len >= nodes[cur].len
+        if (len == nodes[cur].len) {
+            nodes[cur].action = static_cast<int8_t>(action);
+            return;
+        }
+        int bit = Bit(key.hi, key.lo, nodes[cur].len);
+        uint32_t next = nodes[cur].child[bit];
+        Node leaf = { key, static_cast<uint8_t>(len), static_cast<int8_t>(action), { 0, 0 } };
+        if (next == 0) {
+            nodes.push_back(leaf);
+            nodes[cur].child[bit] = static_cast<uint32_t>(nodes.size() - 1);
+            return;
+        }
+        const Node& child = nodes[next];
+        int common = Common(key.hi, key.lo, child.key.hi, child.key.lo, min(len, static_cast<int>(child.len)));
+        if (common == child.len) {
+            cur = next;
+            continue;
+        }
+        // 与子节点在common位分叉: 插入一个长度为common的中间节点
+        Node mid = { key, static_cast<uint8_t>(common), -1, { 0, 0 } };
+        Mask(&mid.key.hi, &mid.key.lo, common);
+        mid.child[Bit(child.key.hi, child.key.lo, common)] = next;
+        if (common == len) {
+            mid.action = static_cast<int8_t>(action);
+        } else {
+            nodes.push_back(leaf);
+            mid.child[Bit(key.hi, key.lo, common)] = static_cast<uint32_t>(nodes.size() - 1);
+        }
+        nodes.push_back(mid);
+        nodes[cur].child[bit] = static_cast<uint32_t>(nodes.size() - 1);
+        return;
+    }
+}
+
+// 列表文件: 每行一个CIDR，# 开头为注释，行内第一个空白之后的内容忽略
+bool Acl::_Load_File(const string& path, int action, Table* table) {
+    ifstream in(path);
+    if (!in) {
+        LOG_ERROR("acl: open %s error!", path.c_str());
+        return false;
+    }
+    string line;
+    int lineNo = 0;
+    int bad = 0;
+    while (getline(in, line)) {
+        lineNo++;
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == string::npos || line[begin] == '#' || line[begin] == ';') { continue; }
+        size_t end = line.find_first_of(" \t\r#;", begin);
+        Key key;
+        int len;
+        if (!_Parse_Cidr(line.substr(begin, end == string::npos ? string::npos : end - begin), &key, &len)) {
+            if (bad++ < 5) { LOG_WARN("acl: %s:%d: bad prefix", path.c_str(), lineNo); }
+            continue;
+        }
+        _Insert(table, key, len, action);
+        action ? table->allows++ : table->denies++;
+    }
+    return bad == 0;
+}
+
+// 沿树向下走，返回最后一个(最长)匹配的前缀的动作
+bool Acl::_Walk(const Table* table, uint32_t cur, uint64_t hi, uint64_t lo, bool result) {
+    while (cur) {
+        const Node& node = table->nodes[cur];
+        if (Common(hi, lo, node.key.hi, node.key.lo, node.len) < node.len) { break; }
+        if (node.action >= 0) { result = node.action; }
+        if (node.len == 128) { break; }
+        cur = node.child[Bit(hi, lo, node.len)];
+    }
+    return result;
+}
+
+// 预先走完IPv4前16位(::ffff:a.b/112)以内的节点，查找时跳过树的上层(上层节点最容易缓存未命中)
+void Acl::_Build_Jump(Table* table) {
+    const int JUMP_LEN = 96 + 16;
+    table->v4.resize(1 << 16);
+    for (uint32_t i = 0; i < (1u << 16); i++) {
+        uint64_t lo = 0x0000ffff00000000ull | (static_cast<uint64_t>(i) << 16);
+        bool result = table->fallback;
+        uint32_t cur = 0;
+        bool first = true;
+        // 根节点的下标也是0，第一次循环单独处理
+        while (first || cur) {
+            first = false;
+            const Node& node = table->nodes[cur];
+            if (node.len >= JUMP_LEN) { break; }
+            if (Common(0, lo, node.key.hi, node.key.lo, node.len) < node.len) {
+                cur = 0;
+                break;
+            }
+            if (node.action >= 0) { result = node.action; }
+            cur = node.child[Bit(0, lo, node.len)];
+        }
+        table->v4[i] = Jump{ cur, result };
+    }
+}
+
+bool Acl::Load(const Config& cfg) {
+    uint64_t gen = ++m_generation;
+    auto begin = chrono::steady_clock::now();
+    unique_ptr<Table> table(new Table);
+    table->nodes.push_back(Node{ { 0, 0 }, 0, -1, { 0, 0 } });
+    table->allows = table->denies = 0;
+
+    // 先allow后deny: 同一前缀同时出现在两张列表中时拒绝
+    bool ok = true;
+    const vector<string>* lists[2] = { &cfg.m_aclAllow, &cfg.m_aclDeny };
+    const string* files[2] = { &cfg.m_aclAllowFile, &cfg.m_aclDenyFile };
+    for (int action = 1; action >= 0; action--) {
+        for (auto& text : *lists[1 - action]) {
+            Key key;
+            int len;
+            if (!_Parse_Cidr(text, &key, &len)) {
+                LOG_WARN("acl: bad prefix %s", text.c_str());
+                ok = false;
+                continue;
+            }
+            _Insert(table.get(), key, len, action);
+            action ? table->allows++ : table->denies++;
+        }
+        if (!files[1 - action]->empty()) {
+            ok = _Load_File(*files[1 - action], action, table.get()) && ok;
+        }
+    }
+    table->fallback = (table->allows == 0);
+    _Build_Jump(table.get());
+
+    // 加载期间又有新的加载开始: 丢弃本次结果
+    if (gen != m_generation) { return ok; }
+    size_t allows = table->allows, denies = table->denies, nodes = table->nodes.size();
+    delete m_pending.exchange(table.release(), memory_order_acq_rel);
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - begin).count();
+    if (allows || denies) {
+        LOG_INFO("acl: %zu allow, %zu deny prefixes, %zu nodes, compiled in %lldms",
+                 allows, denies, nodes, static_cast<long long>(ms));
+    }
+    return ok;
+}
+
+bool Acl::Allow(const struct sockaddr* addr) {
+    // 接管新编译好的树，旧树在这里释放
+    if (m_pending.load(memory_order_relaxed)) {
+        m_table.reset(m_pending.exchange(nullptr, memory_order_acq_rel));
+    }
+    const Table* table = m_table.get();
+    // 空表: 全部允许(只有根节点但根节点有动作时是 ::/0 这样的条目，不能跳过)
+    if (!table || (table->nodes.size() == 1 && table->nodes[0].action < 0)) { return true; }
+
+    uint64_t hi = 0, lo = 0;
+    if (addr->sa_family == AF_INET) {
+        uint32_t ip = ntohl(reinterpret_cast<const sockaddr_in*>(addr)->sin_addr.s_addr);
+        const Jump& jump = table->v4[ip >> 16];
+        return _Walk(table, jump.node, 0, 0x0000ffff00000000ull | ip, jump.result);
+    } else if (addr->sa_family == AF_INET6) {
+        const uint8_t* bytes = reinterpret_cast<const sockaddr_in6*>(addr)->sin6_addr.s6_addr;
+        // 双栈监听收到的IPv4连接(::ffff:a.b.c.d)同样走IPv4的直接索引
+        if (IN6_IS_ADDR_V4MAPPED(reinterpret_cast<const struct in6_addr*>(bytes))) {
+            uint32_t ip = (static_cast<uint32_t>(bytes[12]) << 24) | (bytes[13] << 16) | (bytes[14] << 8) | bytes[15];
+            const Jump& jump = table->v4[ip >> 16];
+            return _Walk(table, jump.node, 0, 0x0000ffff00000000ull | ip, jump.result);
+        }
+        for (int i = 0; i < 8; i++) {
+            hi = (hi << 8) | bytes[i];
+            lo = (lo << 8) | bytes[i + 8];
+        }
+    } else {
+        return true;    // Unix套接字等不做限制
+    }
+
+    // 根节点总是匹配
+    const Node& root = table->nodes[0];
+    bool result = root.action >= 0 ? root.action : table->fallback;
+    return _Walk(table, root.child[Bit(hi, lo, 0)], hi, lo, result);
+}
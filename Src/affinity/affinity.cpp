@@ -0,0 +1,146 @@
+#include "../include/affinity.h"
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+using namespace std;
+
+static string Read_Line(const string& path) {
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+bool Affinity::Parse_CpuList(const string& str, vector<int>* cpus) {
+    assert(cpus);
+    cpus->clear();
+    stringstream ss(str);
+    string item;
+    while (getline(ss, item, ',')) {
+        item.erase(remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) { continue; }
+        char* end = nullptr;
+        long first = strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') { last = strtol(end + 1, &end, 10); }
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            cpus->clear();
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) { cpus->push_back(static_cast<int>(cpu)); }
+    }
+    sort(cpus->begin(), cpus->end());
+    cpus->erase(unique(cpus->begin(), cpus->end()), cpus->end());
+    return true;
+}
+
+string Affinity::To_CpuList(const vector<int>& cpus) {
+    string str;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) { j++; }
+        if (!str.empty()) { str += ","; }
+        str += to_string(cpus[i]);
+        if (j > i) { str += "-" + to_string(cpus[j]); }
+        i = j;
+    }
+    return str;
+}
+
+vector<int> Affinity::Allowed_Cpus() {
+    vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+        }
+    }
+    return cpus;
+}
+
+vector<int> Affinity::Node_Cpus(int node) {
+    vector<int> cpus;
+    Parse_CpuList(Read_Line("/sys/devices/system/node/node" + to_string(node) + "/cpulist"), &cpus);
+    return cpus;
+}
+
+int Affinity::Cpu_Node(int cpu) {
+    DIR* dir = opendir(("/sys/devices/system/cpu/cpu" + to_string(cpu)).c_str());
+    if (!dir) { return -1; }
+    int node = -1;
+    while (struct dirent* ent = readdir(dir)) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && isdigit(ent->d_name[4])) {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// 网卡的中断: /proc/interrupts 中名字包含网卡名的中断，找不到时用网卡PCI设备的MSI中断
+// 其中名字像接收队列的(rx/input/TxRx/comp)优先，再读出这些中断实际投递到的CPU
+vector<int> Affinity::Irq_Cpus(const string& iface) {
+    vector<int> msi;
+    for (const string& path : {"/sys/class/net/" + iface + "/device/msi_irqs",
+                               "/sys/class/net/" + iface + "/device/../msi_irqs"}) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) { continue; }
+        while (struct dirent* ent = readdir(dir)) {
+            if (isdigit(ent->d_name[0])) { msi.push_back(atoi(ent->d_name)); }
+        }
+        closedir(dir);
+        if (!msi.empty()) { break; }
+    }
+
+    vector<int> named, device, rx;
+    ifstream in("/proc/interrupts");
+    string line;
+    while (getline(in, line)) {
+        char* end = nullptr;
+        long irq = strtol(line.c_str(), &end, 10);
+        if (end == line.c_str() || *end != ':') { continue; }
+        string name = line.substr(line.find_last_of(" \t") + 1);
+        string lower = name;
+        transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        bool isRx = lower.find("rx") != string::npos || lower.find("input") != string::npos ||
+                    lower.find("comp") != string::npos;
+        bool match = name.find(iface) != string::npos;
+        if (!match && find(msi.begin(), msi.end(), irq) == msi.end()) { continue; }
+        (match ? named : device).push_back(static_cast<int>(irq));
+        if (isRx) { rx.push_back(static_cast<int>(irq)); }
+    }
+    const vector<int>& irqs = !rx.empty() ? rx : (!named.empty() ? named : device);
+
+    vector<int> cpus;
+    for (int irq : irqs) {
+        string base = "/proc/irq/" + to_string(irq);
+        string list = Read_Line(base + "/effective_affinity_list");
+        if (list.empty()) { list = Read_Line(base + "/smp_affinity_list"); }
+        vector<int> irqCpus;
+        if (Parse_CpuList(list, &irqCpus)) { cpus.insert(cpus.end(), irqCpus.begin(), irqCpus.end()); }
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+bool Affinity::Pin_Thread(const vector<int>& cpus) {
+    if (cpus.empty()) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) { CPU_SET(cpu, &set); }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// MPOL_PREFERRED: 优先在node上分配，node内存不足时仍可以用其他节点
+bool Affinity::Prefer_Node(int node) {
+    if (node < 0 || node >= 64) { return false; }
+    unsigned long mask = 1UL << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) == 0;
+}
@@ -0,0 +1,349 @@
+// 微基准测试: Buffer, HttpRequest::parse, 请求/响应的堆分配次数, HeapTimer, ThreadPool
+// 输出为制表符分隔的结果(名称 参数 ns/op ops/s)，可用 -b 与保存的基线比较
+//
+//   ./bin/bench [-c corpusDir] [-o result.tsv] [-b baseline.tsv] [-t threshold%] [-f filter]
+
+#include "../include/buffer.h"
+#include "../include/httprequest.h"
+#include "../include/httpresponse.h"
+#include "../include/heaptimer.h"
+#include "../include/threadpool.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+using namespace std;
+
+// 编译选项(由Makefile传入)，写进结果的注释行; 与基线的选项不同时比较没有意义
+#ifndef BENCH_FLAGS
+#define BENCH_FLAGS "unknown"
+#endif
+static const char BUILD_LINE[] = "# build: " BENCH_FLAGS;
+
+struct Result {
+    string name;
+    string param;
+    double nsPerOp;
+};
+
+static vector<Result> g_results;
+static string g_filter;
+
+static uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// 运行 body(ops) 若干轮，取最快的一轮(受干扰最小)
+template<class F>
+static void Bench(const string& name, const string& param, uint64_t ops, F&& body, int rounds = 5) {
+    if (!g_filter.empty() && name.find(g_filter) == string::npos) { return; }
+    double best = 1e30;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t t0 = NowNs();
+        body(ops);
+        uint64_t t1 = NowNs();
+        best = min(best, static_cast<double>(t1 - t0) / ops);
+    }
+    g_results.push_back({name, param, best});
+    fprintf(stderr, "%-28s %-14s %12.1f ns/op\n", name.c_str(), param.c_str(), best);
+}
+
+static void Report(const string& name, const string& param, double nsPerOp) {
+    if (!g_filter.empty() && name.find(g_filter) == string::npos) { return; }
+    g_results.push_back({name, param, nsPerOp});
+    fprintf(stderr, "%-28s %-14s %12.1f ns/op\n", name.c_str(), param.c_str(), nsPerOp);
+}
+
+static volatile size_t g_sink;
+
+// 统计operator new的调用次数(只计数，分配仍由malloc完成)
+static atomic<uint64_t> g_newCalls(0);
+
+void* operator new(size_t size) {
+    g_newCalls.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) { throw bad_alloc(); }
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static void BenchBuffer() {
+    for (size_t chunk : {16, 256, 4096}) {
+        string data(chunk, 'x');
+        Bench("buffer.append", to_string(chunk) + "B", 100000, [&](uint64_t ops) {
+            Buffer buff;
+            for (uint64_t i = 0; i < ops; i++) {
+                buff.Append(data);
+                if (buff.ReadableBytes() >= 64 * 1024) { buff.Retrieve(buff.ReadableBytes()); }
+            }
+            g_sink = buff.ReadableBytes();
+        });
+    }
+
+    for (size_t size : {1024, 64 * 1024}) {
+        Bench("buffer.retrieveall", to_string(size) + "B", 100000, [&](uint64_t ops) {
+            Buffer buff(size);
+            for (uint64_t i = 0; i < ops; i++) {
+                buff.Append("GET / HTTP/1.1\r\n", 16);
+                buff.RetrieveAll();
+            }
+            g_sink = buff.WritableBytes();
+        });
+    }
+
+    // 从socketpair读取: 小请求(全部落在buffer内)和大请求(溢出到栈上临时区)
+    for (size_t msg : {512, 32 * 1024}) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) { return; }
+        int sz = 1 << 20;
+        setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+        setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+        string data(msg, 'r');
+        Bench("buffer.readfd", to_string(msg) + "B", 20000, [&](uint64_t ops) {
+            Buffer buff;
+            int err = 0;
+            for (uint64_t i = 0; i < ops; i++) {
+                if (::write(sv[0], data.data(), data.size()) < 0) { break; }
+                size_t got = 0;
+                while (got < msg) {
+                    ssize_t n = buff.ReadFd(sv[1], &err);
+                    if (n <= 0) { break; }
+                    got += n;
+                }
+                buff.RetrieveAll();
+            }
+        });
+        close(sv[0]);
+        close(sv[1]);
+    }
+}
+
+static vector<pair<string, string>> LoadCorpus(const string& dir) {
+    vector<pair<string, string>> corpus;
+    DIR* d = opendir(dir.c_str());
+    if (!d) { return corpus; }
+    while (struct dirent* ent = readdir(d)) {
+        string name = ent->d_name;
+        if (name.size() < 5 || name.substr(name.size() - 4) != ".req") { continue; }
+        ifstream in(dir + "/" + name, ios::binary);
+        stringstream ss;
+        ss << in.rdbuf();
+        corpus.emplace_back(name.substr(0, name.size() - 4), ss.str());
+    }
+    closedir(d);
+    sort(corpus.begin(), corpus.end());
+    return corpus;
+}
+
+static void BenchParse(const string& corpusDir) {
+    auto corpus = LoadCorpus(corpusDir);
+    if (corpus.empty()) {
+        fprintf(stderr, "no corpus in %s, skip httprequest.parse\n", corpusDir.c_str());
+        return;
+    }
+    for (auto& item : corpus) {
+        const string& raw = item.second;
+        Bench("httprequest.parse", item.first, 2000, [&](uint64_t ops) {
+            Buffer buff;
+            HttpRequest request;
+            for (uint64_t i = 0; i < ops; i++) {
+                buff.Append(raw);
+                request.Init();
+                request.parse(buff);
+                buff.RetrieveAll();
+            }
+            g_sink = request.path().size();
+        });
+    }
+}
+
+// 同一连接上的稳态: 解析请求 + 生成响应(资源目录下的文件)，预热后每个请求的堆分配次数应为0
+// 结果是 次数/请求，不是ns/op，只打印不参与基线比较
+static void BenchAllocs(const string& corpusDir) {
+    if (!g_filter.empty() && string("httprequest.allocs").find(g_filter) == string::npos) { return; }
+    const int WARMUP = 16, OPS = 1000;
+    for (auto& item : LoadCorpus(corpusDir)) {
+        Buffer in, out;
+        HttpRequest request;
+        HttpResponse response;
+        uint64_t news = 0, blocks = 0;
+        for (int i = 0; i < WARMUP + OPS; i++) {
+            if (i == WARMUP) {
+                news = g_newCalls.load();
+                blocks = Arena::heapAllocs.load();
+            }
+            in.Append(item.second);
+            request.Init();
+            request.parse(in);
+            in.RetrieveAll();
+            response.Init("./resources", request.path(), request.IsKeepAlive(), 200);
+            response.SetKeepAlive(60, 100);
+            response.Make_Response(out);
+            response.UnmapFile();
+            out.RetrieveAll();
+        }
+        fprintf(stderr, "%-28s %-14s %12.2f allocs/op (arena blocks %.2f)\n", "httprequest.allocs", item.first.c_str(),
+                static_cast<double>(g_newCalls.load() - news) / OPS,
+                static_cast<double>(Arena::heapAllocs.load() - blocks) / OPS);
+    }
+}
+
+static void BenchTimer() {
+    for (int n : {10000, 100000, 1000000}) {
+        string param = to_string(n);
+        mt19937 rng(n);
+        vector<int> timeouts(n);
+        for (auto& t : timeouts) { t = 1000 + rng() % 60000; }
+
+        Bench("heaptimer.add", param, n, [&](uint64_t ops) {
+            HeapTimer timer;
+            for (uint64_t i = 0; i < ops; i++) {
+                timer.add(i, timeouts[i], []{});
+            }
+        }, 3);
+
+        HeapTimer timer;
+        for (int i = 0; i < n; i++) { timer.add(i, timeouts[i], []{}); }
+        Bench("heaptimer.adjust", param, n, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++) {
+                timer.adjust(rng() % n, 60000 + rng() % 1000);
+            }
+        }, 3);
+
+        // tick: 全部定时器已到期，逐个弹出并执行回调(只计tick本身)
+        double best = 1e30;
+        for (int r = 0; r < 3; r++) {
+            HeapTimer expired;
+            for (int i = 0; i < n; i++) { expired.add(i, 0, []{}); }
+            uint64_t t0 = NowNs();
+            expired.tick();
+            best = min(best, static_cast<double>(NowNs() - t0) / n);
+        }
+        Report("heaptimer.tick", param, best);
+    }
+}
+
+static void BenchThreadPool() {
+    unsigned hw = max(2u, thread::hardware_concurrency());
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        if (threads > hw) { break; }
+        string param = to_string(threads) + "t";
+        ThreadPool pool(threads);
+        // 吞吐: 主线程连续投递空任务，等待全部执行完
+        Bench("threadpool.addtask", param, 200000, [&](uint64_t ops) {
+            atomic<uint64_t> done(0);
+            for (uint64_t i = 0; i < ops; i++) {
+                pool.AddTask([&done] { done.fetch_add(1, memory_order_relaxed); });
+            }
+            while (done.load() < ops) { this_thread::yield(); }
+        }, 3);
+
+        // 交接延迟: 投递到开始执行的时间(空闲线程池，逐个投递)
+        if (!g_filter.empty() && string("threadpool.handoff").find(g_filter) == string::npos) { continue; }
+        const int samples = 20000;
+        vector<uint64_t> lat(samples);
+        atomic<int> done(0);
+        for (int i = 0; i < samples; i++) {
+            uint64_t t0 = NowNs();
+            pool.AddTask([&lat, &done, t0, i] {
+                lat[i] = NowNs() - t0;
+                done.fetch_add(1, memory_order_release);
+            });
+            while (done.load(memory_order_acquire) <= i) { this_thread::yield(); }
+        }
+        sort(lat.begin(), lat.end());
+        Report("threadpool.handoff.p50", param, lat[samples / 2]);
+        Report("threadpool.handoff.p99", param, lat[samples * 99 / 100]);
+    }
+}
+
+static void WriteResults(const string& path) {
+    FILE* out = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return;
+    }
+    fprintf(out, "%s\n# name\tparam\tns_per_op\tops_per_sec\n", BUILD_LINE);
+    for (auto& r : g_results) {
+        fprintf(out, "%s\t%s\t%.1f\t%.0f\n", r.name.c_str(), r.param.c_str(),
+                r.nsPerOp, r.nsPerOp > 0 ? 1e9 / r.nsPerOp : 0);
+    }
+    if (out != stdout) { fclose(out); }
+}
+
+// 与基线比较，ns/op 变慢超过阈值的记为回退，返回回退项数
+static int Compare(const string& path, double threshold) {
+    ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "cannot open baseline %s\n", path.c_str());
+        return -1;
+    }
+    map<string, double> base;
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 9, "# build: ") == 0 && line != BUILD_LINE) {
+            fprintf(stderr, "baseline %s (this binary: %s)\n", line.c_str() + 2, BENCH_FLAGS);
+        }
+        if (line.empty() || line[0] == '#') { continue; }
+        stringstream ss(line);
+        string name, param, ns;
+        getline(ss, name, '\t');
+        getline(ss, param, '\t');
+        getline(ss, ns, '\t');
+        base[name + "/" + param] = atof(ns.c_str());
+    }
+    int regressions = 0;
+    fprintf(stderr, "\n%-42s %12s %12s %9s\n", "benchmark", "baseline", "current", "delta");
+    for (auto& r : g_results) {
+        auto it = base.find(r.name + "/" + r.param);
+        if (it == base.end() || it->second <= 0) { continue; }
+        double delta = (r.nsPerOp - it->second) / it->second * 100.0;
+        bool bad = delta > threshold;
+        regressions += bad;
+        fprintf(stderr, "%-42s %12.1f %12.1f %+8.1f%%%s\n", (r.name + "/" + r.param).c_str(),
+                it->second, r.nsPerOp, delta, bad ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    string corpusDir = "./bench/corpus";
+    string output, baseline;
+    double threshold = 10.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:o:b:t:f:")) != -1) {
+        switch (opt) {
+            case 'c': corpusDir = optarg; break;
+            case 'o': output = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'f': g_filter = optarg; break;
+            default:
+                fprintf(stderr, "bench [-c corpusDir] [-o result.tsv] [-b baseline.tsv] [-t threshold%%] [-f filter]\n");
+                return 2;
+        }
+    }
+
+    BenchBuffer();
+    BenchParse(corpusDir);
+    BenchAllocs(corpusDir);
+    BenchTimer();
+    BenchThreadPool();
+
+    WriteResults(output);
+    if (!baseline.empty()) {
+        int regressions = Compare(baseline, threshold);
+        return regressions == 0 ? 0 : 1;
+    }
+    return 0;
+}
@@ -49,6 +49,15 @@ void Buffer::RetrieveAll() {
     m_writePos = 0;
 }
 
+// 清空buffer并把容量恢复为size(连接复用时释放上个连接扩出来的空间)
+void Buffer::Reset(size_t size) {
+    if(m_buffer.size() != size) {
+        std::vector<char>(size).swap(m_buffer);
+    }
+    m_readPos = 0;
+    m_writePos = 0;
+}
+
 // 把可读区域移到str, 并清空
 std::string Buffer::RetrieveAllToStr() {
     std::string str(Peek(), ReadableBytes());
@@ -0,0 +1,160 @@
+#include "../include/outqueue.h"
+#include <algorithm>
+using namespace std;
+
+OutQueue::OutQueue(int buffSize) : m_buff(buffSize), m_staged(0), m_head(0), m_bytes(0), m_cork(false) {}
+
+OutQueue::~OutQueue() {
+    Clear();
+}
+
+void OutQueue::_Push(Type type, const char* data, size_t len, char* map, size_t mapLen, int fd, Policy flush) {
+    m_bytes += len;
+    // 连续的字节片段合并(在暂存buffer中本来就是连续的)
+    if (type == BYTES && m_head < m_segs.size()) {
+        Segment& last = m_segs.back();
+        if (last.type == BYTES && last.flush == FLUSH_BATCH) {
+            last.len += len;
+            last.flush = flush;
+            return;
+        }
+    }
+    m_segs.push_back(Segment{ type, data, len, map, mapLen, fd, flush });
+}
+
+void OutQueue::Push_Staged(Policy flush) {
+    size_t len = m_buff.ReadableBytes() - m_staged;
+    if (len == 0) { return; }
+    m_staged += len;
+    _Push(BYTES, nullptr, len, nullptr, 0, -1, flush);
+}
+
+void OutQueue::Push_File(char* map, size_t len, int fd, Policy flush) {
+    if (len == 0) {
+        if (fd >= 0) { close(fd); }
+        return;
+    }
+    _Push(FILE, map, len, map, len, fd, flush);
+}
+
+void OutQueue::Push_Blob(const char* data, size_t len, Policy flush) {
+    if (len == 0) { return; }
+    _Push(BLOB, data, len, nullptr, 0, -1, flush);
+}
+
+// 从队列头部收集片段，遇到FLUSH_NOW的片段、达到MAX_IOV或limit为止
+// 后面还有数据要接着发时带MSG_MORE: 这次的尾巴和下一次的开头合成满MSS的报文
+ssize_t OutQueue::Flush(int fd, int* saveErrno, size_t limit) {
+    struct iovec iov[MAX_IOV];
+    int cnt = 0;
+    size_t off = 0;
+    size_t total = 0;
+    size_t i = m_head;
+    while (i < m_segs.size() && cnt < MAX_IOV && (limit == 0 || total < limit)) {
+        const Segment& seg = m_segs[i++];
+        if (seg.type == BYTES) {
+            iov[cnt].iov_base = const_cast<char*>(m_buff.Peek()) + off;
+            off += seg.len;
+        } else {
+            iov[cnt].iov_base = const_cast<char*>(seg.data);
+        }
+        iov[cnt].iov_len = seg.len;
+        if (limit && total + seg.len > limit) { iov[cnt].iov_len = limit - total; }
+        total += iov[cnt].iov_len;
+        cnt++;
+        if (seg.flush == FLUSH_NOW) { break; }
+    }
+    if (cnt == 0) { return 0; }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = cnt;
+    int flags = MSG_NOSIGNAL;
+    bool cut = iov[cnt - 1].iov_len < m_segs[i - 1].len;    // 最后一个片段被limit截断
+    if (m_cork && total < m_bytes && (cut || m_segs[i - 1].flush != FLUSH_NOW)) { flags |= MSG_MORE; }
+    ssize_t len = sendmsg(fd, &msg, flags);
+    if (len < 0) {
+        *saveErrno = errno;
+        return len;
+    }
+    _Consume(len);
+    return len;
+}
+
+// mincore只看映射所在的页缓存; 没有写权限的文件内核只报告本进程页表中已有的页，
+// 所以对第一个报告不在的页再用preadv2(RWF_NOWAIT)读1字节确认: 在页缓存中时不会返回EAGAIN
+bool OutQueue::Cold(size_t window, FileRange* range) const {
+    static const size_t PAGE = sysconf(_SC_PAGESIZE);
+    for (size_t i = m_head; i < m_segs.size() && window > 0; i++) {
+        const Segment& seg = m_segs[i];
+        size_t n = min(window, seg.len);
+        window -= n;
+        if (seg.type != FILE || seg.fd < 0 || seg.mapLen < MIN_PROBE_LEN) { continue; }
+        uintptr_t start = reinterpret_cast<uintptr_t>(seg.data) & ~(PAGE - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(seg.data) + n;
+        size_t pages = min((end - start + PAGE - 1) / PAGE, MAX_PROBE_PAGES);
+        unsigned char vec[MAX_PROBE_PAGES];
+        if (mincore(reinterpret_cast<void*>(start), pages * PAGE, vec) < 0) { continue; }
+        size_t miss = 0;
+        while (miss < pages && (vec[miss] & 1)) { miss++; }
+        if (miss == pages) { continue; }
+        off_t off = static_cast<off_t>(start + miss * PAGE - reinterpret_cast<uintptr_t>(seg.map));
+        char byte;
+        struct iovec iov = { &byte, 1 };
+        if (preadv2(seg.fd, &iov, 1, off, RWF_NOWAIT) >= 0 || errno != EAGAIN) { continue; }
+        range->fd = seg.fd;
+        range->off = off;
+        range->len = end - (start + miss * PAGE);
+        return true;
+    }
+    return false;
+}
+
+void OutQueue::_Consume(size_t len) {
+    m_bytes -= len;
+    while (len > 0) {
+        Segment& seg = m_segs[m_head];
+        size_t n = min(len, seg.len);
+        if (seg.type == BYTES) {
+            m_buff.Retrieve(n);
+            m_staged -= n;
+        } else {
+            seg.data += n;
+        }
+        seg.len -= n;
+        len -= n;
+        if (seg.len == 0) {
+            _Release(seg);
+            m_head++;
+        }
+    }
+    if (m_head == m_segs.size()) {
+        m_segs.clear();
+        m_head = 0;
+    }
+}
+
+void OutQueue::_Release(Segment& seg) {
+    if (seg.type == FILE && seg.map) {
+        munmap(seg.map, seg.mapLen);
+        seg.map = nullptr;
+    }
+    if (seg.fd >= 0) {
+        close(seg.fd);
+        seg.fd = -1;
+    }
+}
+
+void OutQueue::Clear() {
+    for (size_t i = m_head; i < m_segs.size(); i++) { _Release(m_segs[i]); }
+    m_segs.clear();
+    m_head = 0;
+    m_bytes = 0;
+    m_staged = 0;
+    m_buff.RetrieveAll();
+}
+
+void OutQueue::Reset(size_t size) {
+    Clear();
+    m_buff.Reset(size);
+}
@@ -1,18 +1,103 @@
 #include "../include/config.h"
+#include <fstream>
+using namespace std;
 
 Config::Config() {
+    _Set_Defaults();
+}
+
+void Config::_Set_Defaults() {
     m_port = 8092;
+    m_listen.clear();
     m_optLinger = 0;
     m_trigMode = 3;
     m_timeout = 60000;
+    m_backlog = 1024;
+    m_drainTimeout = 30000;
+    m_acceptBatch = 64;
+    m_deferAccept = 1;
+    m_fastOpen = 0;
+    m_maxConn = 0;
+    m_evictPercent = 90;
+    m_maxRequests = 1000;
     m_threadPoolNum = 8;
+    m_readBuffSize = 1024;
+    m_writeBuffSize = 1024;
+    m_writeQuantumKB = 256;
+    m_writeQuantumUs = 1000;
+    m_ioThreads = 2;
+    m_root = "resource";
+    m_maxBodyKB = 8192;
+    m_spoolKB = 256;
+    m_spoolDir = "/tmp";
+    m_uploadDir = "upload";
+
+    m_sqlHost = "127.0.0.1";
+    m_sqlPort = 3306;
+    m_sqlUser = "root";
+    m_sqlPwd = "********";
+    m_dbName = "laidb";
     m_sqlPoolNum = 10;
 
+    m_openLog = true;
+    m_logLevel = 1;
+    m_logStagingKB = 64;
+    m_traceSample = 0;
+
+    m_reactorCpu = -1;
+    m_workerCpus = "";
+    m_numaNode = -1;
+    m_irqIface = "";
+
+    m_overloadTargetMs = 5;
+    m_overloadIntervalMs = 100;
+    m_retryAfter = 1;
+
+    m_connRate = 0;
+    m_connBurst = 20;
+    m_reqRate = 0;
+    m_reqBurst = 50;
+    m_rateRules.clear();
+    m_rateSlots = 65536;
+
+    m_aclAllow.clear();
+    m_aclDeny.clear();
+    m_aclAllowFile = "";
+    m_aclDenyFile = "";
+
+    m_http2 = true;
+    m_h2MaxStreams = 100;
+
+    m_wsPath = "/live";
+    m_wsIntervalMs = 1000;
+    m_wsMaxMessage = 65536;
+    m_wsQueueKB = 1024;
 }
+
 void Config::Parse_Arg(int argc, char* argv[]) {
+    m_args.assign(argv, argv + argc);
+    // 先找出配置文件，加载后再用命令行参数覆盖
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0) {
+            m_configFile = argv[i + 1];
+        }
+    }
+    if (!m_configFile.empty() && !Load_File(m_configFile)) {
+        fprintf(stderr, "load config file %s error!\n", m_configFile.c_str());
+    }
+    _Apply_Args(m_args);
+}
+
+void Config::_Apply_Args(const vector<string>& args) {
+    vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
     int opt;
-    const char* str = "p:o:m:T:t:s:";
-    while (~(opt = getopt(argc, argv, str))) {
+    const char* str = "p:o:m:T:t:s:l:v:S:f:";
+    optind = 1;
+    while (~(opt = getopt(static_cast<int>(args.size()), argv.data(), str))) {
         switch(opt) {
             case 'p': m_port = atoi(optarg); break;
             case 'o': m_optLinger = atoi(optarg); break;
@@ -20,7 +105,159 @@ void Config::Parse_Arg(int argc, char* argv[]) {
             case 'T': m_timeout = atoi(optarg); break;
             case 't': m_threadPoolNum = atoi(optarg); break;
             case 's': m_sqlPoolNum = atoi(optarg); break;
+            case 'l': m_openLog = atoi(optarg); break;
+            case 'v': m_logLevel = atoi(optarg); break;
+            case 'S': m_traceSample = atoi(optarg); break;
+            case 'f': break;
+        }
+    }
+}
+
+// 重新读取: 默认值 -> 配置文件 -> 命令行参数
+bool Config::Reload() {
+    if (m_configFile.empty()) { return false; }
+    Config cfg;
+    cfg.m_configFile = m_configFile;
+    cfg.m_args = m_args;
+    if (!cfg.Load_File(m_configFile)) { return false; }
+    cfg._Apply_Args(m_args);
+    *this = cfg;
+    return true;
+}
+
+static string Trim(const string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) { return ""; }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+// INI格式: [section] 下为 key = value，# 或 ; 开头为注释(值后面空白加 # 或 ; 也是注释)
+bool Config::Load_File(const string& path) {
+    ifstream in(path);
+    if (!in) { return false; }
+    string line, section;
+    int lineNo = 0;
+    bool ok = true;
+    while (getline(in, line)) {
+        lineNo++;
+        line = Trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';') { continue; }
+        if (line[0] == '[') {
+            size_t end = line.find(']');
+            if (end == string::npos) {
+                fprintf(stderr, "%s:%d: bad section\n", path.c_str(), lineNo);
+                ok = false;
+                continue;
+            }
+            section = Trim(line.substr(1, end - 1));
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == string::npos) {
+            fprintf(stderr, "%s:%d: expect key = value\n", path.c_str(), lineNo);
+            ok = false;
+            continue;
+        }
+        string key = Trim(line.substr(0, eq));
+        string value = line.substr(eq + 1);
+        // 行尾注释: 空白后跟 # 或 ;
+        for (size_t i = 1; i < value.size(); i++) {
+            if ((value[i] == '#' || value[i] == ';') && (value[i - 1] == ' ' || value[i - 1] == '\t')) {
+                value.erase(i);
+                break;
+            }
+        }
+        value = Trim(value);
+        if (!_Set(section, key, value)) {
+            fprintf(stderr, "%s:%d: unknown key %s.%s\n", path.c_str(), lineNo, section.c_str(), key.c_str());
+            ok = false;
         }
     }
+    return ok;
 }
 
+bool Config::_Set(const string& section, const string& key, const string& value) {
+    int num = atoi(value.c_str());
+    if (section == "server") {
+        if (key == "port") { m_port = num; }
+        else if (key == "listen") { m_listen.push_back(value); }     // 可以出现多次
+        else if (key == "opt_linger") { m_optLinger = num; }
+        else if (key == "trig_mode") { m_trigMode = num; }
+        else if (key == "timeout") { m_timeout = num; }
+        else if (key == "backlog") { m_backlog = num; }
+        else if (key == "drain_timeout") { m_drainTimeout = num; }
+        else if (key == "accept_batch") { m_acceptBatch = num; }
+        else if (key == "defer_accept") { m_deferAccept = num; }
+        else if (key == "fastopen") { m_fastOpen = num; }
+        else if (key == "max_conn") { m_maxConn = num; }
+        else if (key == "evict_percent") { m_evictPercent = num; }
+        else if (key == "max_requests") { m_maxRequests = num; }
+        else if (key == "thread_num") { m_threadPoolNum = num; }
+        else if (key == "read_buffer") { m_readBuffSize = num; }
+        else if (key == "write_buffer") { m_writeBuffSize = num; }
+        else if (key == "write_quantum_kb") { m_writeQuantumKB = num; }
+        else if (key == "write_quantum_us") { m_writeQuantumUs = num; }
+        else if (key == "io_threads") { m_ioThreads = num; }
+        else if (key == "root") { m_root = value; }
+        else if (key == "max_body_kb") { m_maxBodyKB = num; }
+        else if (key == "spool_kb") { m_spoolKB = num; }
+        else if (key == "spool_dir") { m_spoolDir = value; }
+        else if (key == "upload_dir") { m_uploadDir = value; }
+        else { return false; }
+    } else if (section == "mysql") {
+        if (key == "host") { m_sqlHost = value; }
+        else if (key == "port") { m_sqlPort = num; }
+        else if (key == "user") { m_sqlUser = value; }
+        else if (key == "password") { m_sqlPwd = value; }
+        else if (key == "database") { m_dbName = value; }
+        else if (key == "pool_size") { m_sqlPoolNum = num; }
+        else { return false; }
+    } else if (section == "log") {
+        if (key == "open") { m_openLog = num; }
+        else if (key == "level") { m_logLevel = num; }
+        else if (key == "staging_kb") { m_logStagingKB = num; }
+        else { return false; }
+    } else if (section == "trace") {
+        if (key == "sample") { m_traceSample = num; }
+        else { return false; }
+    } else if (section == "cpu") {
+        if (key == "reactor") { m_reactorCpu = value.empty() ? -1 : num; }
+        else if (key == "workers") { m_workerCpus = value; }
+        else if (key == "numa_node") { m_numaNode = value.empty() ? -1 : num; }
+        else if (key == "irq_iface") { m_irqIface = value; }
+        else { return false; }
+    } else if (section == "overload") {
+        if (key == "target_ms") { m_overloadTargetMs = num; }
+        else if (key == "interval_ms") { m_overloadIntervalMs = num; }
+        else if (key == "retry_after") { m_retryAfter = num; }
+        else { return false; }
+    } else if (section == "ratelimit") {
+        if (key == "conn_rate") { m_connRate = atof(value.c_str()); }
+        else if (key == "conn_burst") { m_connBurst = num; }
+        else if (key == "req_rate") { m_reqRate = atof(value.c_str()); }
+        else if (key == "req_burst") { m_reqBurst = num; }
+        else if (key == "path") { m_rateRules.push_back(value); }   // 可以出现多次
+        else if (key == "slots") { m_rateSlots = num; }
+        else { return false; }
+    } else if (section == "acl") {
+        if (key == "allow") { m_aclAllow.push_back(value); }     // 可以出现多次
+        else if (key == "deny") { m_aclDeny.push_back(value); }
+        else if (key == "allow_file") { m_aclAllowFile = value; }
+        else if (key == "deny_file") { m_aclDenyFile = value; }
+        else { return false; }
+    } else if (section == "http2") {
+        if (key == "enable") { m_http2 = num; }
+        else if (key == "max_streams") { m_h2MaxStreams = num; }
+        else { return false; }
+    } else if (section == "websocket") {
+        if (key == "path") { m_wsPath = value; }
+        else if (key == "interval_ms") { m_wsIntervalMs = num; }
+        else if (key == "max_message") { m_wsMaxMessage = num; }
+        else if (key == "queue_kb") { m_wsQueueKB = num; }
+        else { return false; }
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,163 @@
+#include "../include/headermap.h"
+using namespace std;
+
+namespace {
+
+struct Name {
+    const char* str;
+    size_t len;
+};
+
+// 常用头部的名字(小写)，顺序与HeaderMap::Id一致
+constexpr Name NAMES[] = {
+    { "host", 4 },
+    { "connection", 10 },
+    { "keep-alive", 10 },
+    { "content-length", 14 },
+    { "content-type", 12 },
+    { "transfer-encoding", 17 },
+    { "expect", 6 },
+    { "upgrade", 7 },
+    { "http2-settings", 14 },
+    { "sec-websocket-key", 17 },
+    { "sec-websocket-version", 21 },
+    { "user-agent", 10 },
+    { "accept", 6 },
+    { "accept-encoding", 15 },
+    { "accept-language", 15 },
+    { "cookie", 6 },
+    { "referer", 7 },
+    { "origin", 6 },
+    { "authorization", 13 },
+    { "cache-control", 13 },
+    { "pragma", 6 },
+    { "if-modified-since", 17 },
+    { "if-none-match", 13 },
+    { "range", 5 },
+    { "x-forwarded-for", 15 },
+};
+constexpr size_t NAME_COUNT = sizeof(NAMES) / sizeof(NAMES[0]);
+static_assert(NAME_COUNT == HeaderMap::COUNT, "header name table does not match HeaderMap::Id");
+static_assert(HeaderMap::COUNT <= 32, "m_present has 32 bits");
+
+constexpr int TABLE_BITS = 7;
+constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+constexpr uint8_t EMPTY = 0xff;
+
+constexpr char Lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+// 只取长度和首、中、尾三个字节(忽略大小写)，乘以种子取高位; 命中槽位后再比较完整的名字
+constexpr uint32_t Hash(const char* s, size_t len, uint32_t seed) {
+    return ((static_cast<uint32_t>(len) << 24 | static_cast<uint32_t>(static_cast<uint8_t>(Lower(s[0]))) << 16 |
+             static_cast<uint32_t>(static_cast<uint8_t>(Lower(s[len / 2]))) << 8 |
+             static_cast<uint32_t>(static_cast<uint8_t>(Lower(s[len - 1])))) * seed) >> (32 - TABLE_BITS);
+}
+
+constexpr bool Collision_Free(uint32_t seed) {
+    bool used[TABLE_SIZE] = {};
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        uint32_t h = Hash(NAMES[i].str, NAMES[i].len, seed);
+        if (used[h]) { return false; }
+        used[h] = true;
+    }
+    return true;
+}
+
+// 编译期搜索使所有常用名字互不冲突的种子(找不到时编译失败)
+constexpr uint32_t Find_Seed() {
+    uint32_t seed = 0x9e3779b1u;
+    while (!Collision_Free(seed)) { seed += 2; }
+    return seed;
+}
+
+struct Table {
+    uint32_t seed;
+    uint8_t slot[TABLE_SIZE];
+};
+
+constexpr Table Build() {
+    Table table{ Find_Seed(), {} };
+    for (uint32_t i = 0; i < TABLE_SIZE; i++) { table.slot[i] = EMPTY; }
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        table.slot[Hash(NAMES[i].str, NAMES[i].len, table.seed)] = static_cast<uint8_t>(i);
+    }
+    return table;
+}
+
+constexpr Table TABLE = Build();
+
+} // namespace
+
+int HeaderMap::Lookup(const char* name, size_t len) {
+    if (len == 0) { return -1; }
+    uint8_t id = TABLE.slot[Hash(name, len, TABLE.seed)];
+    if (id == EMPTY || NAMES[id].len != len) { return -1; }
+    for (size_t i = 0; i < len; i++) {
+        if (Lower(name[i]) != NAMES[id].str[i]) { return -1; }
+    }
+    return id;
+}
+
+// 存储的容量保留给同一连接上的下一个请求
+void HeaderMap::Clear() {
+    m_data.clear();
+    m_present = 0;
+    m_lines = 0;
+    m_unknown = 0;
+    m_overflow.clear();
+}
+
+HeaderMap::Span HeaderMap::_Append(const char* data, size_t len) {
+    Span span{ static_cast<uint32_t>(m_data.size()), static_cast<uint32_t>(len) };
+    m_data.append(data, len);
+    return span;
+}
+
+// 重复的常用头部也计入行数，不能靠重复同一个头部绕过上限
+bool HeaderMap::Add(const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    if (m_lines >= MAX_FIELDS) { return false; }
+    m_lines++;
+    int id = Lookup(name, nameLen);
+    if (id >= 0) {
+        if (Has(static_cast<Id>(id))) {
+            // 合并: 旧值, 新值; 旧值在存储末尾时原地追加，否则先搬到末尾(原来的位置不再引用)，
+            // 连续重复的头部只追加新值，不会每次重新拷贝已合并的部分
+            Span& known = m_known[id];
+            if (known.off + known.len != m_data.size()) {
+                Span old = known;
+                known.off = static_cast<uint32_t>(m_data.size());
+                m_data.append(m_data, old.off, old.len);
+            }
+            m_data.append(", ");
+            m_data.append(value, valueLen);
+            known.len = static_cast<uint32_t>(m_data.size() - known.off);
+            return true;
+        }
+        m_known[id] = _Append(value, valueLen);
+        m_present |= 1u << id;
+        return true;
+    }
+    Field field{ _Append(name, nameLen), _Append(value, valueLen) };
+    if (m_unknown < INLINE_FIELDS) {
+        m_inline[m_unknown] = field;
+    } else {
+        m_overflow.push_back(field);
+    }
+    m_unknown++;
+    return true;
+}
+
+Slice HeaderMap::Get(const char* name, size_t len) const {
+    int id = Lookup(name, len);
+    if (id >= 0) { return Get(static_cast<Id>(id)); }
+    Slice key(name, len);
+    for (size_t i = 0; i < m_unknown; i++) {
+        const Field& field = _Unknown(i);
+        if (_Slice(field.name).EqualsNoCase(key)) { return _Slice(field.value); }
+    }
+    return Slice();
+}
+
+size_t HeaderMap::Size() const {
+    return __builtin_popcount(m_present) + m_unknown;
+}
@@ -4,11 +4,35 @@ using namespace std;
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+std::atomic<int> HttpConn::readBuffSize(1024);
+std::atomic<int> HttpConn::writeBuffSize(1024);
+std::atomic<bool> HttpConn::isDraining(false);
+std::atomic<int> HttpConn::maxRequests(0);
+std::atomic<int> HttpConn::keepAliveTimeout(0);
+RateLimit* HttpConn::rateLimit = nullptr;
+Broadcaster* HttpConn::hub = nullptr;
+std::atomic<int> HttpConn::writeQuantum(256 * 1024);
+std::atomic<int> HttpConn::writeQuantumUs(1000);
+std::atomic<uint64_t> HttpConn::writeYields(0);
+std::atomic<uint64_t> HttpConn::holdNs(0);
+std::atomic<uint64_t> HttpConn::holdMaxNs(0);
+IoPool* HttpConn::ioPool = nullptr;
 
 HttpConn::HttpConn() { 
     m_fd = -1;
-    m_addr = {0};
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_ip[0] = '\0';
     m_isClose = true;
+    m_respBytes = 0;
+    m_traceId = 0;
+    m_taskBegin = m_holdNs = m_holdMaxNs = 0;
+    m_yields = 0;
+    m_gen = 0;
+    m_coldSkip = false;
+    m_idle = false;
+    m_reqCount = 0;
+    m_accessCnt = 0;
+    inLru = false;
 };
 
 HttpConn::~HttpConn() { 
@@ -16,20 +40,62 @@ HttpConn::~HttpConn() {
 };
 
 // 客户连接初始化
-void HttpConn::init(int fd, const sockaddr_in& addr) {
+void HttpConn::init(int fd, const sockaddr_storage& addr) {
     assert(fd > 0);
     userCount++;                // 客户连接数+1
     m_addr = addr;              // 客户socket地址
+    _Format_Addr();
     m_fd = fd;                  // 客户TCP连接描述符
-    m_writeBuff.RetrieveAll();  // 客户写缓冲区
-    m_readBuff.RetrieveAll();   // 客户读缓冲区
+    m_out.Reset(writeBuffSize);         // 客户输出队列
+    m_out.SetCork(addr.ss_family != AF_UNIX);
+    m_respBytes = 0;
+    m_accessCnt = 0;
+    m_readBuff.Reset(readBuffSize);     // 客户读缓冲区
     m_isClose = false;          // 客户是否关闭连接标记
+    m_idle = true;
+    m_reqCount = 0;
+    m_taskBegin = m_holdNs = m_holdMaxNs = 0;
+    m_yields = 0;
+    m_gen++;
+    m_coldSkip = false;
+    m_h2.reset();
+    m_ws.reset();
+}
+
+// 客户地址转成文本; 双栈监听收到的IPv4连接是映射地址(::ffff:a.b.c.d)，只显示IPv4部分
+void HttpConn::_Format_Addr() {
+    if (m_addr.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&m_addr)->sin_addr, m_ip, sizeof(m_ip));
+    } else if (m_addr.ss_family == AF_INET6) {
+        const struct in6_addr* in6 = &reinterpret_cast<const sockaddr_in6*>(&m_addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(in6)) {
+            inet_ntop(AF_INET, in6->s6_addr + 12, m_ip, sizeof(m_ip));
+        } else {
+            inet_ntop(AF_INET6, in6, m_ip, sizeof(m_ip));
+        }
+    } else {
+        snprintf(m_ip, sizeof(m_ip), "unix");
+    }
+}
+
+int HttpConn::GetPort() const {
+    if (m_addr.ss_family == AF_INET) { return ntohs(reinterpret_cast<const sockaddr_in*>(&m_addr)->sin_port); }
+    if (m_addr.ss_family == AF_INET6) { return ntohs(reinterpret_cast<const sockaddr_in6*>(&m_addr)->sin6_port); }
+    return 0;
 }
 
 // 关闭连接
 void HttpConn::Close() {
     m_response.UnmapFile();     // 释放共享内存
+    m_out.Clear();              // 释放还没发送完的文件映射
+    m_h2.reset();               // 释放各个流映射的文件
+    m_request.Init();           // 释放请求体临时文件，删除没有收完的上传文件
+    m_idle = false;
     if(m_isClose == false){
+        // 先退订再关闭fd: reactor分发广播时持有同一把锁，不会给已关闭(可能被复用)的fd注册事件
+        if (m_ws && hub) { hub->Unsubscribe(this); }
+        LOG_DEBUG("close %s: %d requests, worker hold %lluus (max %lluus), %u yields", m_ip, m_reqCount,
+                  static_cast<unsigned long long>(m_holdNs / 1000), static_cast<unsigned long long>(m_holdMaxNs / 1000), m_yields);
         m_isClose = true;       // 标记关闭
         userCount--;            // 连接数-1
         close(m_fd);            
@@ -44,73 +110,306 @@ ssize_t HttpConn::read(int* saveErrno) {
         if (len <= 0) {
             break;
         }
-    } while (isET);     // 边沿触发需要循环读
+    } while (isET && m_readBuff.ReadableBytes() < MAX_READ);     // 边沿触发需要循环读(上传时每次最多读MAX_READ，处理后重新注册事件再读)
     return len;
 }
 
-// 把服务器响应数据集中写给客户 
+// 把输出队列中的响应集中写给客户(每次一个sendmsg，带上尽量多的片段)
+// 一直写到队列发完、发送缓冲区满(EAGAIN)或者用完写配额: 大文件发给很快的客户端时不会一直占着工作线程，
+// 用完配额后返回正数且队列不空，由调用者重新注册EPOLLOUT，排到线程池队列的后面再继续
+// 每次sendmsg之前检查这次要发送的文件页是否在页缓存中，不在时返回-1(EINPROGRESS)，不在工作线程中等待磁盘
 ssize_t HttpConn::write(int* saveErrno) {
+    // WebSocket: 101响应发送完之后发送帧队列
+    if (m_ws && m_out.Empty()) { return m_ws->Write(m_fd, saveErrno); }
+    size_t quantum = writeQuantum > 0 ? static_cast<size_t>(writeQuantum) : 0;
+    uint64_t quantumNs = writeQuantumUs > 0 ? static_cast<uint64_t>(writeQuantumUs) * 1000 : 0;
+    uint64_t begin = quantumNs ? Trace::NowNs() : 0;
+    size_t sent = 0;
     ssize_t len = -1;
-    do {
-        len = writev(m_fd, m_iov, m_iovCnt);
-        if(len <= 0) {
-            *saveErrno = errno;
+    bool probe = ioPool && !m_coldSkip;
+    m_coldSkip = false;
+    while (true) {
+        size_t limit = quantum ? quantum - sent : 0;
+        if (probe && m_out.Cold(limit ? limit : COLD_WINDOW, &m_cold)) {
+            *saveErrno = EINPROGRESS;
+            len = -1;
             break;
         }
-        // iovec 没有数据， 说明传输结束
-        if (m_iov[0].iov_len + m_iov[1].iov_len == 0) { 
-            break; 
-        }
-        // len > m_iov[0].iov_len, 说明m_iov[0]和m_iov[1]都有数据写到fd 
-        else if(static_cast<size_t>(len) > m_iov[0].iov_len) {
-            m_iov[1].iov_base = (uint8_t*) m_iov[1].iov_base + (len - m_iov[0].iov_len);
-            m_iov[1].iov_len -= (len - m_iov[0].iov_len);
-            // m_iov[0]需要初始化(因为被写空了)
-            if(m_iov[0].iov_len) {
-                m_writeBuff.RetrieveAll();
-                m_iov[0].iov_len = 0;
-            }
+        probe = ioPool != nullptr;
+        TraceSpan span(m_traceId, "send");
+        len = m_out.Flush(m_fd, saveErrno, limit);
+        span.SetArg(len);
+        // 出错(包括EAGAIN)或者队列已发完
+        if (len <= 0 || m_out.Empty()) {
+            break;
         }
-        else {
-            m_iov[0].iov_base = (uint8_t*)m_iov[0].iov_base + len; 
-            m_iov[0].iov_len -= len; 
-            m_writeBuff.Retrieve(len);
+        sent += len;
+        if ((quantum && sent >= quantum) || (quantumNs && Trace::NowNs() - begin >= quantumNs)) {
+            m_yields++;
+            writeYields.fetch_add(1, std::memory_order_relaxed);
+            break;
         }
-    } while(isET || ToWriteBytes() > 10240); // 当m_iov的数据很大或者边沿触发时，需要循环写
+    }
     return len;
 }
 
+bool HttpConn::Read_Cold() {
+    m_coldSkip = true;
+    Trace::Instance()->Instant(m_traceId, "cold_read", Trace::NowNs(), static_cast<int64_t>(m_cold.len));
+    return ioPool->Submit(m_cold.fd, m_cold.off, m_cold.len, this, m_gen);
+}
+
+void HttpConn::EndTask() {
+    if (m_taskBegin == 0) { return; }
+    uint64_t ns = Trace::NowNs() - m_taskBegin;
+    m_taskBegin = 0;
+    m_holdNs += ns;
+    if (ns > m_holdMaxNs) { m_holdMaxNs = ns; }
+    holdNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = holdMaxNs.load(std::memory_order_relaxed);
+    while (ns > max && !holdMaxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
 // process: 3件事
 // 1. 解析客户的请求数据
 // 2. 根据解析的请求数据作出响应
-// 3. 将响应数据和响应文件放入m_iov，方便集中写
+// 3. 将响应头和响应文件排进输出队列，方便集中写
+// 输入buffer中已经有后续的完整请求(流水线)时一起处理，几个响应在同一次sendmsg中发出
 bool HttpConn::process() {
-    m_request.Init();
+    if (m_h2) { return _Process_H2(); }
+    if (m_ws) {
+        m_ws->Process(m_readBuff);
+        return false;
+    }
+    m_respBytes = m_out.Bytes();
+    bool queued = _Process_Http();
+    for (int i = 1; queued && i < MAX_PIPELINE && _Can_Pipeline(); i++) {
+        if (!_Process_Http()) { break; }
+    }
+    return queued;
+}
+
+// 是否接着处理输入buffer中的下一个请求: 只在普通的长连接上合并;
+// 开启按IP限速时每个请求都要在解析前经过reactor线程的检查，不合并
+bool HttpConn::_Can_Pipeline() const {
+    return !m_h2 && !m_ws && m_response.IsKeepAlive() && !m_request.InProgress() &&
+           m_readBuff.ReadableBytes() > 0 && m_out.Bytes() < MAX_BATCH &&
+           (!rateLimit || !rateLimit->Enabled());
+}
+
+// 处理一个HTTP/1.1请求，响应(包括100 Continue)排进输出队列时返回true; 请求还没收完时返回false
+bool HttpConn::_Process_Http() {
+    // 上一个请求已经处理完时开始新的请求; 否则继续接收请求头或请求体
+    bool fresh = !m_request.InProgress();
+    if (fresh) { m_request.Init(); }
     // 1.没有可读的客户请求数据
     if(m_readBuff.ReadableBytes() <= 0) {
         return false;
     }
-    // 2.解析客户的请求数据
-    else if(m_request.parse(m_readBuff)) {
+    // 连接上的第一个请求是HTTP/2连接前言(prior knowledge)
+    if (fresh && m_reqCount == 0 && Http2Session::enabled) {
+        int preface = Http2Session::Check_Preface(m_readBuff);
+        if (preface < 0) { return false; }      // 等待前言的其余部分
+        if (preface > 0) {
+            _New_H2();
+            return _Process_H2();
+        }
+    }
+    if (fresh) {
+        m_reqBegin = chrono::steady_clock::now();
+        m_request.SetTraceId(m_traceId);
+    }
+    // 2.解析客户的请求数据(请求体片段交给请求的接收方后从输入buffer取走)
+    bool ok = m_request.parse(m_readBuff);
+    if (ok && !m_request.IsFinished()) {
+        // 请求还没收完，等待更多数据; 客户端在等100 Continue时先回复它: 排进输出队列(在流水线上还没发出的响应后面)，
+        // 返回true注册EPOLLOUT，发送完后继续接收请求体
+        if (m_request.ClaimContinue()) {
+            static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            m_out.Push_Blob(CONTINUE, sizeof(CONTINUE) - 1, OutQueue::FLUSH_NOW);
+            return true;
+        }
+        return false;
+    }
+    m_reqCount++;
+    if(ok) {
+        if (_Upgrade_H2() || _Upgrade_Ws()) { return true; }
         // 客户请求数据解析成功， 初始化正常网页响应
-        m_response.Init(srcDir, m_request.path(), m_request.IsKeepAlive(), 200);
+        // 排空中或达到单连接请求数上限时，本次响应后关闭连接
+        int maxReq = maxRequests;
+        bool keepAlive = m_request.IsKeepAlive() && !isDraining && (maxReq <= 0 || m_reqCount < maxReq);
+        // 路由表中的处理函数: 生成响应体，或者指定要发送的文件; 没有路由时按路径发送静态文件
+        Reply reply;
+        bool content = Router::Instance()->Route(m_request, &reply);
+        if (content && !reply.file.empty()) {
+            m_request.path() = reply.file;
+            content = false;
+        }
+        m_response.Init(srcDir, m_request.path(), keepAlive, 200);
+        m_response.SetKeepAlive(keepAliveTimeout, maxReq > 0 ? maxReq - m_reqCount : 0);
+        if (content) { m_response.SetContent(reply.code, reply.type, std::move(reply.body)); }
+    } else if (m_request.ErrorCode() != 400) {
+        // 请求头太大(431)、请求体太大(413)、不支持的传输编码(501)或无法保存(500): 不再接收剩下的请求体，回复后关闭连接
+        m_parseEnd = chrono::steady_clock::now();
+        m_readBuff.RetrieveAll();
+        m_response.Make_Error(m_out.Stage(), m_request.ErrorCode());
+        _Reply_Now();
+        return true;
     } else {
         // 客户请求数据解析失败， 初始化错误网页响应
         m_response.Init(srcDir, m_request.path(), false, 400);
     }
-    // 根据客户请求数据，作出响应, 并将响应数据写到输出buffer中
-    m_response.Make_Response(m_writeBuff);
-    // 将输出buffer中的响应数据 读到 m_iov[0]中
-    m_iov[0].iov_base = const_cast<char*>(m_writeBuff.Peek());
-    m_iov[0].iov_len = m_writeBuff.ReadableBytes();
-    m_iovCnt = 1;
-    
-    // 将客户请求的文件(需要响应的文件)，读到m_iov[1]中
-    if(m_response.FileLen() > 0  && m_response.File()) {
-        m_iov[1].iov_base = m_response.File();
-        m_iov[1].iov_len = m_response.FileLen();
-        m_iovCnt = 2;
+    m_parseEnd = chrono::steady_clock::now();
+    // 根据客户请求数据，作出响应, 并将响应头写到输出队列的暂存buffer中
+    {
+        TraceSpan span(m_traceId, "make_response");
+        m_response.Make_Response(m_out.Stage());
     }
+    m_respEnd = chrono::steady_clock::now();
+    _Queue_Response();
     return true;
 }
 
+// 响应头排进输出队列，客户请求的文件(映射的共享内存)跟在后面，由队列发送完后释放
+void HttpConn::_Queue_Response() {
+    m_out.Push_Staged();
+    if (m_response.FileLen() > 0 && m_response.File()) {
+        size_t len = m_response.FileLen();
+        int fd;
+        char* map = m_response.ReleaseFile(&fd);
+        m_out.Push_File(map, len, fd);
+    }
+    _Record_Access();
+}
+
+// 记下刚排进队列的响应的访问日志
+void HttpConn::_Record_Access() {
+    if (m_accessCnt == m_access.size()) { m_access.emplace_back(); }
+    AccessRecord& rec = m_access[m_accessCnt++];
+    rec.method.assign(m_request.method());
+    rec.path.assign(m_request.path());
+    rec.version.assign(m_request.version());
+    rec.code = m_response.Code();
+    rec.bytes = m_out.Bytes() - m_respBytes;
+    rec.reqBegin = m_reqBegin;
+    rec.parseEnd = m_parseEnd;
+    rec.respEnd = m_respEnd;
+    m_respBytes = m_out.Bytes();
+}
+
+void HttpConn::_New_H2() {
+    m_h2.reset(new Http2Session(m_ip, srcDir));
+    m_h2->SetAdmit([this](const string& path) {
+        return !rateLimit || !rateLimit->Enabled() ||
+               rateLimit->Allow_Request(GetAddr(), path.data(), path.size(), Trace::NowNs());
+    });
+}
+
+// HTTP/1.1请求带 Upgrade: h2c 和 HTTP2-Settings: 回复101，这个请求的响应作为流1发送
+// 带请求体的请求(POST)不升级，按HTTP/1.1处理
+bool HttpConn::_Upgrade_H2() {
+    if (!Http2Session::enabled || isDraining || m_request.method() == "POST") { return false; }
+    string upgrade = m_request.GetHeader("Upgrade");
+    string settings = m_request.GetHeader("HTTP2-Settings");
+    if (upgrade.find("h2c") == string::npos || settings.empty()) { return false; }
+    _New_H2();
+    if (!m_h2->Upgrade(settings, m_request, m_out.Stage())) {
+        m_h2.reset();
+        return false;
+    }
+    return _Process_H2();
+}
+
+// WebSocket握手: 路径为配置的路径时回复101并订阅广播，之后的帧由WebSocket处理
+// 排空期间不再升级(按普通请求响应)
+bool HttpConn::_Upgrade_Ws() {
+    if (!hub || isDraining || m_request.path() != WebSocket::path || !m_request.IsWebSocket()) { return false; }
+    m_parseEnd = chrono::steady_clock::now();
+    WebSocket::Handshake(m_request, m_out.Stage());
+    m_response.Init(srcDir, m_request.path(), false, 101);     // 只用于访问日志
+    m_ws.reset(new WebSocket());
+    hub->Subscribe(this);
+    _Reply_Now();
+    return true;
+}
+
+// HTTP/2: 处理已读到的帧，继续发送各个流的响应体; 没有要发送的数据时返回false(等待客户端)
+// 文件内容拷贝进DATA帧，帧都在暂存buffer中
+bool HttpConn::_Process_H2() {
+    if (isDraining) { m_h2->Shutdown(m_out.Stage()); }
+    m_h2->Process(m_readBuff, m_out.Stage());
+    m_out.Push_Staged();
+    return !m_out.Empty();
+}
+
+// 过载时丢弃已读到的请求数据，直接回复503并在发送后关闭连接(不解析请求、不访问数据库)
+bool HttpConn::Shed(int retryAfter) {
+    // HTTP/2、WebSocket连接上不能插入HTTP/1.1响应
+    if (m_h2 || m_ws || m_readBuff.ReadableBytes() == 0) { return false; }
+    m_request.Init();
+    m_readBuff.RetrieveAll();
+    m_out.Clear();
+    m_respBytes = 0;
+    m_reqBegin = m_parseEnd = chrono::steady_clock::now();
+    m_response.Make_Unavailable(m_out.Stage(), retryAfter);
+    _Reply_Now();
+    return true;
+}
+
+// 被限速: 同样丢弃请求数据，回复固定的429并在发送后关闭连接(直接发送共享的响应文本，不拷贝)
+bool HttpConn::Throttle() {
+    if (m_readBuff.ReadableBytes() == 0) { return false; }
+    m_request.Init();
+    m_readBuff.RetrieveAll();
+    m_out.Clear();
+    m_respBytes = 0;
+    m_reqBegin = m_parseEnd = chrono::steady_clock::now();
+    m_response.Make_TooMany();
+    const string& text = HttpResponse::TooMany_Text();
+    m_out.Push_Blob(text.data(), text.size());
+    _Reply_Now();
+    return true;
+}
+
+// 把暂存buffer中已生成的响应(没有文件)排进输出队列
+void HttpConn::_Reply_Now() {
+    m_respEnd = chrono::steady_clock::now();
+    m_out.Push_Staged();
+    _Record_Access();
+}
+
+// 不解析请求，直接从输入buffer的请求行中取出路径(不含查询串)，限速检查用
+bool HttpConn::PeekPath(const char** path, size_t* len) const {
+    if (m_h2 || m_ws) { return false; }     // HTTP/2在每个流解码头部后检查，WebSocket只在握手时检查
+    if (m_request.InProgress()) { return false; }   // 正在接收的请求在开始时已经检查过
+    const char* begin = m_readBuff.Peek();
+    const char* end = begin + m_readBuff.ReadableBytes();
+    const char* sp = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    if (!sp) { return false; }
+    const char* p = sp + 1;
+    const char* q = p;
+    while (q < end && *q != ' ' && *q != '?' && *q != '\r') { q++; }
+    if (q == p) { return false; }
+    *path = p;
+    *len = q - p;
+    return true;
+}
+
+// 输出队列发送完成后记访问日志，流水线上一起发送的响应各记一条
+// (格式: ip "方法 路径 HTTP/版本" 状态码 字节数 解析/生成/发送/总耗时us)
+// HTTP/2每个流结束时单独记录，不经过这里
+void HttpConn::LogAccess() {
+    auto now = chrono::steady_clock::now();
+    auto us = [](chrono::steady_clock::duration d) {
+        return static_cast<long>(chrono::duration_cast<chrono::microseconds>(d).count());
+    };
+    for (size_t i = 0; i < m_accessCnt; i++) {
+        const AccessRecord& rec = m_access[i];
+        LOG_ACCESS("%s \"%s %s HTTP/%s\" %d %zu %ld/%ld/%ld/%ldus",
+                   m_ip, rec.method.c_str(), rec.path.c_str(), rec.version.c_str(), rec.code, rec.bytes,
+                   us(rec.parseEnd - rec.reqBegin), us(rec.respEnd - rec.parseEnd),
+                   us(now - rec.respEnd), us(now - rec.reqBegin));
+    }
+    m_accessCnt = 0;
+}
+
@@ -1,43 +1,97 @@
 #include "../include/httprequest.h"
+#include "../include/log.h"
+#include <algorithm>
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-    "/index", "/register", "/login",
-    "/welcome", "/video", "/picture" };
+std::atomic<size_t> HttpRequest::maxBody(8 << 20);
+std::atomic<size_t> HttpRequest::spoolSize(256 << 10);
+std::string HttpRequest::spoolDir = "/tmp";
 
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
-    {"/register.html", 0}, {"/login.html", 1}};
+static const size_t MAX_LINE = 8192;    // 请求行、请求头、块大小行的长度上限
+static const size_t MAX_HEADER_BYTES = 32768;   // 请求头的总长度上限，超过时回复431
+
+HttpRequest::~HttpRequest() {
+    if (m_spoolFd >= 0) { close(m_spoolFd); }
+}
 
 void HttpRequest::Init() {
-    m_method = m_path = m_version = m_body = "";
+    // clear保留容量，同一连接上的下一个请求不再分配
+    m_method.clear();
+    m_path.clear();
+    m_version.clear();
+    m_body.clear();
     m_state = REQUEST_LINE;
-    m_header.clear();
-    m_post.clear();
+    m_header.Clear();
+    m_error = 0;
+    m_bodyLeft = 0;
+    m_bodyLen = 0;
+    m_headerBytes = 0;
+    m_continue = false;
+    m_multipart.reset();
+    if (m_spoolFd >= 0) {
+        close(m_spoolFd);
+        m_spoolFd = -1;
+    }
+    // 表单在Arena上，旧的表不析构，内存随Reset回收
+    m_post = nullptr;
+    m_arena.Reset();
+}
+
+// 有表单的请求才创建表单(没有表单的请求不使用Arena)
+FormMap* HttpRequest::_Form() {
+    if (!m_post) {
+        m_post = m_arena.Create<FormMap>(0, ArenaStringHash(), std::equal_to<ArenaString>(),
+                                         FormMap::allocator_type(&m_arena));
+    }
+    return m_post;
 }
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if (m_post.count(key) == 1) {
-        return m_post.find(key)->second;
-    }
-    return "";
+    if (!m_post) { return ""; }
+    auto it = m_post->find(ArenaString(key.data(), key.size(), m_post->get_allocator()));
+    return it == m_post->end() ? "" : std::string(it->second.data(), it->second.size());
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if (m_post.count(key) == 1) {
-        return m_post.find(key)->second;
-    }
-    return "";
+    return GetPost(std::string(key));
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if (m_header.count("Connection") == 1) {
-        return m_header.find("Connection")->second == "keep-alive" && m_version == "1.1";
+std::string HttpRequest::GetHeader(const std::string& key) const {
+    return m_header.Get(key).ToString();
+}
+
+// 逗号分隔的令牌列表(Connection等)中是否有这个令牌，忽略大小写
+static bool Has_Token(Slice list, const char* token) {
+    Slice want(token, strlen(token));
+    const char* p = list.data;
+    const char* end = list.data + list.len;
+    while (p < end) {
+        const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+        const char* stop = comma ? comma : end;
+        const char* b = p;
+        const char* e = stop;
+        while (b < e && (*b == ' ' || *b == '\t')) { b++; }
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t')) { e--; }
+        if (Slice(b, e - b).EqualsNoCase(want)) { return true; }
+        p = stop + 1;
     }
     return false;
 }
 
+bool HttpRequest::IsWebSocket() const {
+    return m_method == "GET" && m_version == "1.1" &&
+           m_header.Get(HeaderMap::UPGRADE).EqualsNoCase(Slice("websocket", 9)) &&
+           Has_Token(m_header.Get(HeaderMap::CONNECTION), "upgrade") &&
+           !m_header.Get(HeaderMap::SEC_WEBSOCKET_KEY).empty() &&
+           m_header.Get(HeaderMap::SEC_WEBSOCKET_VERSION) == Slice("13", 2);
+}
+
+bool HttpRequest::IsKeepAlive() const {
+    return m_version == "1.1" && Has_Token(m_header.Get(HeaderMap::CONNECTION), "keep-alive");
+}
+
 // 解析客户请求文件
 bool HttpRequest::parse(Buffer& buff) {
     const char CRLF[] = "\r\n";
@@ -45,153 +99,344 @@ bool HttpRequest::parse(Buffer& buff) {
     if(buff.ReadableBytes() <= 0) {
         return false;
     }
+    // 采样请求按解析阶段记录时间片段
+    static const char* PHASE_NAME[] = { "parse.request_line", "parse.headers", "parse.body", "parse.body",
+                                        "parse.body", "parse.body", "parse.body", "parse.finish" };
+    PARSE_STATE phase = m_state;
+    uint64_t phaseBegin = m_traceId ? Trace::NowNs() : 0;
     // 当buffer中有可读的请求数据和请求解析状态不为结束时，一直解析下去
-    while(buff.ReadableBytes() && m_state != FINISH) {
-        // 在可读区域找到每一行的行尾， 并且得到一行数据
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), lineEnd);
-        // 根据解析的状态来解析请求文件（有限状态机）
-        // 初始解析状态为 解析请求行
-        switch(m_state){
-            // 请求行解析成功的话，状态转到解析请求头
-            case REQUEST_LINE: {
-                if(!_Parse_RequestLine(line)) {
-                    return false;
-                }
-                _Parse_Path(); // 解析URL
+    while(buff.ReadableBytes() && m_state != FINISH && m_error == 0) {
+        if(m_state == BODY || m_state == CHUNK_DATA) {
+            // 请求体不按行处理: 已到达的部分交给接收方并从buffer中取走，大的请求体不会积在buffer里
+            size_t len = static_cast<size_t>(std::min<uint64_t>(buff.ReadableBytes(), m_bodyLeft));
+            if(!_On_Body(buff.Peek(), len)) { break; }
+            buff.Retrieve(len);
+            m_bodyLeft -= len;
+            if(m_bodyLeft == 0) {
+                m_state = (m_state == BODY) ? FINISH : CHUNK_END;
+            }
+        } else {
+            // 在可读区域找到每一行的行尾， 并且得到一行数据; 行还不完整时等待更多数据
+            const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+            if(lineEnd == buff.BeginWriteConst()) {
+                if(buff.ReadableBytes() > MAX_LINE) { m_error = 400; }
                 break;
             }
-            // 请求头解析完成，状态转到解析请求体
-            case HEADERS:
-                _Parse_Header(line);
-                if(buff.ReadableBytes() <= 2) {
-                    m_state = FINISH;
+            // 行直接指向buffer，不构造行字符串; 处理完再从buffer取走
+            Slice line(buff.Peek(), lineEnd - buff.Peek());
+            // 根据解析的状态来解析请求文件（有限状态机）
+            // 初始解析状态为 解析请求行
+            switch(m_state){
+                // 请求行解析成功的话，状态转到解析请求头(请求之间多余的空行忽略)
+                case REQUEST_LINE: {
+                    if(line.empty()) { break; }
+                    if(!_Parse_RequestLine(line)) {
+                        m_error = 400;
+                    }
+                    break;
                 }
-                break;
-            case BODY:
-                _Parse_Body(line);
-                break;
-            default:
-                break;
+                // 空行表示请求头结束，按Content-Length或chunked接收请求体
+                case HEADERS:
+                    if(line.empty()) {
+                        _Begin_Body();
+                    } else if((m_headerBytes += line.len + 2) > MAX_HEADER_BYTES) {
+                        m_error = 431;
+                    } else {
+                        _Parse_Header(line.data, line.data + line.len);
+                    }
+                    break;
+                case CHUNK_SIZE:
+                    _Parse_ChunkSize(line);
+                    break;
+                case CHUNK_END:
+                    if(line.empty()) { m_state = CHUNK_SIZE; }
+                    else { m_error = 400; }
+                    break;
+                case CHUNK_TRAILER:
+                    if(line.empty()) { m_state = FINISH; }
+                    break;
+                default:
+                    break;
+            }
+            buff.RetrieveUntil(lineEnd + 2);    // 下一行
+        }
+        if(m_traceId && m_state != phase) {
+            uint64_t now = Trace::NowNs();
+            Trace::Instance()->Span(m_traceId, PHASE_NAME[phase], phaseBegin, now);
+            phase = m_state;
+            phaseBegin = now;
         }
-        if(lineEnd == buff.BeginWrite()) { break; }
-        buff.RetrieveUntil(lineEnd + 2);    // 下一行
     }
+    // multipart请求体必须以结束分隔符结尾
+    if(m_state == FINISH && m_multipart && !m_multipart->Finished() && m_error == 0) { m_error = 400; }
+    if(m_error) {
+        m_multipart.reset();    // 删除已保存的上传文件
+        return false;
+    }
+    // 请求体在内存中时解析表单
+    if(m_state == FINISH && m_spoolFd < 0) { _Parse_Post(); }
     return true;
 }
 
+bool HttpRequest::ClaimContinue() {
+    bool ret = m_continue;
+    m_continue = false;
+    return ret;
+}
+
+void HttpRequest::Init_H2(const string& method, const string& path, HeaderMap&& header, string&& body) {
+    Init();
+    m_method = method;
+    m_path = path;
+    m_version = "2";
+    m_header = std::move(header);
+    m_body = std::move(body);
+    _Parse_Post();
+    m_state = FINISH;
+}
+
 // 解析请求行（请求行内容如: GET http://www.baidu.com/ HTTP/1.1\r\n）
-bool HttpRequest::_Parse_RequestLine(const string& line) {
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        m_method = subMatch[1];        // 请求方法
-        m_path = subMatch[2];           // 请求URL
-        m_version = subMatch[3];        // HTTP协议版本
-        m_state = HEADERS;              // 解析请求行结束后，请求状态到解析请求头
-        return true;
+// 格式: 方法 SP URL SP HTTP/版本，各部分不能含空格; 赋值给成员复用它们的容量，不分配内存
+bool HttpRequest::_Parse_RequestLine(Slice line) {
+    const char* begin = line.data;
+    const char* end = line.data + line.len;
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    if(!sp1) { return false; }
+    const char* sp2 = static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1));
+    if(!sp2 || end - sp2 < 6 || memcmp(sp2 + 1, "HTTP/", 5) != 0 || memchr(sp2 + 6, ' ', end - sp2 - 6)) {
+        return false;
     }
-    return false;
+    m_method.assign(begin, sp1);        // 请求方法
+    m_path.assign(sp1 + 1, sp2);        // 请求URL
+    m_version.assign(sp2 + 6, end);     // HTTP协议版本
+    m_state = HEADERS;                  // 解析请求行结束后，请求状态到解析请求头
+    return true;
 }
-// 解析URL
-void HttpRequest::_Parse_Path() {
-    if (m_path == "/") {
-        m_path = "/index.html"; 
-    } else {
-        for (auto &item: DEFAULT_HTML) {
-            if(item == m_path) {
-                m_path += ".html";
-                break;
+// 解析请求头
+// 名字: 冒号前不能有空白(RFC 7230 3.2.4); 值: 去掉前后的空白
+void HttpRequest::_Parse_Header(const char* begin, const char* end) {
+    const char* colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+    if (!colon || colon == begin || colon[-1] == ' ' || colon[-1] == '\t') {
+        m_error = 400;
+        return;
+    }
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) { value++; }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) { end--; }
+    if (!m_header.Add(begin, colon - begin, value, end - value)) { m_error = 431; }    // 字段行数超过上限
+}
+
+// 请求头结束: 确定请求体的长度(同时有Transfer-Encoding和Content-Length时以chunked为准)
+// Content-Length超过上限时立即回复413，不再接收请求体
+void HttpRequest::_Begin_Body() {
+    Slice encoding = m_header.Get(HeaderMap::TRANSFER_ENCODING);
+    Slice length = m_header.Get(HeaderMap::CONTENT_LENGTH);
+    if (m_header.Has(HeaderMap::TRANSFER_ENCODING)) {
+        m_error = _Check_Encoding(encoding);
+        if (m_error) { return; }
+        m_state = CHUNK_SIZE;
+    } else if (m_header.Has(HeaderMap::CONTENT_LENGTH)) {
+        uint64_t len = 0;
+        for (size_t i = 0; i < length.len; i++) {
+            char c = length.data[i];
+            if (c < '0' || c > '9' || len > (UINT64_MAX - 9) / 10) {
+                m_error = 400;
+                return;
             }
+            len = len * 10 + (c - '0');
+        }
+        if (len > maxBody) {
+            m_error = 413;
+            return;
         }
+        m_bodyLeft = len;
+        m_state = len > 0 ? BODY : FINISH;
+    } else {
+        m_state = FINISH;
+    }
+    // multipart/form-data: 请求体交给流式解析，文件部分直接写进上传目录
+    string boundary;
+    if (m_state != FINISH && m_method == "POST" && Multipart::Boundary(m_header.Get(HeaderMap::CONTENT_TYPE), &boundary)) {
+        m_multipart.reset(new Multipart(boundary, _Form()));
+    }
+    if (m_state != FINISH && m_version == "1.1") {
+        m_continue = m_header.Get(HeaderMap::EXPECT).EqualsNoCase(Slice("100-continue", 12));
     }
 }
 
-// 解析请求头
-void HttpRequest::_Parse_Header(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if (regex_match(line, subMatch, patten)) {
-        m_header[subMatch[1]] = subMatch[2];
-    } else {
-        m_state = BODY;     // 解析状态转到解析请求体
+// Transfer-Encoding: 逗号分隔的编码列表(多行已合并)，最后一个必须是chunked且只出现一次，否则无法确定请求体的结束(400);
+// 不解码其他编码(gzip等)，回复501
+int HttpRequest::_Check_Encoding(Slice encoding) {
+    static const Slice CHUNKED("chunked", 7);
+    const char* p = encoding.data;
+    const char* end = p + encoding.len;
+    int chunked = 0;
+    bool last = false, other = false;
+    while (p < end) {
+        const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+        const char* next = comma ? comma : end;
+        const char* b = p;
+        const char* e = next;
+        while (b < e && (*b == ' ' || *b == '\t')) { b++; }
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t')) { e--; }
+        p = comma ? comma + 1 : end;
+        if (b == e) { continue; }     // 空的列表元素
+        last = Slice(b, e - b).EqualsNoCase(CHUNKED);
+        if (last) { chunked++; }
+        else { other = true; }
     }
+    if (!last || chunked != 1) { return 400; }
+    return other ? 501 : 0;
 }
 
-// 解析请求体 
-void HttpRequest::_Parse_Body(const string& line) {
-    m_body = line;
-    _Parse_Post();
-    m_state = FINISH;       // 请求体解析完成，结束本次解析
+// 块大小行: 十六进制大小，可能带 ;扩展(忽略); 大小为0表示最后一块，之后是尾部字段
+bool HttpRequest::_Parse_ChunkSize(Slice line) {
+    uint64_t size = 0;
+    size_t i = 0;
+    for (; i < line.len; i++) {
+        char c = line.data[i];
+        int v;
+        if (c >= '0' && c <= '9') { v = c - '0'; }
+        else if (c >= 'a' && c <= 'f') { v = c - 'a' + 10; }
+        else if (c >= 'A' && c <= 'F') { v = c - 'A' + 10; }
+        else { break; }
+        if (size > (UINT64_MAX >> 4)) {
+            m_error = 400;
+            return false;
+        }
+        size = (size << 4) | v;
+    }
+    if (i == 0 || (i < line.len && line.data[i] != ';' && line.data[i] != ' ' && line.data[i] != '\t')) {
+        m_error = 400;
+        return false;
+    }
+    size_t limit = maxBody;     // 重新加载配置可能把上限改得比已收到的还小
+    if (m_bodyLen > limit || size > limit - m_bodyLen) {
+        m_error = 413;
+        return false;
+    }
+    m_bodyLeft = size;
+    m_state = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+    return true;
+}
+
+// 请求体片段的接收方: 先放在内存里，总大小超过spoolSize后转存到临时文件
+bool HttpRequest::_On_Body(const char* data, size_t len) {
+    m_bodyLen += len;
+    if (m_bodyLen > maxBody) {
+        m_error = 413;
+        return false;
+    }
+    if (m_multipart) {
+        if (!m_multipart->Feed(data, len)) {
+            m_error = m_multipart->Error();
+            return false;
+        }
+        return true;
+    }
+    if (m_spoolFd < 0 && m_body.size() + len > spoolSize) {
+        if (!_Open_Spool() || !_Spool(m_body.data(), m_body.size())) {
+            m_error = 500;
+            return false;
+        }
+        string().swap(m_body);
+    }
+    if (m_spoolFd >= 0) {
+        if (!_Spool(data, len)) {
+            m_error = 500;
+            return false;
+        }
+        return true;
+    }
+    m_body.append(data, len);
+    return true;
 }
 
-// 把十六进制转成十进制
+// 临时文件: O_TMPFILE创建没有名字的文件，不支持时用mkstemp后立即删除
+bool HttpRequest::_Open_Spool() {
+    m_spoolFd = open(spoolDir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (m_spoolFd < 0) {
+        string path = spoolDir + "/body.XXXXXX";
+        m_spoolFd = mkostemp(&path[0], O_CLOEXEC);
+        if (m_spoolFd >= 0) { unlink(path.c_str()); }
+    }
+    if (m_spoolFd < 0) {
+        LOG_ERROR("spool request body in %s error: %s", spoolDir.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool HttpRequest::_Spool(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(m_spoolFd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            LOG_ERROR("spool request body error: %s", strerror(errno));
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 把十六进制转成十进制，不是十六进制数字时返回-1
 int HttpRequest::Conver_Hex(char ch) {
+    if(ch >= '0' && ch <= '9') return ch - '0';
     if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
     if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
-    return ch;
+    return -1;
 }
 
-// POST请求方法时，需要解析请求体
+// POST请求方法时，需要解析请求体(urlencoded在这里解析，multipart在接收请求体时已经解析好)
+// 登录、注册等处理由路由表中注册的处理函数完成
 void HttpRequest::_Parse_Post() {
-    if(m_method == "POST" && m_header["Content-Type"] == "application/x-www-form-urlencoded") {
+    if(m_method != "POST") { return; }
+    // 媒体类型忽略大小写和参数(; charset=...)
+    Slice type = m_header.Get(HeaderMap::CONTENT_TYPE);
+    const char* semi = static_cast<const char*>(memchr(type.data, ';', type.len));
+    if(semi) { type.len = semi - type.data; }
+    while(type.len > 0 && (type.data[type.len - 1] == ' ' || type.data[type.len - 1] == '\t')) { type.len--; }
+    if(type.EqualsNoCase(Slice("application/x-www-form-urlencoded", 33))) {
         _Parse_FromUrlencoded();
-        // 注册或登录界面
-        if(DEFAULT_HTML_TAG.count(m_path)) {
-            int tag = DEFAULT_HTML_TAG.find(m_path)->second;
-            if(tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);
-                if(User_Verify(m_post["username"], m_post["password"], isLogin)) {
-                    m_path = "/welcome.html";
-                } else {
-                    m_path = "/error.html";
-                }
-            }
+    }
+}
+
+// 解码: +为空格，%XX为一个字节(不合法的%原样保留)
+void HttpRequest::Url_Decode(const char* data, size_t len, ArenaString* out) {
+    out->reserve(len);
+    for(size_t i = 0; i < len; i++) {
+        if(data[i] == '+') {
+            *out += ' ';
+        } else if(data[i] == '%' && i + 2 < len && Conver_Hex(data[i + 1]) >= 0 && Conver_Hex(data[i + 2]) >= 0) {
+            *out += static_cast<char>(Conver_Hex(data[i + 1]) * 16 + Conver_Hex(data[i + 2]));
+            i += 2;
+        } else {
+            *out += data[i];
         }
-    }   
+    }
 }
 
-// 请求体格式（name=lai&password=123&realName=alai）
+// 请求体格式（name=lai&password=123&realName=alai）: 按&切分，等号左右分别解码
 void HttpRequest::_Parse_FromUrlencoded() {
-    if(m_body.size() == 0) { return; }
-
-    string key, value;
-    int num = 0, n = m_body.size();
-    int i = 0, j = 0;
-    // 解析等号左右的数据，并作成post键值对
-    for(; i < n; i++) {
-        char ch = m_body[i];
-        switch (ch) {
-            case '=': {
-                key = m_body.substr(j, i - j);
-                j = i + 1;
-                break;
-            }
-            case '+': {
-                m_body[i] = ' ';
-                break;
-            }
-            case '%': {
-                num = Conver_Hex(m_body[i + 1]) * 16 + Conver_Hex(m_body[i + 2]);
-                m_body[i + 2] = num % 10 + '0';
-                m_body[i + 1] = num / 10 + '0';
-                i += 2;
-                break;
-            }
-            case '&': {
-                value = m_body.substr(j, i - j);
-                j = i + 1;
-                m_post[key] = value;
-                break;
-            }
-            default:
-                break;
+    FormMap* form = _Form();
+    const char* p = m_body.data();
+    const char* end = p + m_body.size();
+    while(p < end) {
+        const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+        if(!amp) { amp = end; }
+        const char* eq = static_cast<const char*>(memchr(p, '=', amp - p));
+        if(!eq) { eq = amp; }
+        ArenaString key(form->get_allocator());
+        Url_Decode(p, eq - p, &key);
+        if(!key.empty()) {
+            ArenaString value(form->get_allocator());
+            if(eq < amp) { Url_Decode(eq + 1, amp - eq - 1, &value); }
+            form->erase(key);
+            form->emplace(std::move(key), std::move(value));
         }
-    }
-    assert(j <= i);
-    if(m_post.count(key) == 0 && j < i) {
-        value = m_body.substr(j, i - j);
-        m_post[key] = value;
+        p = amp + 1;
     }
 }
 
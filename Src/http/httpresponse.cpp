@@ -31,6 +31,13 @@ const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 405, "Method Not Allowed" },
+    { 413, "Payload Too Large" },
+    { 429, "Too Many Requests" },
+    { 431, "Request Header Fields Too Large" },
+    { 500, "Internal Server Error" },
+    { 501, "Not Implemented" },
+    { 503, "Service Unavailable" },
 };
 
 // 响应状态码与错误网页键值对
@@ -44,8 +51,11 @@ HttpResponse::HttpResponse() {
     m_code = -1;
     m_path = m_srcDir = "";
     m_isKeepAlive = false;
+    m_keepAliveTimeout = m_keepAliveMax = 0;
     m_mmFile = nullptr; 
+    m_mmFd = -1;
     m_mmFileStat = {0};
+    m_hasContent = false;
 };
 
 HttpResponse::~HttpResponse() {
@@ -54,13 +64,23 @@ HttpResponse::~HttpResponse() {
 
 void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
-    if (m_mmFile) { UnmapFile(); }
+    UnmapFile();
     m_code = code;                  // 响应状态码
     m_isKeepAlive = isKeepAlive;    // 是否长连接标记
+    m_keepAliveTimeout = m_keepAliveMax = 0;
     m_path = path;                  // 请求URL文件路径
     m_srcDir = srcDir;              // 源文件目录 
     m_mmFile = nullptr;             // 客户请求文件(后续映射到共享内存)
     m_mmFileStat = {0};             // 客户请求文件信息
+    m_hasContent = false;
+    m_content.clear();
+}
+
+void HttpResponse::SetContent(int code, const string& type, string body) {
+    m_code = code;
+    m_hasContent = true;
+    m_contentType = type;
+    m_content = std::move(body);
 }
 
 // 释放共享内存
@@ -69,13 +89,40 @@ void HttpResponse::UnmapFile() {
         munmap(m_mmFile, m_mmFileStat.st_size);
         m_mmFile = nullptr;
     }
+    if(m_mmFd >= 0) {
+        close(m_mmFd);
+        m_mmFd = -1;
+    }
+}
+
+char* HttpResponse::ReleaseFile(int* fd) {
+    char* file = m_mmFile;
+    *fd = m_mmFd;
+    m_mmFile = nullptr;
+    m_mmFd = -1;
+    return file;
 }
 
 // 根据客户的请求，作出响应文件
 void HttpResponse::Make_Response(Buffer& buff) {
+    if (m_hasContent) {
+        _Add_StateLine(buff);
+        _Add_Header(buff);
+        _Add_Length(buff, m_content.size());
+        buff.Append(m_content);
+        return;
+    }
+    Prepare();
+    _Add_StateLine(buff);   // 添加响应行 
+    _Add_Header(buff);      // 添加响应头
+    _Add_Content(buff);     // 添加响应体 
+}
+
+// 确定状态码和要发送的文件(HTTP/2的响应头由调用方另行编码)
+void HttpResponse::Prepare() {
     // stat: 获取文件信息，放到m_mmFileStat 
     // 如果客户请求文件是目录文件的话，客户找不到网页
-    if(stat((m_srcDir + m_path).data(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode)) {
+    if(stat(_File_Path(), &m_mmFileStat) < 0 || S_ISDIR(m_mmFileStat.st_mode)) {
         m_code = 404;
     }
     // 如果客户请求文件，其他用户没有可读权限，客户禁止访问
@@ -86,26 +133,24 @@ void HttpResponse::Make_Response(Buffer& buff) {
         m_code = 200; 
     }
     _Error_Html();          // 网页出错(如果响应状态码是错误码的话才会真正执行)
-    _Add_StateLine(buff);   // 添加响应行 
-    _Add_Header(buff);      // 添加响应头
-    _Add_Content(buff);     // 添加响应体 
 }
 
 void HttpResponse::_Error_Html() {
     // 如果响应状态码是网页错误码的话，将客户请求文件改成网页出错文件
     if (CODE_PATH.count(m_code) == 1) {
         m_path = CODE_PATH.find(m_code)->second;
-        stat((m_srcDir + m_path).data(), &m_mmFileStat);
+        stat(_File_Path(), &m_mmFileStat);
     }
 }
 
 // 添加响应行 （格式如：HTTP/1.1 200 OK）
 void HttpResponse::_Add_StateLine(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(m_code) == 1) {
-        status = CODE_STATUS.find(m_code)->second;
-    }
-    buff.Append("HTTP/1.1 " + to_string(m_code) + " " + status + "\r\n");
+    auto it = CODE_STATUS.find(m_code);
+    char line[64];
+    int n = snprintf(line, sizeof(line), "HTTP/1.1 %d ", m_code);
+    buff.Append(line, n);
+    if(it != CODE_STATUS.end()) { buff.Append(it->second); }
+    buff.Append("\r\n", 2);
 }
 
 // 添加响应头
@@ -114,52 +159,86 @@ void HttpResponse::_Add_Header(Buffer& buff) {
     // 判断是否是长连接
     if(m_isKeepAlive) {
         buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+        // 与服务器实际执行的空闲超时、单连接请求数上限一致
+        char line[64];
+        int n = 0;
+        if(m_keepAliveTimeout > 0 && m_keepAliveMax > 0) {
+            n = snprintf(line, sizeof(line), "Keep-Alive: timeout=%d, max=%d\r\n", m_keepAliveTimeout, m_keepAliveMax);
+        } else if(m_keepAliveTimeout > 0) {
+            n = snprintf(line, sizeof(line), "Keep-Alive: timeout=%d\r\n", m_keepAliveTimeout);
+        } else if(m_keepAliveMax > 0) {
+            n = snprintf(line, sizeof(line), "Keep-Alive: max=%d\r\n", m_keepAliveMax);
+        }
+        buff.Append(line, n);
     } else{
         buff.Append("close\r\n");
     }
     // 文本类型
-    buff.Append("Content-type: " + _Get_FileType() + "\r\n");
+    buff.Append("Content-type: ", 14);
+    buff.Append(FileType());
+    buff.Append("\r\n", 2);
 }
 
 // 添加响应体
 void HttpResponse::_Add_Content(Buffer& buff) {
-    // 以只读方式打开可和请求文件
-    int srcFd = open((m_srcDir + m_path).data(), O_RDONLY);
-    if(srcFd < 0) { 
+    if(!MapFile()) {
         ErrorContent(buff, "File NotFound!");
         return; 
     }
+    // 添加文本信息长度
+    _Add_Length(buff, m_mmFileStat.st_size);
+}
 
-    // 将文件映射到共享内存， MAP_PRIVATE 建立一个写入时拷贝的私有映射
-    int* mmRet = (int*)mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return; 
+// 以只读方式打开请求文件并映射到共享内存， MAP_PRIVATE 建立一个写入时拷贝的私有映射
+// fd与映射一起保留到UnmapFile(或随ReleaseFile交出)
+bool HttpResponse::MapFile() {
+    int srcFd = open(_File_Path(), O_RDONLY | O_CLOEXEC);
+    if(srcFd < 0) { 
+        return false; 
     }
-    m_mmFile = (char*)mmRet;
-    close(srcFd);
-
-    // 添加文本信息长度
-    buff.Append("Content-length: " + to_string(m_mmFileStat.st_size) + "\r\n\r\n");
+    void* mmRet = mmap(0, m_mmFileStat.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+    if(mmRet == MAP_FAILED) {
+        close(srcFd);
+        return false; 
+    }
+    m_mmFile = static_cast<char*>(mmRet);
+    m_mmFd = srcFd;
+    return true;
 }
 
-string HttpResponse::_Get_FileType() {
+const string& HttpResponse::FileType() const {
+    static const string TEXT_PLAIN = "text/plain";
+    if (m_hasContent) { return m_contentType; }
     // 判断文件类型 
     string::size_type idx = m_path.find_last_of('.');
     if(idx == string::npos) {
-        return "text/plain";
-    }
-    // 根据文件后缀名 得到 文本类型
-    string suffix = m_path.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+        return TEXT_PLAIN;
     }
-    return "text/plain";
+    // 根据文件后缀名 得到 文本类型(后缀很短，放在string的内联存储里)
+    auto it = SUFFIX_TYPE.find(m_path.substr(idx));
+    return it == SUFFIX_TYPE.end() ? TEXT_PLAIN : it->second;
+}
+
+// 资源目录 + 请求路径，拼进成员复用容量
+const char* HttpResponse::_File_Path() {
+    m_filePath.assign(m_srcDir).append(m_path);
+    return m_filePath.c_str();
+}
+
+void HttpResponse::_Add_Length(Buffer& buff, size_t len) {
+    char line[48];
+    int n = snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", len);
+    buff.Append(line, n);
 }
 
 // 添加错误文本 
 void HttpResponse::ErrorContent(Buffer& buff, string message) {
+    string body = ErrorBody(message);
+    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
+    buff.Append(body);
+}
+
+string HttpResponse::ErrorBody(const string& message) const {
     string body;
     string status;
     body += "<html><title>Error</title>";
@@ -172,8 +251,62 @@ void HttpResponse::ErrorContent(Buffer& buff, string message) {
     body += to_string(m_code) + " : " + status  + "\n";
     body += "<p>" + message + "</p>";
     body += "<hr><em>TinyWebServer</em></body></html>";
+    return body;
+}
 
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+
+// 过载时的503响应: 不读文件，告诉客户端多少秒后重试，并关闭连接
+string HttpResponse::Unavailable_Text(int retryAfter) {
+    static const string body = "503 : Service Unavailable, retry later\n";
+    return "HTTP/1.1 503 " + CODE_STATUS.find(503)->second + "\r\n"
+           "Retry-After: " + to_string(retryAfter) + "\r\n"
+           "Connection: close\r\n"
+           "Content-type: text/plain\r\n"
+           "Content-length: " + to_string(body.size()) + "\r\n\r\n" + body;
 }
 
+void HttpResponse::Make_Unavailable(Buffer& buff, int retryAfter) {
+    UnmapFile();
+    m_code = 503;
+    m_isKeepAlive = false;
+    m_mmFileStat = {0};
+    buff.Append(Unavailable_Text(retryAfter));
+}
+
+// 被限速时的429响应: 内容固定，只生成一次
+const string& HttpResponse::TooMany_Body() {
+    static const string body = "429 : Too Many Requests, slow down\n";
+    return body;
+}
+
+const string& HttpResponse::TooMany_Text() {
+    const string& body = TooMany_Body();
+    static const string text = "HTTP/1.1 429 " + CODE_STATUS.find(429)->second + "\r\n"
+           "Retry-After: 1\r\n"
+           "Connection: close\r\n"
+           "Content-type: text/plain\r\n"
+           "Content-length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    return text;
+}
+
+void HttpResponse::Make_TooMany() {
+    UnmapFile();
+    m_code = 429;
+    m_isKeepAlive = false;
+    m_mmFileStat = {0};
+}
+
+// 请求本身无法处理(413、431、500、501): 纯文本响应，发送后关闭连接(请求体可能还没有收完)
+void HttpResponse::Make_Error(Buffer& buff, int code) {
+    UnmapFile();
+    m_code = code;
+    m_isKeepAlive = false;
+    m_mmFileStat = {0};
+    auto it = CODE_STATUS.find(code);
+    string status = it == CODE_STATUS.end() ? "Error" : it->second;
+    string body = to_string(code) + " : " + status + "\n";
+    buff.Append("HTTP/1.1 " + to_string(code) + " " + status + "\r\n"
+                "Connection: close\r\n"
+                "Content-type: text/plain\r\n"
+                "Content-length: " + to_string(body.size()) + "\r\n\r\n" + body);
+}
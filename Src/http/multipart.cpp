@@ -0,0 +1,279 @@
+#include "../include/multipart.h"
+#include "../include/log.h"
+#include <algorithm>
+using namespace std;
+
+std::string Multipart::uploadDir = "./upload";
+std::atomic<unsigned> Multipart::m_seq(0);
+
+static const size_t MAX_HEADER = 8192;     // 每个部分的头部大小上限
+static const size_t MAX_VALUE = 65536;     // 普通字段值的大小上限
+static const int MAX_PARTS = 64;
+
+Multipart::Multipart(const string& boundary, FormMap* fields)
+    : m_delim("\r\n--" + boundary), m_fields(fields), m_state(PREAMBLE), m_error(0),
+      m_headerBytes(0), m_parts(0), m_isFile(false), m_fd(-1) {
+    // 第一个分隔符前面没有CRLF: 当作请求体前面已经收到了CRLF
+    m_carry = "\r\n";
+    size_t n = m_delim.size();
+    for (size_t i = 0; i < 256; i++) { m_skip[i] = n; }
+    for (size_t i = 0; i + 1 < n; i++) { m_skip[static_cast<uint8_t>(m_delim[i])] = n - 1 - i; }
+}
+
+Multipart::~Multipart() {
+    _Discard_File();
+    if (m_state != DONE || m_error) {
+        for (auto& path : m_saved) { unlink(path.c_str()); }
+    }
+}
+
+bool Multipart::Boundary(Slice contentType, string* boundary) {
+    // 先不拷贝地检查类型，其他请求(urlencoded等)不分配内存
+    if (contentType.len < 19 || !Slice(contentType.data, 19).EqualsNoCase(Slice("multipart/form-data", 19))) { return false; }
+    string type = contentType.ToString();
+    for (char& c : type) { c = tolower(static_cast<unsigned char>(c)); }
+    size_t pos = type.find("boundary=");
+    if (pos == string::npos) { return false; }
+    // 参数值保留原来的大小写，可以带引号
+    string value = contentType.ToString().substr(pos + 9);
+    if (!value.empty() && value[0] == '"') {
+        size_t end = value.find('"', 1);
+        if (end == string::npos) { return false; }
+        value = value.substr(1, end - 1);
+    } else {
+        value = value.substr(0, value.find_first_of("; \t"));
+    }
+    if (value.empty() || value.size() > 70) { return false; }
+    *boundary = value;
+    return true;
+}
+
+// Boyer-Moore-Horspool: 按窗口最后一个字节跳转，分隔符通常有几十个字节，大多数位置一次跳过整个分隔符长度
+size_t Multipart::_Find(const char* data, size_t len) const {
+    size_t n = m_delim.size();
+    const char* delim = m_delim.data();
+    size_t i = 0;
+    while (i + n <= len) {
+        uint8_t last = static_cast<uint8_t>(data[i + n - 1]);
+        if (last == static_cast<uint8_t>(delim[n - 1]) && memcmp(data + i, delim, n - 1) == 0) { return i; }
+        i += m_skip[last];
+    }
+    return string::npos;
+}
+
+// 末尾可能是分隔符开头的字节数: 分隔符只在开头有CR，从最靠前的CR开始检查
+size_t Multipart::_Partial(const char* data, size_t len) const {
+    size_t n = m_delim.size();
+    size_t from = len >= n ? len - n + 1 : 0;
+    for (size_t i = from; i < len; i++) {
+        if (data[i] == '\r' && memcmp(data + i, m_delim.data(), len - i) == 0) { return len - i; }
+    }
+    return 0;
+}
+
+bool Multipart::Feed(const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end && m_error == 0) {
+        switch (m_state) {
+        case PREAMBLE:
+        case DATA: {
+            // 上一段末尾留下的字节加上这一段开头能否组成分隔符
+            if (!m_carry.empty()) {
+                size_t need = m_delim.size() - m_carry.size();
+                size_t n = min(need, static_cast<size_t>(end - p));
+                if (memcmp(m_delim.data() + m_carry.size(), p, n) != 0) {
+                    if (!_Emit(m_carry.data(), m_carry.size())) { return false; }
+                    m_carry.clear();
+                } else if (n < need) {
+                    m_carry.append(p, n);
+                    p += n;
+                    break;
+                } else {
+                    m_carry.clear();
+                    p += n;
+                    if (!_End_Part()) { return false; }
+                    m_state = AFTER_DELIM;
+                    break;
+                }
+            }
+            size_t pos = _Find(p, end - p);
+            if (pos != string::npos) {
+                if (!_Emit(p, pos)) { return false; }
+                p += pos + m_delim.size();
+                if (!_End_Part()) { return false; }
+                m_state = AFTER_DELIM;
+            } else {
+                size_t keep = _Partial(p, end - p);
+                if (!_Emit(p, end - p - keep)) { return false; }
+                m_carry.assign(end - keep, keep);
+                p = end;
+            }
+            break;
+        }
+        case AFTER_DELIM:
+        case HEADER: {
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            const char* stop = nl ? nl + 1 : end;
+            if (!_Line(p, stop - p)) { return false; }
+            p = stop;
+            break;
+        }
+        case DONE:
+            return true;   // 结束分隔符之后的内容忽略
+        }
+    }
+    return m_error == 0;
+}
+
+// 分隔符之后的行(结束分隔符"--"或空白)和各部分的头部行
+bool Multipart::_Line(const char* data, size_t len) {
+    m_headerBytes += len;
+    if (m_headerBytes > MAX_HEADER) { return _Fail(400); }
+    m_line.append(data, len);
+    if (m_state == AFTER_DELIM && m_line.compare(0, 2, "--") == 0) {
+        m_state = DONE;
+        return true;
+    }
+    if (m_line.empty() || m_line.back() != '\n') { return true; }
+    string line = m_line.substr(0, m_line.size() - (m_line.size() >= 2 && m_line[m_line.size() - 2] == '\r' ? 2 : 1));
+    m_line.clear();
+    if (m_state == AFTER_DELIM) {
+        if (line.find_first_not_of(" \t") != string::npos) { return _Fail(400); }
+        if (++m_parts > MAX_PARTS) { return _Fail(413); }
+        m_name.clear();
+        m_filename.clear();
+        m_isFile = false;
+        m_state = HEADER;
+        return true;
+    }
+    // 头部结束，开始接收这一部分的数据
+    if (line.empty()) {
+        m_headerBytes = 0;
+        if (!_Begin_Part()) { return false; }
+        m_state = DATA;
+        return true;
+    }
+    return _Header(line);
+}
+
+// 只关心Content-Disposition的name和filename
+bool Multipart::_Header(const string& line) {
+    size_t colon = line.find(':');
+    if (colon == string::npos) { return _Fail(400); }
+    string key = line.substr(0, colon);
+    for (char& c : key) { c = tolower(static_cast<unsigned char>(c)); }
+    if (key != "content-disposition") { return true; }
+    auto param = [&line](const char* name, string* value) {
+        string pattern = string(name) + "=\"";
+        size_t pos = 0;
+        while ((pos = line.find(pattern, pos)) != string::npos) {
+            // 不能是其他参数名的后缀(filename中的name)
+            if (pos == 0 || line[pos - 1] == ' ' || line[pos - 1] == ';') {
+                size_t begin = pos + pattern.size();
+                size_t end = line.find('"', begin);
+                if (end == string::npos) { return false; }
+                *value = line.substr(begin, end - begin);
+                return true;
+            }
+            pos += pattern.size();
+        }
+        return false;
+    };
+    if (!param("name", &m_name)) { return _Fail(400); }
+    m_isFile = param("filename", &m_filename);
+    return true;
+}
+
+// 文件部分在上传目录下创建临时文件(没有选择文件时文件名为空，不创建)
+bool Multipart::_Begin_Part() {
+    if (m_name.empty()) { return _Fail(400); }
+    m_value.clear();
+    if (!m_isFile || m_filename.empty()) { return true; }
+    m_tmpPath = uploadDir + "/.upload.XXXXXX";
+    m_fd = mkostemp(&m_tmpPath[0], O_CLOEXEC);
+    if (m_fd < 0 && errno == ENOENT && mkdir(uploadDir.c_str(), 0755) == 0) {
+        m_tmpPath = uploadDir + "/.upload.XXXXXX";
+        m_fd = mkostemp(&m_tmpPath[0], O_CLOEXEC);
+    }
+    if (m_fd < 0) {
+        LOG_ERROR("upload: create file in %s error: %s", uploadDir.c_str(), strerror(errno));
+        return _Fail(500);
+    }
+    fchmod(m_fd, 0644);
+    return true;
+}
+
+// 当前部分的一段数据(直接指向读缓冲区): 文件部分写进文件，普通字段追加到值
+bool Multipart::_Emit(const char* data, size_t len) {
+    if (len == 0 || m_state != DATA) { return true; }
+    if (m_fd >= 0) {
+        while (len > 0) {
+            ssize_t n = write(m_fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) { continue; }
+                LOG_ERROR("upload: write %s error: %s", m_tmpPath.c_str(), strerror(errno));
+                return _Fail(500);
+            }
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+    if (m_isFile) { return true; }     // 没有选择文件
+    if (m_value.size() + len > MAX_VALUE) { return _Fail(413); }
+    m_value.append(data, len);
+    return true;
+}
+
+// 一个部分结束: 文件改成最终的文件名(时间-序号.扩展名，不使用客户端给的文件名)
+bool Multipart::_End_Part() {
+    if (m_state != DATA) { return true; }
+    if (m_fd < 0) {
+        Form_Set(m_fields, m_name.data(), m_name.size(), m_value.data(), m_value.size());
+        m_value.clear();
+        return true;
+    }
+    string ext;
+    size_t dot = m_filename.find_last_of('.');
+    if (dot != string::npos && m_filename.size() - dot <= 9) {
+        for (size_t i = dot + 1; i < m_filename.size(); i++) {
+            char c = tolower(static_cast<unsigned char>(m_filename[i]));
+            if (!isalnum(static_cast<unsigned char>(c))) {
+                ext.clear();
+                break;
+            }
+            ext += c;
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%ld-%d-%u%s%s", static_cast<long>(time(nullptr)), getpid(),
+             m_seq.fetch_add(1), ext.empty() ? "" : ".", ext.c_str());
+    close(m_fd);
+    m_fd = -1;
+    string path = uploadDir + "/" + name;
+    if (rename(m_tmpPath.c_str(), path.c_str()) < 0) {
+        LOG_ERROR("upload: rename %s error: %s", m_tmpPath.c_str(), strerror(errno));
+        unlink(m_tmpPath.c_str());
+        return _Fail(500);
+    }
+    m_saved.push_back(path);
+    LOG_INFO("upload: %s saved as %s", m_filename.c_str(), path.c_str());
+    Form_Set(m_fields, m_name.data(), m_name.size(), name, strlen(name));
+    return true;
+}
+
+// 请求没有完整收到(连接断开、出错): 删除写了一半的文件
+void Multipart::_Discard_File() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        unlink(m_tmpPath.c_str());
+        m_fd = -1;
+    }
+}
+
+bool Multipart::_Fail(int code) {
+    if (m_error == 0) { m_error = code; }
+    _Discard_File();
+    return false;
+}
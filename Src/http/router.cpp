@@ -0,0 +1,156 @@
+#include "../include/router.h"
+#include "../include/log.h"
+#include <algorithm>
+using namespace std;
+
+Slice RouteParams::Get(const char* name) const {
+    Slice key(name, strlen(name));
+    for (auto& param : m_list) {
+        if (param.name == key) { return param.value; }
+    }
+    return Slice();
+}
+
+Router* Router::Instance() {
+    static Router router;
+    return &router;
+}
+
+// 路径按'/'分段，空段(连续的'/'、结尾的'/')忽略
+bool Router::Add(const string& method, const string& pattern, Handler handler) {
+    assert(!m_compiled);
+    Node* node = &m_root;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        size_t end = pattern.find('/', pos);
+        if (end == string::npos) { end = pattern.size(); }
+        string segment = pattern.substr(pos, end - pos);
+        pos = end + 1;
+        if (segment.empty()) { continue; }
+        if (segment == "*") {
+            // 前缀挂载只能是最后一段
+            if (pos < pattern.size()) {
+                LOG_ERROR("route: '*' must be the last segment: %s", pattern.c_str());
+                return false;
+            }
+            if (!node->wildcard) { node->wildcard.reset(new Node); }
+            node = node->wildcard.get();
+        } else if (segment[0] == ':') {
+            if (!node->param) {
+                node->param.reset(new Node);
+                node->paramName = segment.substr(1);
+            } else if (node->paramName != segment.substr(1)) {
+                LOG_ERROR("route: conflicting parameter :%s in %s", segment.c_str() + 1, pattern.c_str());
+                return false;
+            }
+            node = node->param.get();
+        } else {
+            Node* child = nullptr;
+            for (auto& literal : node->literals) {
+                if (literal->segment == segment) { child = literal.get(); }
+            }
+            if (!child) {
+                node->literals.emplace_back(new Node);
+                child = node->literals.back().get();
+                child->segment = segment;
+            }
+            node = child;
+        }
+    }
+    for (auto& item : node->handlers) {
+        if (item.first == method) {
+            LOG_ERROR("route: duplicate %s %s", method.empty() ? "*" : method.c_str(), pattern.c_str());
+            return false;
+        }
+    }
+    node->handlers.emplace_back(method, std::move(handler));
+    return true;
+}
+
+void Router::Compile() {
+    _Compile(&m_root);
+    m_compiled = true;
+}
+
+// 字面子节点按段排序，查找时二分
+void Router::_Compile(Node* node) {
+    sort(node->literals.begin(), node->literals.end(),
+         [](const unique_ptr<Node>& a, const unique_ptr<Node>& b) { return a->segment < b->segment; });
+    for (auto& literal : node->literals) { _Compile(literal.get()); }
+    if (node->param) { _Compile(node->param.get()); }
+    if (node->wildcard) { _Compile(node->wildcard.get()); }
+}
+
+// 从p开始匹配剩下的路径: 字面段优先，然后参数段，最后前缀挂载; 不匹配时回溯
+const Router::Node* Router::_Match(const Node* node, const char* p, const char* end, RouteParams* params) const {
+    while (p < end && *p == '/') { p++; }
+    if (p == end) {
+        if (!node->handlers.empty()) { return node; }
+        // "/static/*" 也匹配 "/static"
+        if (node->wildcard && !node->wildcard->handlers.empty()) {
+            params->Add(Slice("*", 1), Slice(p, 0));
+            return node->wildcard.get();
+        }
+        return nullptr;
+    }
+    const char* segEnd = static_cast<const char*>(memchr(p, '/', end - p));
+    if (!segEnd) { segEnd = end; }
+    Slice segment(p, segEnd - p);
+
+    auto it = lower_bound(node->literals.begin(), node->literals.end(), segment,
+                          [](const unique_ptr<Node>& a, const Slice& key) { return Slice(a->segment) < key; });
+    if (it != node->literals.end() && Slice((*it)->segment) == segment) {
+        const Node* found = _Match(it->get(), segEnd, end, params);
+        if (found) { return found; }
+    }
+    if (node->param) {
+        params->Add(Slice(node->paramName), segment);
+        const Node* found = _Match(node->param.get(), segEnd, end, params);
+        if (found) { return found; }
+        params->Pop();
+    }
+    if (node->wildcard && !node->wildcard->handlers.empty()) {
+        params->Add(Slice("*", 1), Slice(p, end - p));
+        return node->wildcard.get();
+    }
+    return nullptr;
+}
+
+const Router::Handler* Router::Match(const string& method, const string& path, RouteParams* params, bool* wrongMethod) const {
+    assert(m_compiled);
+    *wrongMethod = false;
+    params->Clear();
+    // 查询字符串不参与匹配
+    const char* begin = path.data();
+    const char* q = static_cast<const char*>(memchr(begin, '?', path.size()));
+    const char* end = q ? q : begin + path.size();
+    const Node* node = _Match(&m_root, begin, end, params);
+    if (!node) { return nullptr; }
+    const Handler* any = nullptr;
+    for (auto& item : node->handlers) {
+        if (item.first == method) { return &item.second; }
+        if (item.first.empty()) { any = &item.second; }
+    }
+    if (!any) { *wrongMethod = true; }
+    return any;
+}
+
+bool Router::Route(const HttpRequest& request, Reply* reply) const {
+    RouteParams params;
+    bool wrongMethod;
+    const Handler* handler = Match(request.method(), request.path(), &params, &wrongMethod);
+    if (handler) {
+        (*handler)(request, params, reply);
+        return true;
+    }
+    if (wrongMethod) {
+        reply->code = 405;
+        reply->body = "405 : Method Not Allowed\n";
+        return true;
+    }
+    return false;
+}
+
+Router::Handler Router::File(const string& path) {
+    return [path](const HttpRequest&, const RouteParams&, Reply* reply) { reply->File(path); };
+}
@@ -0,0 +1,405 @@
+#include "../include/hpack.h"
+#include <climits>
+using namespace std;
+
+// RFC 7541 附录A 静态表，下标从1开始
+static const HeaderField STATIC_TABLE[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+static const size_t STATIC_COUNT = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// RFC 7541 附录B Huffman编码表(不含EOS: 0x3fffffff, 30位)
+static const uint32_t HUFFMAN_CODE[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t HUFFMAN_LEN[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+
+static const uint32_t HUFFMAN_EOS = 256;
+
+// Huffman解码树: 按位向下走，叶子节点给出符号; 第一次使用时由编码表生成
+struct HuffmanNode {
+    int16_t child[2];
+    int16_t sym;        // -1 中间节点
+};
+
+static const vector<HuffmanNode>& Huffman_Tree() {
+    static const vector<HuffmanNode> tree = [] {
+        vector<HuffmanNode> nodes(1, HuffmanNode{ { -1, -1 }, -1 });
+        for (uint32_t sym = 0; sym <= HUFFMAN_EOS; sym++) {
+            uint32_t code = sym < HUFFMAN_EOS ? HUFFMAN_CODE[sym] : 0x3fffffff;
+            int len = sym < HUFFMAN_EOS ? HUFFMAN_LEN[sym] : 30;
+            size_t cur = 0;
+            for (int i = len - 1; i >= 0; i--) {
+                int bit = (code >> i) & 1;
+                if (nodes[cur].child[bit] < 0) {
+                    nodes[cur].child[bit] = static_cast<int16_t>(nodes.size());
+                    nodes.push_back(HuffmanNode{ { -1, -1 }, -1 });
+                }
+                cur = nodes[cur].child[bit];
+            }
+            nodes[cur].sym = static_cast<int16_t>(sym);
+        }
+        return nodes;
+    }();
+    return tree;
+}
+
+/* ---------------- 动态表 ---------------- */
+
+void HpackTable::Add(const string& name, const string& value) {
+    size_t size = name.size() + value.size() + 32;
+    // 条目比整张表还大: 清空表，条目不加入(RFC 7541 4.4)
+    if (size > m_maxSize) {
+        _Evict(0);
+        return;
+    }
+    _Evict(m_maxSize - size);
+    m_entries.push_front(HeaderField{ name, value });
+    m_size += size;
+}
+
+void HpackTable::SetMaxSize(size_t maxSize) {
+    m_maxSize = maxSize;
+    _Evict(maxSize);
+}
+
+void HpackTable::_Evict(size_t maxSize) {
+    while (m_size > maxSize && !m_entries.empty()) {
+        const HeaderField& last = m_entries.back();
+        m_size -= last.name.size() + last.value.size() + 32;
+        m_entries.pop_back();
+    }
+}
+
+int HpackTable::Find(const string& name, const string& value, bool* exact) const {
+    int nameMatch = -1;
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        if (m_entries[i].name != name) { continue; }
+        if (m_entries[i].value == value) {
+            *exact = true;
+            return static_cast<int>(i);
+        }
+        if (nameMatch < 0) { nameMatch = static_cast<int>(i); }
+    }
+    *exact = false;
+    return nameMatch;
+}
+
+/* ---------------- 解码 ---------------- */
+
+HpackDecoder::HpackDecoder(size_t maxTableSize, size_t maxListSize)
+    : m_table(maxTableSize), m_maxTableSize(maxTableSize), m_maxListSize(maxListSize) {}
+
+// 前缀为prefix位的整数(RFC 7541 5.1)
+bool HpackDecoder::Decode_Int(const uint8_t** p, const uint8_t* end, int prefix, uint64_t* value) {
+    if (*p >= end) { return false; }
+    uint64_t max = (1u << prefix) - 1;
+    uint64_t v = **p & max;
+    (*p)++;
+    if (v == max) {
+        int shift = 0;
+        for (;;) {
+            if (*p >= end || shift > 56) { return false; }
+            uint8_t b = *(*p)++;
+            v += static_cast<uint64_t>(b & 0x7f) << shift;
+            shift += 7;
+            if (!(b & 0x80)) { break; }
+        }
+    }
+    *value = v;
+    return true;
+}
+
+// 字符串: 最高位为Huffman标记，后面是7位前缀的长度
+bool HpackDecoder::Decode_String(const uint8_t** p, const uint8_t* end, string* str) {
+    if (*p >= end) { return false; }
+    bool huffman = **p & 0x80;
+    uint64_t len;
+    if (!Decode_Int(p, end, 7, &len) || len > static_cast<uint64_t>(end - *p)) { return false; }
+    const uint8_t* data = *p;
+    *p += len;
+    if (huffman) { return Huffman_Decode(data, len, str); }
+    str->assign(reinterpret_cast<const char*>(data), len);
+    return true;
+}
+
+// 末尾不足一个符号的填充必须是EOS的前缀(全1)且少于8位; 出现EOS符号是错误
+bool HpackDecoder::Huffman_Decode(const uint8_t* data, size_t len, string* str) {
+    const vector<HuffmanNode>& tree = Huffman_Tree();
+    str->clear();
+    str->reserve(len * 8 / 5);
+    int cur = 0;
+    int depth = 0;
+    bool ones = true;
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 7; b >= 0; b--) {
+            int bit = (data[i] >> b) & 1;
+            cur = tree[cur].child[bit];
+            if (cur < 0) { return false; }
+            depth++;
+            ones = ones && bit;
+            int sym = tree[cur].sym;
+            if (sym >= 0) {
+                if (sym == static_cast<int>(HUFFMAN_EOS)) { return false; }
+                str->push_back(static_cast<char>(sym));
+                cur = 0;
+                depth = 0;
+                ones = true;
+            }
+        }
+    }
+    return depth < 8 && ones;
+}
+
+// 下标: 1..61为静态表，之后是动态表(最新的条目在前)
+bool HpackDecoder::_Get(uint64_t index, HeaderField* field) const {
+    if (index == 0) { return false; }
+    if (index <= STATIC_COUNT) {
+        *field = STATIC_TABLE[index - 1];
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= m_table.Count()) { return false; }
+    *field = m_table.At(index);
+    return true;
+}
+
+bool HpackDecoder::Decode(const uint8_t* data, size_t len, vector<HeaderField>* fields) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t listSize = 0;
+    fields->clear();
+    while (p < end) {
+        uint8_t b = *p;
+        HeaderField field;
+        if (b & 0x80) {
+            // 索引
+            uint64_t index;
+            if (!Decode_Int(&p, end, 7, &index) || !_Get(index, &field)) { return false; }
+        } else if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新: 只能出现在头部块开头，且不超过本端通告的大小
+            uint64_t size;
+            if (!fields->empty() || !Decode_Int(&p, end, 5, &size) || size > m_maxTableSize) { return false; }
+            m_table.SetMaxSize(size);
+            continue;
+        } else {
+            // 字面量: 01 加入动态表(6位前缀), 0000 不加入, 0001 永不加入(4位前缀)
+            bool indexing = (b & 0xc0) == 0x40;
+            uint64_t index;
+            if (!Decode_Int(&p, end, indexing ? 6 : 4, &index)) { return false; }
+            if (index) {
+                if (!_Get(index, &field)) { return false; }
+            } else if (!Decode_String(&p, end, &field.name)) {
+                return false;
+            }
+            if (!Decode_String(&p, end, &field.value)) { return false; }
+            if (indexing) { m_table.Add(field.name, field.value); }
+        }
+        listSize += field.name.size() + field.value.size() + 32;
+        if (listSize > m_maxListSize) { return false; }
+        fields->push_back(std::move(field));
+    }
+    return true;
+}
+
+/* ---------------- 编码 ---------------- */
+
+HpackEncoder::HpackEncoder() : m_table(4096), m_pendingSize(SIZE_MAX), m_minPendingSize(SIZE_MAX) {}
+
+// 本端最多使用4096字节的动态表; 对端允许得更大时不扩大
+void HpackEncoder::SetMaxTableSize(size_t size) {
+    size = min<size_t>(size, 4096);
+    m_pendingSize = size;
+    m_minPendingSize = min(m_minPendingSize, size);
+}
+
+void HpackEncoder::Encode_Int(uint64_t value, int prefix, uint8_t first, string* out) {
+    uint64_t max = (1u << prefix) - 1;
+    if (value < max) {
+        out->push_back(static_cast<char>(first | value));
+        return;
+    }
+    out->push_back(static_cast<char>(first | max));
+    value -= max;
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+// Huffman编码更短时使用Huffman
+void HpackEncoder::Encode_String(const string& str, string* out) {
+    uint64_t bits = 0;
+    for (unsigned char c : str) { bits += HUFFMAN_LEN[c]; }
+    size_t hlen = (bits + 7) / 8;
+    if (hlen >= str.size()) {
+        Encode_Int(str.size(), 7, 0, out);
+        out->append(str);
+        return;
+    }
+    Encode_Int(hlen, 7, 0x80, out);
+    uint64_t acc = 0;
+    int n = 0;
+    for (unsigned char c : str) {
+        acc = (acc << HUFFMAN_LEN[c]) | HUFFMAN_CODE[c];
+        n += HUFFMAN_LEN[c];
+        while (n >= 8) {
+            n -= 8;
+            out->push_back(static_cast<char>(acc >> n));
+        }
+    }
+    // 用EOS的前缀(全1)填满最后一个字节
+    if (n > 0) {
+        out->push_back(static_cast<char>((acc << (8 - n)) | (0xff >> n)));
+    }
+}
+
+bool HpackEncoder::_Worth_Indexing(const string& name) {
+    return name != "content-length" && name != "date" && name != "etag" && name != "last-modified";
+}
+
+void HpackEncoder::Encode(const vector<HeaderField>& fields, string* out) {
+    if (m_pendingSize != SIZE_MAX) {
+        if (m_minPendingSize < m_pendingSize) { Encode_Int(m_minPendingSize, 5, 0x20, out); }
+        Encode_Int(m_pendingSize, 5, 0x20, out);
+        m_table.SetMaxSize(m_pendingSize);
+        m_pendingSize = m_minPendingSize = SIZE_MAX;
+    }
+    for (const HeaderField& field : fields) {
+        size_t nameIndex = 0;
+        size_t index = 0;
+        for (size_t i = 0; i < STATIC_COUNT && !index; i++) {
+            if (STATIC_TABLE[i].name != field.name) { continue; }
+            if (STATIC_TABLE[i].value == field.value) { index = i + 1; }
+            if (!nameIndex) { nameIndex = i + 1; }
+        }
+        if (!index) {
+            bool exact;
+            int found = m_table.Find(field.name, field.value, &exact);
+            if (found >= 0 && exact) {
+                index = STATIC_COUNT + 1 + found;
+            } else if (found >= 0 && !nameIndex) {
+                nameIndex = STATIC_COUNT + 1 + found;
+            }
+        }
+        if (index) {
+            Encode_Int(index, 7, 0x80, out);
+            continue;
+        }
+        bool indexing = _Worth_Indexing(field.name);
+        Encode_Int(nameIndex, indexing ? 6 : 4, indexing ? 0x40 : 0x00, out);
+        if (!nameIndex) { Encode_String(field.name, out); }
+        Encode_String(field.value, out);
+        if (indexing) { m_table.Add(field.name, field.value); }
+    }
+}
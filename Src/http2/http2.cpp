@@ -0,0 +1,525 @@
+#include "../include/http2.h"
+#include "../include/log.h"
+#include "../include/router.h"
+using namespace std;
+
+std::atomic<bool> Http2Session::enabled(true);
+std::atomic<int> Http2Session::maxStreams(100);
+std::atomic<int> Http2Session::maxRequests(0);
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LEN = sizeof(PREFACE) - 1;
+
+static const size_t MAX_FRAME_SIZE = 16384;         // 本端接收的帧大小(默认值，不通告)
+static const size_t MAX_HEADER_LIST = 16384;        // SETTINGS_MAX_HEADER_LIST_SIZE
+static const size_t MAX_HEADER_BLOCK = 65536;       // HEADERS + CONTINUATION 累计上限
+static const size_t MAX_BODY = 1 << 20;             // 单个请求体上限(HTTP/2的请求体放在内存里，不超过max_body)
+static const int64_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+static const size_t WRITE_QUANTUM = 256 * 1024;     // 一次处理最多生成的输出，发送完再继续
+
+static inline uint32_t Get32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void Put32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+// HTTP2-Settings头部: base64url编码的SETTINGS帧载荷(不带填充)
+static bool Base64Url_Decode(const string& text, string* out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    out->clear();
+    for (char c : text) {
+        int v;
+        if (c >= 'A' && c <= 'Z') { v = c - 'A'; }
+        else if (c >= 'a' && c <= 'z') { v = c - 'a' + 26; }
+        else if (c >= '0' && c <= '9') { v = c - '0' + 52; }
+        else if (c == '-' || c == '+') { v = 62; }
+        else if (c == '_' || c == '/') { v = 63; }
+        else if (c == '=') { break; }
+        else { return false; }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    return true;
+}
+
+Http2Session::Http2Session(const char* ip, const char* srcDir)
+    : m_ip(ip), m_srcDir(srcDir), m_decoder(4096, MAX_HEADER_LIST),
+      m_prefaceDone(false), m_settingsSent(false), m_settingsDone(false),
+      m_lastStreamId(0), m_contStream(0), m_contEndStream(false), m_streamCount(0),
+      m_sendWindow(DEFAULT_WINDOW), m_peerInitWindow(DEFAULT_WINDOW), m_peerMaxFrame(16384),
+      m_goawaySent(false), m_goawayRecv(false), m_error(false) {}
+
+int Http2Session::Check_Preface(const Buffer& in) {
+    size_t n = min(in.ReadableBytes(), PREFACE_LEN);
+    if (memcmp(in.Peek(), PREFACE, n) != 0) { return 0; }
+    return n == PREFACE_LEN ? 1 : -1;
+}
+
+bool Http2Session::Upgrade(const string& settings, HttpRequest& request, Buffer& out) {
+    string payload;
+    if (!Base64Url_Decode(settings, &payload) || payload.size() % 6 != 0 ||
+        _On_Settings(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()) != NO_ERROR) {
+        return false;
+    }
+    out.Append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    _Send_Settings(out);
+    // 升级的请求是流1，请求已经完整(半关闭)
+    m_lastStreamId = 1;
+    m_streamCount = 1;
+    Stream* stream = _Open_Stream(1, true);
+    stream->parseEnd = stream->begin;
+    _Serve(stream, request, out);
+    _Pump(out);
+    return true;
+}
+
+void Http2Session::Process(Buffer& in, Buffer& out) {
+    if (m_error) {
+        in.RetrieveAll();
+        return;
+    }
+    if (!m_prefaceDone) {
+        int preface = Check_Preface(in);
+        if (preface < 0) {
+            _Pump(out);     // h2c升级时流1的响应不必等客户端前言
+            return;
+        }
+        if (preface == 0) {
+            _Conn_Error(PROTOCOL_ERROR, out);
+            in.RetrieveAll();
+            return;
+        }
+        in.Retrieve(PREFACE_LEN);
+        m_prefaceDone = true;
+        if (!m_settingsSent) { _Send_Settings(out); }
+    }
+    // 帧头: 长度(24位) 类型(8位) 标志(8位) 流id(31位)
+    while (in.ReadableBytes() >= 9) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.Peek());
+        size_t len = (static_cast<size_t>(p[0]) << 16) | (p[1] << 8) | p[2];
+        if (len > MAX_FRAME_SIZE) {
+            _Conn_Error(FRAME_SIZE_ERROR, out);
+            break;
+        }
+        if (in.ReadableBytes() < 9 + len) { break; }
+        bool ok = _On_Frame(p[3], p[4], Get32(p + 5) & 0x7fffffff, p + 9, len, out);
+        in.Retrieve(9 + len);
+        if (!ok) { break; }
+    }
+    if (m_error) {
+        in.RetrieveAll();
+        return;
+    }
+    _Pump(out);
+}
+
+void Http2Session::Shutdown(Buffer& out) {
+    if (m_goawaySent) { return; }
+    if (!m_settingsSent) { _Send_Settings(out); }
+    _Write_Goaway(NO_ERROR, out);
+}
+
+bool Http2Session::Done() const {
+    return m_error || ((m_goawaySent || m_goawayRecv) && m_streams.empty() && m_contStream == 0);
+}
+
+bool Http2Session::_On_Frame(uint8_t type, uint8_t flags, uint32_t id, const uint8_t* payload, size_t len, Buffer& out) {
+    // 客户端前言之后的第一个帧必须是SETTINGS; 头部块没有结束时只能收到同一个流的CONTINUATION
+    if (!m_settingsDone && (type != SETTINGS || (flags & ACK))) { return _Conn_Error(PROTOCOL_ERROR, out); }
+    if (m_contStream && (type != CONTINUATION || id != m_contStream)) { return _Conn_Error(PROTOCOL_ERROR, out); }
+
+    switch (type) {
+    case DATA:
+        return _On_Data(id, flags, payload, len, out);
+    case HEADERS: {
+        if (id == 0 || !(id & 1)) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        size_t pad = 0;
+        if (flags & PADDED) {
+            if (len < 1) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+            pad = *payload++;
+            len--;
+        }
+        if (flags & PRIORITY_FLAG) {
+            // 不使用优先级: 各个流轮流发送
+            if (len < 5) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+            payload += 5;
+            len -= 5;
+        }
+        if (pad > len) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        m_headerBlock.assign(reinterpret_cast<const char*>(payload), len - pad);
+        if (flags & END_HEADERS) { return _On_Headers(id, flags & END_STREAM, out); }
+        m_contStream = id;
+        m_contEndStream = flags & END_STREAM;
+        return true;
+    }
+    case CONTINUATION: {
+        if (!m_contStream) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        if (m_headerBlock.size() + len > MAX_HEADER_BLOCK) { return _Conn_Error(ENHANCE_YOUR_CALM, out); }
+        m_headerBlock.append(reinterpret_cast<const char*>(payload), len);
+        if (!(flags & END_HEADERS)) { return true; }
+        m_contStream = 0;
+        return _On_Headers(id, m_contEndStream, out);
+    }
+    case PRIORITY:
+        if (id == 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        if (len != 5) { _Reset(id, FRAME_SIZE_ERROR, out); }
+        return true;
+    case RST_STREAM:
+        if (id == 0 || id > m_lastStreamId) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        if (len != 4) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+        m_streams.erase(id);
+        return true;
+    case SETTINGS: {
+        if (id != 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        if (flags & ACK) { return len == 0 ? true : _Conn_Error(FRAME_SIZE_ERROR, out); }
+        if (len % 6 != 0) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+        int err = _On_Settings(payload, len);
+        if (err != NO_ERROR) { return _Conn_Error(err, out); }
+        m_settingsDone = true;
+        _Frame_Header(0, SETTINGS, ACK, 0, out);
+        return true;
+    }
+    case PING:
+        if (id != 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        if (len != 8) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+        if (!(flags & ACK)) {
+            _Frame_Header(8, PING, ACK, 0, out);
+            out.Append(payload, 8);
+        }
+        return true;
+    case GOAWAY:
+        if (id != 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        m_goawayRecv = true;
+        return true;
+    case WINDOW_UPDATE:
+        return _On_Window_Update(id, payload, len, out);
+    case PUSH_PROMISE:
+        return _Conn_Error(PROTOCOL_ERROR, out);
+    default:
+        return true;    // 未知类型的帧忽略
+    }
+}
+
+int Http2Session::_On_Settings(const uint8_t* payload, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t key = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = Get32(payload + i + 2);
+        switch (key) {
+        case 1:     // HEADER_TABLE_SIZE
+            m_encoder.SetMaxTableSize(value);
+            break;
+        case 2:     // ENABLE_PUSH(不使用服务器推送)
+            if (value > 1) { return PROTOCOL_ERROR; }
+            break;
+        case 4: {   // INITIAL_WINDOW_SIZE: 差值作用到所有已打开的流
+            if (value > MAX_WINDOW) { return FLOW_CONTROL_ERROR; }
+            int64_t delta = static_cast<int64_t>(value) - m_peerInitWindow;
+            for (auto& item : m_streams) {
+                item.second->sendWindow += delta;
+                if (item.second->sendWindow > MAX_WINDOW) { return FLOW_CONTROL_ERROR; }
+            }
+            m_peerInitWindow = value;
+            break;
+        }
+        case 5:     // MAX_FRAME_SIZE
+            if (value < 16384 || value > 16777215) { return PROTOCOL_ERROR; }
+            m_peerMaxFrame = value;
+            break;
+        default:
+            break;
+        }
+    }
+    return NO_ERROR;
+}
+
+Http2Session::Stream* Http2Session::_Open_Stream(uint32_t id, bool remoteClosed) {
+    unique_ptr<Stream> stream(new Stream);
+    stream->id = id;
+    stream->remoteClosed = remoteClosed;
+    stream->sendWindow = m_peerInitWindow;
+    stream->data = nullptr;
+    stream->left = 0;
+    stream->responding = false;
+    stream->code = 0;
+    stream->bytes = 0;
+    stream->begin = chrono::steady_clock::now();
+    Stream* raw = stream.get();
+    m_streams[id] = std::move(stream);
+    return raw;
+}
+
+bool Http2Session::_On_Headers(uint32_t id, bool endStream, Buffer& out) {
+    // 即使流会被拒绝也必须解码，保持动态表与对端一致
+    vector<HeaderField> fields;
+    bool ok = m_decoder.Decode(reinterpret_cast<const uint8_t*>(m_headerBlock.data()), m_headerBlock.size(), &fields);
+    m_headerBlock.clear();
+    if (!ok) { return _Conn_Error(COMPRESSION_ERROR, out); }
+
+    auto it = m_streams.find(id);
+    if (it != m_streams.end()) {
+        // 请求体之后的trailer: 必须结束请求，内容忽略
+        Stream* stream = it->second.get();
+        if (stream->remoteClosed || !endStream) {
+            _Reset(id, PROTOCOL_ERROR, out);
+            return true;
+        }
+        stream->remoteClosed = true;
+        _Respond(stream, out);
+        return true;
+    }
+    if (id <= m_lastStreamId) { return _Conn_Error(STREAM_CLOSED, out); }
+    m_lastStreamId = id;
+    // 已发送或收到GOAWAY之后的新流不处理
+    if (m_goawaySent || m_goawayRecv) { return true; }
+    if (static_cast<int>(m_streams.size()) >= maxStreams) {
+        _Reset(id, REFUSED_STREAM, out);
+        return true;
+    }
+    Stream* stream = _Open_Stream(id, endStream);
+    stream->headers = std::move(fields);
+    m_streamCount++;
+    int maxReq = maxRequests;
+    if (maxReq > 0 && m_streamCount >= maxReq) { Shutdown(out); }
+    if (endStream) { _Respond(stream, out); }
+    return true;
+}
+
+bool Http2Session::_On_Data(uint32_t id, uint8_t flags, const uint8_t* payload, size_t len, Buffer& out) {
+    if (id == 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+    size_t pad = 0;
+    if (flags & PADDED) {
+        if (len < 1) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+        pad = payload[0];
+        if (pad >= len) { return _Conn_Error(PROTOCOL_ERROR, out); }
+    }
+    const char* data = reinterpret_cast<const char*>(payload) + (flags & PADDED ? 1 : 0);
+    size_t n = len - (flags & PADDED ? 1 : 0) - pad;
+
+    // 流量控制: 收到多少立即归还多少(请求体的大小另有上限)
+    uint8_t inc[4];
+    Put32(inc, static_cast<uint32_t>(len));
+    if (len > 0) {
+        _Frame_Header(4, WINDOW_UPDATE, 0, 0, out);
+        out.Append(inc, 4);
+    }
+    auto it = m_streams.find(id);
+    if (it == m_streams.end() || it->second->remoteClosed) {
+        if (id > m_lastStreamId) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        _Reset(id, STREAM_CLOSED, out);
+        return true;
+    }
+    Stream* stream = it->second.get();
+    if (stream->body.size() + n > std::min<size_t>(MAX_BODY, HttpRequest::maxBody)) {
+        _Reset(id, CANCEL, out);
+        return true;
+    }
+    stream->body.append(data, n);
+    if (flags & END_STREAM) {
+        stream->remoteClosed = true;
+        _Respond(stream, out);
+    } else if (len > 0) {
+        _Frame_Header(4, WINDOW_UPDATE, 0, id, out);
+        out.Append(inc, 4);
+    }
+    return true;
+}
+
+bool Http2Session::_On_Window_Update(uint32_t id, const uint8_t* payload, size_t len, Buffer& out) {
+    if (len != 4) { return _Conn_Error(FRAME_SIZE_ERROR, out); }
+    uint32_t inc = Get32(payload) & 0x7fffffff;
+    if (id == 0) {
+        if (inc == 0) { return _Conn_Error(PROTOCOL_ERROR, out); }
+        m_sendWindow += inc;
+        if (m_sendWindow > MAX_WINDOW) { return _Conn_Error(FLOW_CONTROL_ERROR, out); }
+        return true;
+    }
+    if (id > m_lastStreamId) { return _Conn_Error(PROTOCOL_ERROR, out); }
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) { return true; }     // 已结束的流
+    if (inc == 0) {
+        _Reset(id, PROTOCOL_ERROR, out);
+        return true;
+    }
+    it->second->sendWindow += inc;
+    if (it->second->sendWindow > MAX_WINDOW) { _Reset(id, FLOW_CONTROL_ERROR, out); }
+    return true;
+}
+
+// 请求接收完: 转成HttpRequest(与HTTP/1.1共用路径映射和登录注册)，再生成响应
+void Http2Session::_Respond(Stream* stream, Buffer& out) {
+    stream->parseEnd = chrono::steady_clock::now();
+    string method, path;
+    HeaderMap header;
+    for (const HeaderField& field : stream->headers) {
+        if (field.name == ":method") { method = field.value; }
+        else if (field.name == ":path") { path = field.value; }
+        else if ((field.name.empty() || field.name[0] != ':') && !header.Add(field.name, field.value)) {
+            _Reset(stream->id, PROTOCOL_ERROR, out);
+            return;
+        }
+    }
+    stream->headers.clear();
+    if (method.empty() || path.empty()) {
+        _Reset(stream->id, PROTOCOL_ERROR, out);
+        return;
+    }
+    // 按路径限速(不含查询串)，与HTTP/1.1在解析前检查一致
+    if (m_admit && !m_admit(path.substr(0, path.find('?')))) {
+        stream->method = method;
+        stream->path = path;
+        stream->code = 429;
+        stream->text = HttpResponse::TooMany_Body();
+        stream->data = stream->text.data();
+        stream->left = stream->text.size();
+        _Send_Headers(stream, "text/plain", out);
+        return;
+    }
+    HttpRequest request;
+    request.Init_H2(method, path, std::move(header), std::move(stream->body));
+    _Serve(stream, request, out);
+}
+
+// 与HTTP/1.1相同: 先查路由表，没有路由时按静态文件响应(映射文件，失败时回复错误页)
+void Http2Session::_Serve(Stream* stream, HttpRequest& request, Buffer& out) {
+    stream->method = request.method();
+    Reply reply;
+    if (Router::Instance()->Route(request, &reply)) {
+        if (reply.file.empty()) {
+            stream->path = request.path();
+            stream->code = reply.code;
+            stream->text = std::move(reply.body);
+            stream->data = stream->text.data();
+            stream->left = stream->text.size();
+            _Send_Headers(stream, reply.type, out);
+            return;
+        }
+        request.path() = reply.file;
+    }
+    stream->path = request.path();
+    HttpResponse& response = stream->response;
+    response.Init(m_srcDir, request.path(), false, 200);
+    response.Prepare();
+    if (response.MapFile()) {
+        stream->data = response.File();
+        stream->left = response.FileLen();
+    } else {
+        stream->text = response.ErrorBody("File NotFound!");
+        stream->data = stream->text.data();
+        stream->left = stream->text.size();
+    }
+    stream->code = response.Code();
+    _Send_Headers(stream, response.FileType(), out);
+}
+
+void Http2Session::_Send_Headers(Stream* stream, const string& type, Buffer& out) {
+    string block;
+    m_encoder.Encode({ { ":status", to_string(stream->code) },
+                       { "content-type", type },
+                       { "content-length", to_string(stream->left) } }, &block);
+    _Frame_Header(block.size(), HEADERS, END_HEADERS | (stream->left ? 0 : END_STREAM), stream->id, out);
+    out.Append(block);
+    stream->respEnd = chrono::steady_clock::now();
+    stream->responding = true;
+    if (stream->left == 0) { _Finish(stream->id); }
+}
+
+// 轮流从每个有数据的流取一帧，直到窗口用完或本次输出达到上限
+void Http2Session::_Pump(Buffer& out) {
+    while (m_sendWindow > 0 && out.ReadableBytes() < WRITE_QUANTUM) {
+        bool sent = false;
+        for (auto it = m_streams.begin(); it != m_streams.end() && m_sendWindow > 0; ) {
+            Stream* stream = it->second.get();
+            ++it;   // _Finish会删除当前流
+            if (!stream->responding || stream->sendWindow <= 0) { continue; }
+            size_t n = min(min(stream->left, m_peerMaxFrame),
+                           static_cast<size_t>(min(stream->sendWindow, m_sendWindow)));
+            bool last = (n == stream->left);
+            _Frame_Header(n, DATA, last ? END_STREAM : 0, stream->id, out);
+            out.Append(stream->data, n);
+            stream->data += n;
+            stream->left -= n;
+            stream->bytes += n;
+            stream->sendWindow -= n;
+            m_sendWindow -= n;
+            sent = true;
+            if (last) { _Finish(stream->id); }
+        }
+        if (!sent) { break; }
+    }
+}
+
+void Http2Session::_Finish(uint32_t id) {
+    auto it = m_streams.find(id);
+    if (it == m_streams.end()) { return; }
+    _Log(*it->second);
+    m_streams.erase(it);
+}
+
+// 访问日志格式与HTTP/1.1相同; 发送耗时截止到最后一帧放进输出buffer
+void Http2Session::_Log(const Stream& stream) const {
+    auto now = chrono::steady_clock::now();
+    auto us = [](chrono::steady_clock::duration d) {
+        return static_cast<long>(chrono::duration_cast<chrono::microseconds>(d).count());
+    };
+    LOG_ACCESS("%s \"%s %s HTTP/2\" %d %zu %ld/%ld/%ld/%ldus",
+               m_ip, stream.method.c_str(), stream.path.c_str(), stream.code, stream.bytes,
+               us(stream.parseEnd - stream.begin), us(stream.respEnd - stream.parseEnd),
+               us(now - stream.respEnd), us(now - stream.begin));
+}
+
+bool Http2Session::_Conn_Error(int code, Buffer& out) {
+    if (!m_error) {
+        LOG_DEBUG("h2: %s connection error %d", m_ip, code);
+        if (!m_settingsSent) { _Send_Settings(out); }
+        _Write_Goaway(code, out);
+        m_error = true;
+    }
+    return false;
+}
+
+void Http2Session::_Reset(uint32_t id, int code, Buffer& out) {
+    uint8_t payload[4];
+    Put32(payload, code);
+    _Frame_Header(4, RST_STREAM, 0, id, out);
+    out.Append(payload, 4);
+    m_streams.erase(id);
+}
+
+void Http2Session::_Send_Settings(Buffer& out) {
+    uint8_t payload[12];
+    payload[0] = 0; payload[1] = 3;     // MAX_CONCURRENT_STREAMS
+    Put32(payload + 2, maxStreams);
+    payload[6] = 0; payload[7] = 6;     // MAX_HEADER_LIST_SIZE
+    Put32(payload + 8, MAX_HEADER_LIST);
+    _Frame_Header(sizeof(payload), SETTINGS, 0, 0, out);
+    out.Append(payload, sizeof(payload));
+    m_settingsSent = true;
+}
+
+void Http2Session::_Write_Goaway(int code, Buffer& out) {
+    uint8_t payload[8];
+    Put32(payload, m_lastStreamId);
+    Put32(payload + 4, code);
+    _Frame_Header(sizeof(payload), GOAWAY, 0, 0, out);
+    out.Append(payload, sizeof(payload));
+    m_goawaySent = true;
+}
+
+void Http2Session::_Frame_Header(size_t len, uint8_t type, uint8_t flags, uint32_t id, Buffer& out) {
+    uint8_t header[9];
+    header[0] = len >> 16;
+    header[1] = len >> 8;
+    header[2] = len;
+    header[3] = type;
+    header[4] = flags;
+    Put32(header + 5, id);
+    out.Append(header, sizeof(header));
+}
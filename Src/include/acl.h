@@ -0,0 +1,62 @@
+#ifndef _ACL_H
+#define _ACL_H
+
+#include "./define.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Config;
+
+// 访问控制: allow/deny 两张CIDR列表(IPv4和IPv6)编译成一棵路径压缩的二叉前缀树(Patricia)
+// IPv4地址映射到 ::ffff:0:0/96 下，与IPv6共用一棵树
+// 判定: 最长前缀匹配的那一条决定允许或拒绝; 都不匹配时，没有allow条目则允许，否则拒绝
+// 只在reactor线程accept之后查询; 重新加载在工作线程中编译新树，编译好后交给reactor替换，
+// reactor不会因为加载大列表而停顿
+class Acl {
+public:
+    Acl();
+    ~Acl();
+
+    // 读取配置中的条目和列表文件并编译(可以在任意线程调用)
+    bool Load(const Config& cfg);
+    // reactor线程调用
+    bool Allow(const struct sockaddr* addr);
+
+private:
+    struct Key {
+        uint64_t hi;
+        uint64_t lo;
+    };
+    struct Node {
+        Key key;            // 前缀(len之后的位为0)
+        uint8_t len;
+        int8_t action;      // -1 中间节点, 0 拒绝, 1 允许
+        uint32_t child[2];  // 0表示没有(根节点不会是子节点)
+    };
+    // IPv4按前16位直接索引: 从哪个节点继续查找、以及之前路径上最长匹配的结果
+    struct Jump {
+        uint32_t node;
+        int32_t result;
+    };
+    struct Table {
+        std::vector<Node> nodes;
+        std::vector<Jump> v4;
+        bool fallback;      // 都不匹配时的结果
+        size_t allows;
+        size_t denies;
+    };
+
+    static bool _Parse_Cidr(const std::string& text, Key* key, int* len);
+    static bool _Load_File(const std::string& path, int action, Table* table);
+    static void _Insert(Table* table, const Key& key, int len, int action);
+    static void _Build_Jump(Table* table);
+    static bool _Walk(const Table* table, uint32_t cur, uint64_t hi, uint64_t lo, bool result);
+
+    std::unique_ptr<Table> m_table;     // reactor正在使用的树
+    std::atomic<Table*> m_pending;      // 新编译好、等待reactor接管的树
+    std::atomic<uint64_t> m_generation; // 多次重新加载时只发布最新一次的结果
+};
+
+#endif /* _ACL_H */
@@ -0,0 +1,24 @@
+#ifndef _AFFINITY_H
+#define _AFFINITY_H
+
+#include "./define.h"
+#include <string>
+#include <vector>
+
+// CPU绑定与NUMA: 把reactor和工作线程固定在指定CPU上，并让内存优先从这些CPU所在的NUMA节点分配
+// 网卡RX队列中断所在的CPU从 /proc/interrupts 和 /proc/irq/N/ 中读取
+class Affinity {
+public:
+    static bool Parse_CpuList(const std::string& str, std::vector<int>* cpus);   // 如 "0-3,8"
+    static std::string To_CpuList(const std::vector<int>& cpus);
+
+    static std::vector<int> Allowed_Cpus();                 // 当前线程允许运行的CPU
+    static std::vector<int> Node_Cpus(int node);            // NUMA节点的CPU
+    static int Cpu_Node(int cpu);                           // CPU所在的NUMA节点, 未知返回-1
+    static std::vector<int> Irq_Cpus(const std::string& iface);     // 网卡RX队列中断所在的CPU
+
+    static bool Pin_Thread(const std::vector<int>& cpus);  // 绑定当前线程
+    static bool Prefer_Node(int node);                      // 当前线程(及之后创建的线程)优先从node分配内存
+};
+
+#endif /* _AFFINITY_H */
@@ -0,0 +1,114 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include "./define.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// 每个连接一个的bump分配器: 请求处理过程中的小对象从当前块顺序分配，释放是空操作，请求结束时Reset整体回收
+// Reset时如果本次用了多个块，合并成一个与高水位一样大的块，稳态下每个请求不再调用malloc
+// 放在Arena上的对象不执行析构函数，只能放不持有其他资源(文件、堆内存)的对象
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 4096);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // align必须是2的幂; 对齐的是返回的地址(不是块内偏移)
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(m_block);
+        size_t pos = ((base + m_pos + align - 1) & ~(uintptr_t)(align - 1)) - base;
+        if (pos + size > m_cap) { return _Allocate_Slow(size, align); }
+        m_pos = pos + size;
+        return m_block + pos;
+    }
+    // 在Arena上构造对象(不会被析构)
+    template<class T, class... Args>
+    T* Create(Args&&... args) {
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    // 回收全部分配，之前得到的指针都失效
+    void Reset();
+
+    size_t Used() const { return m_used + m_pos; }
+    uint64_t HeapAllocs() const { return m_heapAllocs; }
+
+    static std::atomic<uint64_t> heapAllocs;     // 所有Arena向堆申请块的总次数(观察稳态是否为0增长)
+    static const size_t MAX_BLOCK = 64 * 1024;   // Reset合并块的上限，个别很大的请求不会让连接一直占着大块
+
+private:
+    // 块头按max_align_t对齐，可分配区域的起点与malloc的返回值对齐方式相同
+    struct alignas(std::max_align_t) Block {
+        Block* next;
+    };
+
+    void* _Allocate_Slow(size_t size, size_t align);
+    char* _New_Block(size_t size);
+
+    char* m_block;          // 当前块的可用区域
+    size_t m_pos;
+    size_t m_cap;
+    Block* m_full;          // 已用满的块(链表)
+    size_t m_used;          // 已用满的块中分配出去的字节数
+    size_t m_blockSize;
+    uint64_t m_heapAllocs;
+};
+
+// 从Arena分配的STL分配器
+template<class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena* arena) : m_arena(arena) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    Arena* arena() const { return m_arena; }
+
+private:
+    Arena* m_arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+struct ArenaStringHash {
+    size_t operator()(const ArenaString& s) const {
+        size_t h = 14695981039346656037ull;    // FNV-1a
+        for (char c : s) { h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ull; }
+        return h;
+    }
+};
+
+// 表单字段(名字 -> 值)，整个表都在Arena上
+using FormMap = std::unordered_map<ArenaString, ArenaString, ArenaStringHash, std::equal_to<ArenaString>,
+                                   ArenaAllocator<std::pair<const ArenaString, ArenaString>>>;
+
+// 设置字段的值(名字和值都拷贝到表所在的Arena上)
+inline void Form_Set(FormMap* form, const char* key, size_t keyLen, const char* value, size_t valueLen) {
+    ArenaAllocator<char> alloc(form->get_allocator());
+    ArenaString name(key, keyLen, alloc);
+    auto it = form->find(name);
+    if (it != form->end()) {
+        it->second.assign(value, valueLen);
+    } else {
+        form->emplace(std::move(name), ArenaString(value, valueLen, alloc));
+    }
+}
+
+#endif /* _ARENA_H */
@@ -23,6 +23,7 @@ public:
     void RetrieveUntil(const char* end);
 
     void RetrieveAll() ;
+    void Reset(size_t size);
     std::string RetrieveAllToStr();
 
     const char* BeginWriteConst() const;
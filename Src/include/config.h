@@ -2,23 +2,107 @@
 #define _CONFIG_H
 
 #include "./define.h"
+#include <string>
+#include <vector>
 
+// 配置优先级: 默认值 < 配置文件(-f) < 命令行参数
+// 配置文件为INI格式，见 server.conf；收到SIGHUP时用 Reload() 重新读取
 class Config {
 public:
     Config();
     ~Config() = default;
 
     void Parse_Arg(int argc, char* argv[]);
+    bool Load_File(const std::string& path);
+    bool Reload();
 
+    const std::vector<std::string>& Args() const { return m_args; }
+
+    // [server]
     int m_port;
+    std::vector<std::string> m_listen;  // 监听地址，为空时监听m_port
     int m_optLinger;
     int m_trigMode;
     int m_timeout;
+    int m_backlog;
+    int m_drainTimeout;
+    int m_acceptBatch;
+    int m_deferAccept;
+    int m_fastOpen;
+    int m_maxConn;
+    int m_evictPercent;
+    int m_maxRequests;
     int m_threadPoolNum;
+    int m_readBuffSize;
+    int m_writeBuffSize;
+    int m_writeQuantumKB;
+    int m_writeQuantumUs;
+    int m_ioThreads;
+    std::string m_root;
+    int m_maxBodyKB;
+    int m_spoolKB;
+    std::string m_spoolDir;
+    std::string m_uploadDir;
+
+    // [mysql]
+    std::string m_sqlHost;
+    int m_sqlPort;
+    std::string m_sqlUser;
+    std::string m_sqlPwd;
+    std::string m_dbName;
     int m_sqlPoolNum;
 
-};
+    // [log]
+    bool m_openLog;
+    int m_logLevel;
+    int m_logStagingKB;
 
-#endif /* _CONFIG_H */
+    // [trace]
+    int m_traceSample;
+
+    // [cpu]
+    int m_reactorCpu;
+    std::string m_workerCpus;
+    int m_numaNode;
+    std::string m_irqIface;
+
+    // [overload]
+    int m_overloadTargetMs;
+    int m_overloadIntervalMs;
+    int m_retryAfter;
+
+    // [ratelimit]
+    double m_connRate;
+    int m_connBurst;
+    double m_reqRate;
+    int m_reqBurst;
+    std::vector<std::string> m_rateRules;   // 每条为"路径 速率 [突发量]"
+    int m_rateSlots;
 
+    // [acl]
+    std::vector<std::string> m_aclAllow;
+    std::vector<std::string> m_aclDeny;
+    std::string m_aclAllowFile;
+    std::string m_aclDenyFile;
 
+    // [http2]
+    bool m_http2;
+    int m_h2MaxStreams;
+
+    // [websocket]
+    std::string m_wsPath;
+    int m_wsIntervalMs;
+    int m_wsMaxMessage;
+    int m_wsQueueKB;
+
+    std::string m_configFile;
+
+private:
+    void _Set_Defaults();
+    void _Apply_Args(const std::vector<std::string>& args);
+    bool _Set(const std::string& section, const std::string& key, const std::string& value);
+
+    std::vector<std::string> m_args;    // 保存命令行参数，重新加载时再次覆盖配置文件
+};
+
+#endif /* _CONFIG_H */
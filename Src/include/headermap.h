@@ -0,0 +1,90 @@
+#ifndef _HEADERMAP_H
+#define _HEADERMAP_H
+
+#include "./define.h"
+#include <string>
+#include <vector>
+
+#include "./slice.h"
+
+// 请求头部表: 常用的头部名字用编译期生成的完美哈希映射到固定的槽位，其余的放进内联的小数组(不够时才用vector)
+// 名字和值按收到的顺序追加到一块连续存储中，各个字段只记录偏移和长度; 存储的容量跨请求复用，
+// 同一连接上的后续请求解析头部不需要分配内存。查找忽略名字的大小写(RFC 7230)
+class HeaderMap {
+public:
+    // 常用头部的槽位，顺序与headermap.cpp中的名字表一致
+    enum Id {
+        HOST,
+        CONNECTION,
+        KEEP_ALIVE,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        TRANSFER_ENCODING,
+        EXPECT,
+        UPGRADE,
+        HTTP2_SETTINGS,
+        SEC_WEBSOCKET_KEY,
+        SEC_WEBSOCKET_VERSION,
+        USER_AGENT,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        COOKIE,
+        REFERER,
+        ORIGIN,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        PRAGMA,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        RANGE,
+        X_FORWARDED_FOR,
+        COUNT,
+    };
+
+    HeaderMap() { Clear(); }
+
+    void Clear();
+    // 添加一个字段，常用头部重复出现时按逗号合并(RFC 7230 3.2.2); 字段行数(合并的也算)超过上限返回false
+    bool Add(const char* name, size_t nameLen, const char* value, size_t valueLen);
+    bool Add(const std::string& name, const std::string& value) {
+        return Add(name.data(), name.size(), value.data(), value.size());
+    }
+
+    // 返回的片段指向内部存储，下一次Add或Clear之前有效; 没有这个头部时为空
+    bool Has(Id id) const { return (m_present >> id) & 1; }
+    Slice Get(Id id) const { return Has(id) ? _Slice(m_known[id]) : Slice(); }
+    Slice Get(const char* name, size_t len) const;
+    Slice Get(const std::string& name) const { return Get(name.data(), name.size()); }
+    size_t Size() const;
+
+    // 常用头部的槽位，不是常用头部时返回-1
+    static int Lookup(const char* name, size_t len);
+
+    static const size_t MAX_FIELDS = 100;
+
+private:
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+    struct Field {
+        Span name;
+        Span value;
+    };
+    static const size_t INLINE_FIELDS = 8;
+
+    Span _Append(const char* data, size_t len);
+    Slice _Slice(const Span& span) const { return Slice(m_data.data() + span.off, span.len); }
+    const Field& _Unknown(size_t i) const { return i < INLINE_FIELDS ? m_inline[i] : m_overflow[i - INLINE_FIELDS]; }
+
+    std::string m_data;
+    uint32_t m_present;             // 已有的常用头部(按槽位的位图)
+    size_t m_lines;                 // 已添加的字段行数，包括合并进常用头部的
+    Span m_known[COUNT];
+    size_t m_unknown;
+    Field m_inline[INLINE_FIELDS];
+    std::vector<Field> m_overflow;
+};
+
+#endif /* _HEADERMAP_H */
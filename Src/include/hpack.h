@@ -0,0 +1,77 @@
+#ifndef _HPACK_H
+#define _HPACK_H
+
+#include "./define.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// HTTP/2头部压缩(RFC 7541)
+// 静态表(61项)全进程共享; 动态表每个连接两张: 解码客户端请求头用一张，编码响应头用一张
+struct HeaderField {
+    std::string name;
+    std::string value;
+};
+
+// 动态表: 新条目插在最前面，总大小(名字+值+32)超过上限时从最旧的条目开始淘汰
+class HpackTable {
+public:
+    explicit HpackTable(size_t maxSize = 4096) : m_size(0), m_maxSize(maxSize) {}
+
+    void Add(const std::string& name, const std::string& value);
+    void SetMaxSize(size_t maxSize);
+    size_t MaxSize() const { return m_maxSize; }
+    size_t Count() const { return m_entries.size(); }
+    const HeaderField& At(size_t i) const { return m_entries[i]; }     // 0为最新的条目
+    // 查找条目，返回下标(从0起)，-1表示没有; *exact表示名字和值都相同
+    int Find(const std::string& name, const std::string& value, bool* exact) const;
+
+private:
+    void _Evict(size_t maxSize);
+
+    std::deque<HeaderField> m_entries;
+    size_t m_size;
+    size_t m_maxSize;
+};
+
+class HpackDecoder {
+public:
+    // maxTableSize: 本端通告的SETTINGS_HEADER_TABLE_SIZE; maxListSize: 解码后头部总大小上限
+    HpackDecoder(size_t maxTableSize = 4096, size_t maxListSize = 16384);
+
+    // 解码一个完整的头部块(HEADERS + CONTINUATION)，出错返回false(连接错误COMPRESSION_ERROR)
+    bool Decode(const uint8_t* data, size_t len, std::vector<HeaderField>* fields);
+
+    static bool Decode_Int(const uint8_t** p, const uint8_t* end, int prefix, uint64_t* value);
+    static bool Decode_String(const uint8_t** p, const uint8_t* end, std::string* str);
+    static bool Huffman_Decode(const uint8_t* data, size_t len, std::string* str);
+
+private:
+    bool _Get(uint64_t index, HeaderField* field) const;
+
+    HpackTable m_table;
+    size_t m_maxTableSize;
+    size_t m_maxListSize;
+};
+
+class HpackEncoder {
+public:
+    HpackEncoder();
+
+    // 对端的SETTINGS_HEADER_TABLE_SIZE: 变小时在下一个头部块开头通知对端
+    void SetMaxTableSize(size_t size);
+    // 编码一个头部块追加到out; 值经常变化的头部(content-length等)不进动态表
+    void Encode(const std::vector<HeaderField>& fields, std::string* out);
+
+    static void Encode_Int(uint64_t value, int prefix, uint8_t first, std::string* out);
+    static void Encode_String(const std::string& str, std::string* out);
+
+private:
+    static bool _Worth_Indexing(const std::string& name);
+
+    HpackTable m_table;
+    size_t m_pendingSize;       // 待通知的表大小, SIZE_MAX表示没有
+    size_t m_minPendingSize;    // 两次头部块之间出现过的最小值，先通知它
+};
+
+#endif /* _HPACK_H */
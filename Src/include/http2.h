@@ -0,0 +1,117 @@
+#ifndef _HTTP2_H
+#define _HTTP2_H
+
+#include "./define.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./buffer.h"
+#include "./hpack.h"
+#include "./httprequest.h"
+#include "./httpresponse.h"
+
+// 明文HTTP/2(h2c，RFC 9113): 客户端直接发送连接前言(prior knowledge)，或在HTTP/1.1请求中带 Upgrade: h2c
+// 一个连接上的多个流复用同一套静态文件响应(HttpResponse映射文件)，响应体按流和连接的发送窗口切成DATA帧，
+// 各个流轮流发送，一个大文件不会挡住同一连接上其他流的小文件
+// 和HTTP/1.1一样由工作线程处理(EPOLLONESHOT保证同一时刻只有一个线程访问)
+class Http2Session {
+public:
+    Http2Session(const char* ip, const char* srcDir);
+    ~Http2Session() = default;
+
+    // 输入buffer开头是否为连接前言: 1 是, 0 不是, -1 数据还不够判断
+    static int Check_Preface(const Buffer& in);
+
+    // 收到带 Upgrade: h2c 的HTTP/1.1请求: 解析HTTP2-Settings，回复101并把这个请求作为流1响应
+    // HTTP2-Settings不合法时返回false，不写任何数据(按HTTP/1.1处理)
+    bool Upgrade(const std::string& settings, HttpRequest& request, Buffer& out);
+    // 处理输入buffer中完整的帧，并把要发送的帧追加到out; 连接出错时写好GOAWAY
+    void Process(Buffer& in, Buffer& out);
+    // 不再接受新的流(排空、达到单连接请求数上限)，已有的流处理完后关闭连接
+    void Shutdown(Buffer& out);
+    // 连接可以关闭: 出错，或者发送/收到GOAWAY且所有流都已结束
+    bool Done() const;
+    // 还有没结束的流(等待请求体、被流量控制挡住的响应)或没收完的头部块: 连接不算空闲
+    bool Active() const { return !m_error && (!m_streams.empty() || m_contStream != 0); }
+
+    // 请求准入检查(按IP和路径限速)，返回false时回复429
+    void SetAdmit(std::function<bool(const std::string& path)> admit) { m_admit = std::move(admit); }
+
+    static std::atomic<bool> enabled;
+    static std::atomic<int> maxStreams;     // SETTINGS_MAX_CONCURRENT_STREAMS
+    static std::atomic<int> maxRequests;    // 每个连接最多处理的流数, 0表示不限
+
+private:
+    enum { DATA = 0, HEADERS = 1, PRIORITY = 2, RST_STREAM = 3, SETTINGS = 4, PUSH_PROMISE = 5,
+           PING = 6, GOAWAY = 7, WINDOW_UPDATE = 8, CONTINUATION = 9 };
+    enum { END_STREAM = 0x1, ACK = 0x1, END_HEADERS = 0x4, PADDED = 0x8, PRIORITY_FLAG = 0x20 };
+    enum { NO_ERROR = 0, PROTOCOL_ERROR = 1, INTERNAL_ERROR = 2, FLOW_CONTROL_ERROR = 3, STREAM_CLOSED = 5,
+           FRAME_SIZE_ERROR = 6, REFUSED_STREAM = 7, CANCEL = 8, COMPRESSION_ERROR = 9, ENHANCE_YOUR_CALM = 11 };
+
+    struct Stream {
+        uint32_t id;
+        bool remoteClosed;          // 请求已接收完(END_STREAM)
+        int64_t sendWindow;
+        std::vector<HeaderField> headers;
+        std::string body;
+        HttpResponse response;      // 持有映射的文件
+        std::string text;           // 不来自文件的响应体(错误页、429)
+        const char* data;           // 还没发送的响应体
+        size_t left;
+        bool responding;            // HEADERS已发送，正在发送响应体
+        int code;
+        std::string method, path;
+        size_t bytes;
+        std::chrono::steady_clock::time_point begin, parseEnd, respEnd;
+    };
+
+    bool _On_Frame(uint8_t type, uint8_t flags, uint32_t id, const uint8_t* payload, size_t len, Buffer& out);
+    bool _On_Headers(uint32_t id, bool endStream, Buffer& out);
+    bool _On_Data(uint32_t id, uint8_t flags, const uint8_t* payload, size_t len, Buffer& out);
+    int _On_Settings(const uint8_t* payload, size_t len);
+    bool _On_Window_Update(uint32_t id, const uint8_t* payload, size_t len, Buffer& out);
+    Stream* _Open_Stream(uint32_t id, bool remoteClosed);
+    void _Respond(Stream* stream, Buffer& out);
+    void _Serve(Stream* stream, HttpRequest& request, Buffer& out);
+    void _Send_Headers(Stream* stream, const std::string& type, Buffer& out);
+    void _Pump(Buffer& out);
+    void _Finish(uint32_t id);
+    void _Log(const Stream& stream) const;
+
+    bool _Conn_Error(int code, Buffer& out);
+    void _Reset(uint32_t id, int code, Buffer& out);
+    void _Send_Settings(Buffer& out);
+    void _Write_Goaway(int code, Buffer& out);
+    static void _Frame_Header(size_t len, uint8_t type, uint8_t flags, uint32_t id, Buffer& out);
+
+    const char* m_ip;
+    const char* m_srcDir;
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+    std::map<uint32_t, std::unique_ptr<Stream>> m_streams;   // 按流id有序，轮流发送
+    std::function<bool(const std::string&)> m_admit;
+
+    bool m_prefaceDone;
+    bool m_settingsSent;
+    bool m_settingsDone;        // 收到了对端的第一个SETTINGS
+    uint32_t m_lastStreamId;    // 收到的最大流id
+    uint32_t m_contStream;      // 正在等待CONTINUATION的流, 0表示没有
+    bool m_contEndStream;
+    std::string m_headerBlock;
+    int m_streamCount;
+
+    int64_t m_sendWindow;       // 连接级发送窗口
+    int64_t m_peerInitWindow;   // 对端的SETTINGS_INITIAL_WINDOW_SIZE
+    size_t m_peerMaxFrame;      // 对端的SETTINGS_MAX_FRAME_SIZE
+
+    bool m_goawaySent;
+    bool m_goawayRecv;
+    bool m_error;               // 连接错误: 发送GOAWAY后关闭
+};
+
+#endif /* _HTTP2_H */
@@ -2,50 +2,153 @@
 #define _HTTPCONN_H
 
 #include "./define.h"
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
 #include "./sqlconnRAII.h"
 #include "./buffer.h"
+#include "./outqueue.h"
+#include "./iopool.h"
 #include "./httprequest.h"
 #include "./httpresponse.h"
+#include "./router.h"
+#include "./http2.h"
+#include "./websocket.h"
+#include "./ratelimit.h"
+#include "./log.h"
+#include "./trace.h"
 
 class HttpConn {
 public:
     HttpConn();
     ~HttpConn();
 
-    void init(int sockFd, const sockaddr_in& addr);
+    void init(int sockFd, const sockaddr_storage& addr);
     void Close();
 
     ssize_t read(int* saveErrno);
     ssize_t write(int* saveErrno);
     bool process();
+    bool Shed(int retryAfter);
+    bool Throttle();
+    bool PeekPath(const char** path, size_t* len) const;
+    void LogAccess();
+
+    // 工作线程占用计时: 任务从线程池取出时开始，交还reactor(重新注册事件或关闭连接)时结束
+    void BeginTask(uint64_t nowNs) { m_taskBegin = nowNs; }
+    void EndTask();
+    // write返回-1且错误码为EINPROGRESS时: 要发送的文件页不在页缓存中，交给冷读取线程池，读完后由reactor恢复
+    // 在EndTask之后调用(提交后连接可能马上被恢复); 提交失败返回false，调用者直接重新注册EPOLLOUT
+    bool Read_Cold();
+    uint64_t Gen() const { return m_gen; }      // 每次init加1，冷读取完成时识别fd是否已被复用
 
     int GetFd() const { return m_fd; }
-    struct sockaddr_in GetAddr() const { return m_addr; }
-    int GetPort() const { return m_addr.sin_port; }
-    const char* GetIP() const { return inet_ntoa(m_addr.sin_addr); }
+    bool IsClosed() const { return m_isClose; }
+    const struct sockaddr* GetAddr() const { return reinterpret_cast<const struct sockaddr*>(&m_addr); }
+    int GetPort() const;
+    const char* GetIP() const { return m_ip; }    // Unix套接字连接为"unix"
     
-    int ToWriteBytes() { return m_iov[0].iov_len + m_iov[1].iov_len; }
+    size_t ToWriteBytes() const { return m_out.Bytes(); }
+
+    bool IsKeepAlive() const { return m_h2 ? !m_h2->Done() : m_response.IsKeepAlive(); }
+    bool IsHttp2() const { return m_h2 != nullptr; }
+    bool IsWebSocket() const { return m_ws != nullptr; }
+    // 请求头或请求体还没收完; HTTP/2连接上还有没结束的流
+    bool InRequest() const { return m_h2 ? m_h2->Active() : m_request.InProgress(); }
+    WebSocket* Ws() { return m_ws.get(); }
+
+    uint64_t GetTraceId() const { return m_traceId; }
+    void SetTraceId(uint64_t id) { m_traceId = id; }
 
-    bool IsKeepAlive() const { return m_request.IsKeepAlive(); }
+    // 空闲: 没有正在处理的请求(升级排空时可以直接关闭)
+    bool IsIdle() const { return m_idle; }
+    void SetIdle(bool idle) { m_idle = idle; }
+    bool ClaimIdle() { return m_idle.exchange(false); }    // 取走空闲标记，保证只有一方关闭连接
 
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
+    static std::atomic<int> readBuffSize;     // 新连接读/写缓冲区的初始大小(可热加载)
+    static std::atomic<int> writeBuffSize;
+    static std::atomic<bool> isDraining;      // 正在排空(升级或退出): 响应改为Connection: close
+    static std::atomic<int> maxRequests;      // 每个长连接最多处理的请求数, 0表示不限
+    static std::atomic<int> keepAliveTimeout; // 长连接空闲超时(秒)，写进Keep-Alive响应头
+    static RateLimit* rateLimit;              // HTTP/2连接上每个流的请求限速
+    static std::atomic<int> writeQuantum;     // 一次写任务最多发送的字节数，用完后让出工作线程, 0表示不限
+    static std::atomic<int> writeQuantumUs;   // 一次写任务最多占用的时间(us), 0表示不限
+    static std::atomic<uint64_t> writeYields; // 用完写配额让出工作线程的次数
+    static std::atomic<uint64_t> holdNs;      // 所有连接占用工作线程的累计时间
+    static std::atomic<uint64_t> holdMaxNs;   // 单次任务占用工作线程的最长时间
+    static IoPool* ioPool;                    // 冷文件读取线程池, nullptr表示不检查(直接在工作线程中缺页)
+    static Broadcaster* hub;                  // WebSocket连接握手后订阅的广播
+
+    // 在WebServer活动链表中的位置(空闲连接淘汰用，只由reactor线程访问)
+    std::list<HttpConn*>::iterator lruPos;
+    bool inLru;
     
 private:
-   
+    static const size_t MAX_READ = 256 * 1024;     // 边沿触发时一次最多读进输入buffer的字节数
+    static const int MAX_PIPELINE = 16;             // 一次处理最多合并发送的流水线请求数
+    static const size_t MAX_BATCH = 64 * 1024;      // 输出队列超过这么多字节后不再合并后面的请求
+    static const size_t COLD_WINDOW = 256 * 1024;   // 不限写配额时每次发送前检查页缓存的范围
+
+    // 一个响应的访问日志，排进输出队列时记录，整个队列发送完后一起写日志(字符串的容量跨请求复用)
+    struct AccessRecord {
+        std::string method;
+        std::string path;
+        std::string version;
+        int code;
+        size_t bytes;
+        std::chrono::steady_clock::time_point reqBegin;
+        std::chrono::steady_clock::time_point parseEnd;
+        std::chrono::steady_clock::time_point respEnd;
+    };
+
     int m_fd;
-    struct  sockaddr_in m_addr;
+    struct sockaddr_storage m_addr;    // IPv4、IPv6或Unix域地址
+    char m_ip[INET6_ADDRSTRLEN];        // 建立连接时格式化好，日志线程安全地使用
     bool m_isClose;
     
-    int m_iovCnt;
-    struct iovec m_iov[2];
-    
     Buffer m_readBuff;  
-    Buffer m_writeBuff; 
+    OutQueue m_out;         // 响应头、文件和HTTP/2帧按顺序排队，集中发送
 
     HttpRequest m_request;
     HttpResponse m_response;
+
+    // 访问日志用的请求计时: 开始解析 -> 解析完成 -> 响应生成 -> 发送完成
+    std::chrono::steady_clock::time_point m_reqBegin;
+    std::chrono::steady_clock::time_point m_parseEnd;
+    std::chrono::steady_clock::time_point m_respEnd;
+    size_t m_respBytes;     // 当前响应开始时输出队列中的字节数
+    int m_reqCount;         // 本连接已处理的请求数
+    std::vector<AccessRecord> m_access;
+    size_t m_accessCnt;     // m_access中待写日志的记录数
+
+    std::unique_ptr<Http2Session> m_h2;     // 切换到HTTP/2之后的连接状态
+    std::unique_ptr<WebSocket> m_ws;        // 切换到WebSocket之后的连接状态(关闭时只退订，下次init时释放)
+
+    bool _Process_Http();
+    bool _Can_Pipeline() const;
+    void _Queue_Response();
+    void _Record_Access();
+    void _Reply_Now();
+    void _Format_Addr();
+    void _New_H2();
+    bool _Upgrade_H2();
+    bool _Process_H2();
+    bool _Upgrade_Ws();
+
+    uint64_t m_traceId;     // 本请求的追踪id, 0表示未采样
+    uint64_t m_taskBegin;   // 当前任务开始的时间, 0表示没有任务在执行
+    uint64_t m_holdNs;      // 本连接占用工作线程的累计时间和单次最长时间
+    uint64_t m_holdMaxNs;
+    uint32_t m_yields;      // 本连接用完写配额让出的次数
+    uint64_t m_gen;
+    OutQueue::FileRange m_cold;     // write发现的不在页缓存中的文件范围
+    bool m_coldSkip;        // 冷读取完成后的第一次发送不再检查(保证前进)
+    std::atomic<bool> m_idle;
 };
 
 
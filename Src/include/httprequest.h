@@ -5,57 +5,109 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
+#include <atomic>
+#include <memory>
 #include <errno.h>     
 #include <mysql/mysql.h>
 
 #include "./buffer.h"
 #include "./sqlconnpool.h"
 #include "./sqlconnRAII.h"
+#include "./trace.h"
+#include "./multipart.h"
+#include "./headermap.h"
+#include "./arena.h"
 
 class HttpRequest {
 public:
     enum PARSE_STATE {
         REQUEST_LINE,
         HEADERS,
-        BODY,
+        BODY,           // Content-Length请求体
+        CHUNK_SIZE,     // chunked: 块大小行
+        CHUNK_DATA,     // chunked: 块数据
+        CHUNK_END,      // chunked: 块数据后的CRLF
+        CHUNK_TRAILER,  // chunked: 尾部字段(忽略)
         FINISH,        
     };
 
-    HttpRequest() { Init(); }
-    ~HttpRequest() = default;
+    HttpRequest() : m_post(nullptr), m_spoolFd(-1) { Init(); }
+    ~HttpRequest();
+    HttpRequest(const HttpRequest&) = delete;
+    HttpRequest& operator=(const HttpRequest&) = delete;
 
     void Init();
+    // 解析输入buffer中已到达的数据，可以多次调用直到IsFinished(); 请求出错时返回false，ErrorCode()为状态码
+    // 请求体按到达的片段交给接收方后立即从buffer中取走: 小的放在内存里，超过spoolSize的写进临时文件
     bool parse(Buffer& buff);
+    bool IsFinished() const { return m_state == FINISH; }
+    bool InProgress() const { return m_state != REQUEST_LINE && m_state != FINISH && m_error == 0; }
+    int ErrorCode() const { return m_error; }
+    // 客户端带 Expect: 100-continue 在等待: 只返回一次true，调用方回复100后客户端开始发送请求体
+    bool ClaimContinue();
+    // HTTP/2的请求: 头部已由HPACK解码，只处理路径映射和表单
+    void Init_H2(const std::string& method, const std::string& path, HeaderMap&& header, std::string&& body);
 
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
     bool IsKeepAlive() const;
+    std::string GetHeader(const std::string& key) const;
+    // 常用头部按槽位取值，指向请求的头部表，下一个请求开始前有效
+    Slice Header(HeaderMap::Id id) const { return m_header.Get(id); }
+    // WebSocket握手请求: GET，Upgrade: websocket，Connection包含upgrade，带Sec-WebSocket-Key且版本为13
+    bool IsWebSocket() const;
 
-    std::string path() const { return m_path; }
+    const std::string& path() const { return m_path; }
     std::string& path() { return m_path; }
-    std::string method() const { return m_method; }
-    std::string version() const { return m_version; }
+    const std::string& method() const { return m_method; }
+    const std::string& version() const { return m_version; }
+
+    void SetTraceId(uint64_t id) { m_traceId = id; }
+    uint64_t TraceId() const { return m_traceId; }
+
+    // 请求体: 在内存中时为Body()，写进临时文件时为BodyFd()(已删除的文件，关闭即释放)
+    const std::string& Body() const { return m_body; }
+    int BodyFd() const { return m_spoolFd; }
+    size_t BodyLen() const { return m_bodyLen; }
+
+    // 登录(isLogin)或注册，查询/写入用户表
+    static bool User_Verify(const std::string& name, const std::string& pwd, bool isLogin);
+
+    static std::atomic<size_t> maxBody;     // 请求体上限(字节)，超过时回复413
+    static std::atomic<size_t> spoolSize;   // 请求体超过这个大小时写进临时文件
+    static std::string spoolDir;            // 临时文件目录(restart)
 
 private:
     PARSE_STATE m_state;
+    uint64_t m_traceId = 0;
     std::string m_method, m_path, m_version, m_body;
-    std::unordered_map<std::string, std::string> m_header;
-    std::unordered_map<std::string, std::string> m_post;
+    HeaderMap m_header;
+    Arena m_arena;          // 本次请求的小对象(表单字段)，Init时整体回收
+    FormMap* m_post;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
+    int m_error;            // 出错时的响应状态码(400、413、431、500、501)
+    uint64_t m_bodyLeft;    // 当前Content-Length请求体或块还没收到的字节数
+    size_t m_bodyLen;       // 已收到的请求体字节数
+    size_t m_headerBytes;   // 已收到的请求头字节数(包括行尾)
+    int m_spoolFd;          // 请求体临时文件, -1表示在内存中
+    bool m_continue;        // 需要回复100 Continue
+    std::unique_ptr<Multipart> m_multipart;    // multipart/form-data请求体的流式解析
 
-    bool _Parse_RequestLine(const std::string& line);
-    void _Parse_Header(const std::string& line);
-    void _Parse_Body(const std::string& line);
+    bool _Parse_RequestLine(Slice line);
+    void _Parse_Header(const char* begin, const char* end);
+    void _Begin_Body();
+    static int _Check_Encoding(Slice encoding);
+    bool _Parse_ChunkSize(Slice line);
+    bool _On_Body(const char* data, size_t len);
+    bool _Open_Spool();
+    bool _Spool(const char* data, size_t len);
+    FormMap* _Form();
 
-    void _Parse_Path();
     void _Parse_Post();
     void _Parse_FromUrlencoded();
 
-    static bool User_Verify(const std::string& name, const std::string& pwd, bool isLogin);
     static int Conver_Hex(char ch);
+    static void Url_Decode(const char* data, size_t len, ArenaString* out);
 };
 
 
@@ -13,23 +13,49 @@ public:
 
     void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
     void Make_Response(Buffer& buff);
+    void Prepare();
+    bool MapFile();
     void UnmapFile();
+    // 把映射的文件和打开的fd交给调用者(输出队列发送完后munmap、关闭)，FileLen仍然有效
+    char* ReleaseFile(int* fd);
     void ErrorContent(Buffer& buff, std::string message);
+    std::string ErrorBody(const std::string& message) const;
+    const std::string& FileType() const;
+    void Make_Unavailable(Buffer& buff, int retryAfter);
+    void Make_TooMany();     // 只设置状态，响应内容是TooMany_Text
+    void Make_Error(Buffer& buff, int code);
+    // 路由处理函数生成的响应体: 不查找文件，Make_Response直接发送这段内容
+    void SetContent(int code, const std::string& type, std::string body);
+
+    static std::string Unavailable_Text(int retryAfter);
+    static const std::string& TooMany_Text();
+    static const std::string& TooMany_Body();
+
+    void SetKeepAlive(int timeoutSec, int maxLeft) { m_keepAliveTimeout = timeoutSec; m_keepAliveMax = maxLeft; }
 
     int Code() const { return m_code; }
+    bool IsKeepAlive() const { return m_isKeepAlive; }
     char* File() { return m_mmFile; }
     size_t FileLen() const { return m_mmFileStat.st_size; }
 
 private:
     int m_code;
     bool m_isKeepAlive;
+    int m_keepAliveTimeout;     // Keep-Alive响应头: 空闲超时(秒)，0不写
+    int m_keepAliveMax;         // Keep-Alive响应头: 剩余请求数，0不写
 
     std::string m_path;
     std::string m_srcDir;
+    std::string m_filePath;     // m_srcDir + m_path
     
     char* m_mmFile; 
+    int m_mmFd;                 // 映射的文件保持打开，发送前检查页缓存和冷读取时使用
     struct stat m_mmFileStat;
 
+    bool m_hasContent;
+    std::string m_content;
+    std::string m_contentType;
+
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
@@ -37,9 +63,10 @@ private:
     void _Add_StateLine(Buffer &buff);
     void _Add_Header(Buffer &buff);
     void _Add_Content(Buffer &buff);
+    void _Add_Length(Buffer &buff, size_t len);
+    const char* _File_Path();
 
     void _Error_Html();
-    std::string _Get_FileType();
 
 };
 
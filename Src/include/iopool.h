@@ -0,0 +1,58 @@
+#ifndef _IOPOOL_H
+#define _IOPOOL_H
+
+#include "./define.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "./threadpool.h"
+
+class HttpConn;
+
+// 冷文件读取线程池: 要发送的文件页不在页缓存中时，由这里的线程把这段文件读进页缓存，
+// 工作线程不会在sendmsg里因为缺页等待磁盘; 读完后通过eventfd通知reactor，由reactor重新注册EPOLLOUT继续发送
+// 读取用提交时dup的fd，不访问连接和映射的内存，读取期间连接被关闭也没有关系
+class IoPool {
+public:
+    IoPool() = default;
+    ~IoPool() = default;
+
+    bool Init(int threads);
+    int Fd() const { return m_state ? m_state->eventFd : -1; }
+    bool Enabled() const { return m_pool != nullptr; }
+    // 等待已提交的读取完成，最多timeout，返回是否所有线程都已退出
+    bool Shutdown(std::chrono::milliseconds timeout) { return !m_pool || m_pool->Shutdown(timeout); }
+
+    // 工作线程: 把fd的[off, off+len)读进页缓存，完成后通知reactor恢复连接(gen用来识别连接是否已被复用)
+    // dup失败时返回false，调用者直接继续发送
+    bool Submit(int fd, off_t off, size_t len, HttpConn* client, uint64_t gen);
+    // reactor线程: eventfd可读时取出已完成的读取，对每个连接调用resume
+    void Drain(const std::function<void(HttpConn* client, uint64_t gen)>& resume);
+
+    static std::atomic<uint64_t> coldReads;    // 提交的冷读取次数
+    static std::atomic<uint64_t> coldBytes;    // 冷读取的字节数
+
+private:
+    struct Done {
+        HttpConn* client;
+        uint64_t gen;
+    };
+    // 读取任务和线程池共享的状态(线程池中的任务可能比IoPool活得久)
+    struct State {
+        std::mutex mtx;
+        std::vector<Done> done;
+        int eventFd = -1;
+        ~State() { if (eventFd >= 0) { close(eventFd); } }
+    };
+
+    static void _Read(int fd, off_t off, size_t len);
+
+    std::shared_ptr<State> m_state;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::vector<Done> m_ready;      // Drain时与done交换(保留容量)
+};
+
+#endif /* _IOPOOL_H */
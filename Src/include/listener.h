@@ -0,0 +1,50 @@
+#ifndef _LISTENER_H
+#define _LISTENER_H
+
+#include "./define.h"
+#include <string>
+#include <sys/un.h>
+
+class Config;
+
+// 一个监听地址，配置格式(server.conf 的 listen，可以有多个):
+//   8092                 所有地址的8092端口(IPv6双栈，系统不支持IPv6时退回IPv4)
+//   0.0.0.0:8092         IPv4
+//   [::1]:8092           IPv6
+//   unix:/run/lai.sock   Unix域套接字(同机的反向代理、sidecar使用，不经过TCP协议栈)
+// 后面可以跟选项覆盖[server]中的默认值: backlog=N defer_accept=N fastopen=N v6only=0|1 mode=0660
+class Listener {
+public:
+    Listener();
+
+    bool Parse(const std::string& spec, const Config& cfg);
+    bool Open(bool linger);
+    bool Adopt(int fd);             // 接管升级时旧进程交过来的监听套接字
+    bool Matches(int fd) const;     // fd是否绑定在本监听地址上
+    bool Update(const Listener& other);     // 热加载: 修改backlog和监听选项
+    void Close();
+    void Release_Path() { m_ownsPath = false; }    // 套接字文件已交给新进程，退出时不删除
+
+    int Fd() const { return m_fd; }
+    bool IsUnix() const { return m_addr.ss_family == AF_UNIX; }
+    const std::string& Spec() const { return m_spec; }
+    std::string Name() const;
+
+private:
+    void _Set_Opts() const;
+    bool _Bind_Unix();
+
+    std::string m_spec;
+    int m_fd;
+    struct sockaddr_storage m_addr;
+    socklen_t m_addrLen;
+    bool m_anyAddr;         // 只写了端口: 双栈或IPv4的任意地址都算匹配
+    int m_backlog;
+    int m_deferAccept;
+    int m_fastOpen;
+    int m_v6only;
+    int m_mode;             // Unix套接字文件权限, -1表示不修改
+    bool m_ownsPath;        // 本进程创建的套接字文件，关闭时删除
+};
+
+#endif /* _LISTENER_H */
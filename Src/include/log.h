@@ -0,0 +1,107 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include "./define.h"
+#include <stdarg.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+// 异步日志：每个线程一块无锁暂存区(单生产者单消费者环形缓冲)，
+// 后台写线程定期把所有暂存区交换出来，批量write()到按大小/日期滚动的文件中。
+// 暂存区写满时不阻塞，直接丢弃该行并计数。
+class Log {
+public:
+    enum LEVEL {
+        DEBUG = 0,
+        INFO,
+        WARN,
+        ERROR,
+    };
+
+    // 日志通道：服务日志和访问日志分文件写
+    enum CHANNEL {
+        SERVER = 0,
+        ACCESS,
+        CHANNEL_NUM,
+    };
+
+    static Log* Instance();
+
+    void Init(int level, const char* dir = "./logs",
+              size_t stagingSize = 64 * 1024,
+              size_t maxFileSize = 64 * 1024 * 1024);
+    void Close();
+    void Flush();
+
+    void Write(int level, const char* format, ...);
+    void Access(const char* format, ...);
+
+    bool IsOpen() const { return m_isOpen; }
+    int GetLevel() const { return m_level; }
+    void SetLevel(int level) { m_level = level; }
+    uint64_t DroppedLines() const { return m_dropped; }
+
+private:
+    Log();
+    ~Log();
+
+    struct Staging;
+    struct LocalStaging;
+    struct File {
+        int fd = -1;
+        int day = 0;
+        int index = 0;
+        size_t size = 0;
+        std::string batch;
+    };
+
+    Staging* _Local_Staging();
+    void _Release_Staging(Staging* staging);
+    void _Push(int channel, const char* line, size_t len);
+    void _VFormat(int channel, int level, const char* format, va_list args);
+    void _Writer_Loop();
+    void _Drain();
+    void _Flush_Batch(int channel);
+    void _Open_File(int channel, const struct tm& t);
+
+    std::atomic<bool> m_isOpen;
+    std::atomic<int> m_level;
+    std::atomic<uint64_t> m_dropped;
+
+    std::string m_dir;
+    size_t m_stagingSize;
+    size_t m_maxFileSize;
+    File m_files[CHANNEL_NUM];
+
+    std::mutex m_mtx;                                   // 只保护暂存区登记、归还和写线程等待
+    std::condition_variable m_cond;
+    std::vector<std::shared_ptr<Staging>> m_stagings;
+    std::unique_ptr<std::thread> m_writer;
+    std::atomic<bool> m_flushReq;
+};
+
+#define LOG_BASE(level, format, ...) \
+    do { \
+        Log* log = Log::Instance(); \
+        if (log->IsOpen() && log->GetLevel() <= level) { \
+            log->Write(level, format, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+#define LOG_DEBUG(format, ...) LOG_BASE(Log::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)  LOG_BASE(Log::INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)  LOG_BASE(Log::WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_BASE(Log::ERROR, format, ##__VA_ARGS__)
+
+#define LOG_ACCESS(format, ...) \
+    do { \
+        Log* log = Log::Instance(); \
+        if (log->IsOpen()) { log->Access(format, ##__VA_ARGS__); } \
+    } while(0)
+
+#endif /* _LOG_H */
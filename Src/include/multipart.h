@@ -0,0 +1,67 @@
+#ifndef _MULTIPART_H
+#define _MULTIPART_H
+
+#include "./define.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "./arena.h"
+#include "./slice.h"
+
+// multipart/form-data请求体(RFC 7578)的流式解析: 请求体片段到达时直接在读缓冲区中查找分隔符(Boyer-Moore-Horspool)，
+// 普通字段的值放进表单，文件部分从读缓冲区直接写进上传目录下的临时文件，结束时改成最终的文件名
+// 跨片段的分隔符只保留不超过分隔符长度的尾部，请求体不会整个放在内存里
+class Multipart {
+public:
+    // fields: 解析出的字段(文件字段的值为保存后的文件名)
+    Multipart(const std::string& boundary, FormMap* fields);
+    ~Multipart();
+
+    // 从Content-Type中取出boundary参数，不是multipart/form-data或没有boundary时返回false
+    static bool Boundary(Slice contentType, std::string* boundary);
+
+    // 处理一段请求体，出错返回false，Error()为响应状态码(400格式错误、413字段太大、500写文件失败)
+    bool Feed(const char* data, size_t len);
+    // 请求体结束时检查是否收到了结束分隔符
+    bool Finished() const { return m_state == DONE; }
+    int Error() const { return m_error; }
+
+    static std::string uploadDir;       // 上传文件的目录(restart)
+
+private:
+    enum STATE { PREAMBLE, AFTER_DELIM, HEADER, DATA, DONE };
+
+    size_t _Find(const char* data, size_t len) const;
+    size_t _Partial(const char* data, size_t len) const;
+    bool _Line(const char* data, size_t len);
+    bool _Header(const std::string& line);
+    bool _Begin_Part();
+    bool _Emit(const char* data, size_t len);
+    bool _End_Part();
+    void _Discard_File();
+    bool _Fail(int code);
+
+    std::string m_delim;        // "\r\n--" + boundary
+    size_t m_skip[256];         // BMH: 坏字符跳转表
+    FormMap* m_fields;
+
+    STATE m_state;
+    int m_error;
+    std::string m_carry;        // 上一段末尾可能是分隔符开头的字节
+    std::string m_line;         // 未完整的头部行
+    size_t m_headerBytes;
+    int m_parts;
+
+    std::string m_name;         // 当前部分的字段名
+    std::string m_filename;     // 客户端的文件名(只取扩展名)
+    bool m_isFile;
+    std::string m_value;        // 普通字段的值
+    int m_fd;                   // 文件部分的临时文件
+    std::string m_tmpPath;
+    std::vector<std::string> m_saved;   // 已保存的文件，请求没有完整收到时删除
+
+    static std::atomic<unsigned> m_seq;
+};
+
+#endif /* _MULTIPART_H */
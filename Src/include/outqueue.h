@@ -0,0 +1,85 @@
+#ifndef _OUTQUEUE_H
+#define _OUTQUEUE_H
+
+#include "./define.h"
+#include <vector>
+
+#include "./buffer.h"
+
+// 连接的输出队列: 按顺序排队的片段，一次sendmsg把尽量多的片段交给内核
+// 片段有三种: 输出buffer中的一段字节(响应头、生成的内容、HTTP/2帧)，映射的文件(队列负责释放映射和fd)，
+// 以及生命周期比队列长的共享数据(固定的429响应等，不拷贝)
+// 多个片段(一个响应的头和文件，或者流水线上的几个响应)在同一次sendmsg中发送; 一次发不完时带MSG_MORE，
+// 让内核把不足一个MSS的尾巴留到下一次调用再发，响应的最后一段不带MSG_MORE，立即发出
+class OutQueue {
+public:
+    // 片段发送后的冲刷策略
+    enum Policy {
+        FLUSH_BATCH,    // 可以和后面的片段合并成更大的报文
+        FLUSH_NOW,      // 发送到这里为止，不带MSG_MORE(100 Continue等客户端在等的中间响应)
+    };
+
+    explicit OutQueue(int buffSize = 1024);
+    ~OutQueue();
+    OutQueue(const OutQueue&) = delete;
+    OutQueue& operator=(const OutQueue&) = delete;
+
+    // 响应先写进暂存buffer，再用Push_Staged把新写入的字节作为一个片段排进队列
+    Buffer& Stage() { return m_buff; }
+    void Push_Staged(Policy flush = FLUSH_BATCH);
+    // 映射的文件: 发送完后munmap并关闭fd(检查文件页是否在页缓存中时用)
+    void Push_File(char* map, size_t len, int fd, Policy flush = FLUSH_BATCH);
+    // 不拷贝的数据，必须在发送完之前一直有效
+    void Push_Blob(const char* data, size_t len, Policy flush = FLUSH_BATCH);
+
+    // 发送队列头部的片段(一次sendmsg，limit大于0时最多发送limit字节)，返回发送的字节数;
+    // 出错返回-1并设置*saveErrno，队列为空时返回0
+    ssize_t Flush(int fd, int* saveErrno, size_t limit = 0);
+
+    // 接下来要发送的window字节中，文件部分是否有页不在页缓存中(发送时会缺页读磁盘)
+    // 是时返回true，*range为从第一个不在的页开始到window结束的文件范围
+    struct FileRange {
+        int fd;
+        off_t off;
+        size_t len;
+    };
+    bool Cold(size_t window, FileRange* range) const;
+
+    // TCP连接才使用MSG_MORE(Unix域套接字没有报文合并)
+    void SetCork(bool cork) { m_cork = cork; }
+
+    size_t Bytes() const { return m_bytes; }
+    bool Empty() const { return m_bytes == 0; }
+    // 丢弃所有片段(释放文件)，暂存buffer恢复为size
+    void Reset(size_t size);
+    void Clear();
+
+    static const int MAX_IOV = 64;     // 一次sendmsg最多的片段数
+    static const size_t MAX_PROBE_PAGES = 256;     // Cold一次最多检查的页数
+    static const size_t MIN_PROBE_LEN = 64 * 1024; // 小于它的文件不检查: 缺页最多读几页，每个小文件多一次mincore反而更贵
+
+private:
+    enum Type { BYTES, FILE, BLOB };
+    struct Segment {
+        Type type;
+        const char* data;   // FILE、BLOB: 尚未发送的部分; BYTES在暂存buffer中，按顺序取
+        size_t len;         // 尚未发送的字节数
+        char* map;          // FILE: 映射的起点和长度(munmap用)，文件的fd
+        size_t mapLen;
+        int fd;
+        Policy flush;
+    };
+
+    void _Push(Type type, const char* data, size_t len, char* map, size_t mapLen, int fd, Policy flush);
+    void _Consume(size_t len);
+    static void _Release(Segment& seg);
+
+    Buffer m_buff;
+    size_t m_staged;                // 暂存buffer中已排进队列的字节数
+    std::vector<Segment> m_segs;    // [m_head, size)是待发送的片段，发完后清空(保留容量)
+    size_t m_head;
+    size_t m_bytes;
+    bool m_cork;
+};
+
+#endif /* _OUTQUEUE_H */
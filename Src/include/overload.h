@@ -0,0 +1,42 @@
+#ifndef _OVERLOAD_H
+#define _OVERLOAD_H
+
+#include "./define.h"
+#include <atomic>
+
+// 过载控制(CoDel思路): 用任务在线程池队列中的等待时间(sojourn)衡量排队延迟
+// 一个interval内的最小等待时间都超过target，说明队列持续积压(而不是短暂突发)，进入过载状态;
+// 之后某个interval的最小等待时间回落到target以下(或没有任务)时退出过载
+// 过载期间: 暂停accept(连接留在内核队列)，排队超过target的请求直接回复503
+class Overload {
+public:
+    Overload();
+
+    void Init(int targetMs, int intervalMs);
+    bool Enabled() const { return m_targetNs.load(std::memory_order_relaxed) > 0; }
+
+    // 工作线程取出任务时调用
+    void Observe(uint64_t sojournNs, uint64_t nowNs);
+    // reactor每轮调用，没有任务出队时也能结束interval
+    void Tick(uint64_t nowNs);
+
+    bool IsOverloaded() const { return m_overloaded.load(std::memory_order_relaxed); }
+    bool ShouldShed(uint64_t sojournNs) const {
+        return IsOverloaded() && sojournNs > m_targetNs.load(std::memory_order_relaxed);
+    }
+    void CountShed() { m_shed.fetch_add(1, std::memory_order_relaxed); }
+
+    int IntervalMs() const { return static_cast<int>(m_intervalNs.load(std::memory_order_relaxed) / 1000000); }
+
+private:
+    void _Roll(uint64_t nowNs);
+
+    std::atomic<uint64_t> m_targetNs;       // 可热加载，工作线程并发读取
+    std::atomic<uint64_t> m_intervalNs;
+    std::atomic<uint64_t> m_intervalStart;
+    std::atomic<uint64_t> m_minSojourn;     // 本interval内的最小等待时间
+    std::atomic<bool> m_overloaded;
+    std::atomic<uint64_t> m_shed;           // 本次过载期间回复503的请求数
+};
+
+#endif /* _OVERLOAD_H */
@@ -0,0 +1,62 @@
+#ifndef _RATELIMIT_H
+#define _RATELIMIT_H
+
+#include "./define.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+class Config;
+
+// 按客户IP限速(令牌桶，IPv6按/64前缀计，Unix域套接字连接不限速): 新建连接速率、请求速率，以及按路径单独限速(如 /login.html)
+// 令牌桶用GCRA实现，每个桶只需保存"理论到达时间"(TAT)，访问时按当前时间惰性补充令牌:
+//   TAT' = max(TAT, now) + 间隔;  TAT' - now 超过 间隔 * 突发量 时拒绝
+// 桶存放在开放寻址表中，每个缓存行(64字节)放4个桶，键只在所属缓存行内查找，
+// 一次检查最多一次缓存未命中; 更新用CAS，不加锁
+// 缓存行放满后替换其中最久没有使用的桶(被替换的IP重新获得满桶，限速是近似的)
+class RateLimit {
+public:
+    RateLimit();
+    ~RateLimit();
+
+    void Init(const Config& cfg);
+    bool Enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // 新建连接(reactor线程)
+    bool Allow_Conn(const struct sockaddr* addr, uint64_t nowNs);
+    // 一个请求(工作线程): 路径匹配某条规则时按规则限速，否则按请求速率限速
+    bool Allow_Request(const struct sockaddr* addr, const char* path, size_t len, uint64_t nowNs);
+
+private:
+    struct Limit {
+        std::atomic<uint64_t> intervalNs;   // 补充一个令牌的间隔, 0表示不限
+        std::atomic<uint64_t> burst;
+        Limit() : intervalNs(0), burst(0) {}
+        void Set(double rate, int burst);
+    };
+    struct Rule {
+        std::string path;
+        Limit limit;
+    };
+    struct Slot {
+        std::atomic<uint64_t> key;          // 0表示空槽
+        std::atomic<uint64_t> tat;
+    };
+    struct alignas(64) Line {
+        Slot slots[4];
+    };
+
+    bool _Allow(uint64_t key, const Limit& limit, uint64_t nowNs);
+    Slot* _Find(uint64_t key);
+    static bool _Parse_Rule(const std::string& text, std::string* path, double* rate, int* burst);
+
+    std::atomic<bool> m_enabled;
+    Limit m_conn;
+    Limit m_req;
+    std::vector<Rule*> m_rules;             // 路径规则在第一次Init时确定，之后只更新速率
+
+    Line* m_lines;
+    size_t m_mask;
+};
+
+#endif /* _RATELIMIT_H */
@@ -0,0 +1,81 @@
+#ifndef _ROUTER_H
+#define _ROUTER_H
+
+#include "./define.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./slice.h"
+#include "./httprequest.h"
+
+// 路由参数: 名字指向路由表，值指向请求路径
+class RouteParams {
+public:
+    void Add(Slice name, Slice value) { m_list.push_back({ name, value }); }
+    void Pop() { m_list.pop_back(); }
+    void Clear() { m_list.clear(); }
+    // 没有这个参数时返回空
+    Slice Get(const char* name) const;
+
+private:
+    struct Param {
+        Slice name;
+        Slice value;
+    };
+    std::vector<Param> m_list;
+};
+
+// 处理函数的输出: 生成的内容，或者资源目录下的一个文件(按静态文件发送)
+struct Reply {
+    int code = 200;
+    std::string type = "text/plain";
+    std::string body;
+    std::string file;
+
+    void Json(std::string json) { type = "application/json"; body = std::move(json); }
+    void File(const std::string& path) { file = path; }
+};
+
+// 路由表: 启动时注册，Compile后只读(工作线程并发查找，不加锁)
+// 按路径段组织成树: 字面段(编译后排序，二分查找) > 参数段(:name) > 前缀挂载(*，匹配剩下的整个路径)
+// 没有匹配的路由时按静态文件处理
+class Router {
+public:
+    using Handler = std::function<void(const HttpRequest& request, const RouteParams& params, Reply* reply)>;
+
+    static Router* Instance();
+
+    // method为空表示任意方法(有同一路径的指定方法的路由时优先); 同一方法和路径重复注册返回false
+    bool Add(const std::string& method, const std::string& pattern, Handler handler);
+    void Compile();
+
+    // 查找处理函数，没有匹配返回nullptr; 路径匹配但方法不匹配时*wrongMethod为true
+    const Handler* Match(const std::string& method, const std::string& path, RouteParams* params, bool* wrongMethod) const;
+    // 按请求查找并执行处理函数，没有路由时返回false(静态文件); 方法不匹配时回复405
+    bool Route(const HttpRequest& request, Reply* reply) const;
+
+    // 常用的处理函数: 发送资源目录下的文件
+    static Handler File(const std::string& path);
+
+private:
+    Router() : m_compiled(false) {}
+
+    struct Node {
+        std::string segment;                        // 字面段
+        std::vector<std::unique_ptr<Node>> literals;
+        std::unique_ptr<Node> param;
+        std::string paramName;
+        std::unique_ptr<Node> wildcard;
+        std::vector<std::pair<std::string, Handler>> handlers;     // 方法 -> 处理函数
+    };
+
+    const Node* _Match(const Node* node, const char* p, const char* end, RouteParams* params) const;
+    static void _Compile(Node* node);
+
+    Node m_root;
+    bool m_compiled;
+};
+
+#endif /* _ROUTER_H */
@@ -0,0 +1,40 @@
+#ifndef _SLICE_H
+#define _SLICE_H
+
+#include "./define.h"
+#include <string>
+
+// 指向别处(请求buffer、路由表)的一段字符，不拥有数据; 使用期间原数据不能被修改或释放
+struct Slice {
+    const char* data;
+    size_t len;
+
+    Slice() : data(""), len(0) {}
+    Slice(const char* d, size_t n) : data(d), len(n) {}
+    Slice(const std::string& s) : data(s.data()), len(s.size()) {}
+
+    bool empty() const { return len == 0; }
+    std::string ToString() const { return std::string(data, len); }
+
+    bool operator==(const Slice& other) const {
+        return len == other.len && memcmp(data, other.data, len) == 0;
+    }
+    bool operator!=(const Slice& other) const { return !(*this == other); }
+    bool operator<(const Slice& other) const {
+        int ret = memcmp(data, other.data, len < other.len ? len : other.len);
+        return ret < 0 || (ret == 0 && len < other.len);
+    }
+    // 忽略ASCII大小写比较(HTTP头部名字、方法外的令牌)
+    bool EqualsNoCase(const Slice& other) const {
+        if (len != other.len) { return false; }
+        for (size_t i = 0; i < len; i++) {
+            char a = data[i], b = other.data[i];
+            if (a >= 'A' && a <= 'Z') { a += 'a' - 'A'; }
+            if (b >= 'A' && b <= 'Z') { b += 'a' - 'A'; }
+            if (a != b) { return false; }
+        }
+        return true;
+    }
+};
+
+#endif /* _SLICE_H */
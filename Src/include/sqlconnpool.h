@@ -5,6 +5,7 @@
 #include <mysql/mysql.h>
 #include <string>
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <semaphore.h>
 #include <thread>
@@ -21,6 +22,10 @@ public:
               const char* user,const char* pwd, 
               const char* dbName, int connSize);
     void ClosePool();
+    // 调整大小(不阻塞): 返回需要新建的连接数，由调用者在后台线程调用Grow建立
+    int Resize(int connSize);
+    void Grow(int count);
+    int GetMaxConn();
 
 private:
     SqlConnPool();
@@ -29,6 +34,15 @@ private:
     int MAX_CONN;
     int m_useCount;
     int m_freeCount;
+    int m_shrink;       // 缩容时还需要关闭的连接数(等连接归还时关闭)
+    int m_target;       // Resize设置的目标大小
+    int m_pending;      // 正在后台建立的连接数
+
+    std::string m_host;
+    int m_port;
+    std::string m_user;
+    std::string m_pwd;
+    std::string m_dbName;
 
     std::queue<MYSQL *> m_connQue;
     std::mutex m_mtx;
@@ -5,42 +5,106 @@
 #include <condition_variable>
 #include <queue>
 #include <thread>
+#include <vector>
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <chrono>
+#include <assert.h>
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): m_pool(std::make_shared<Pool>()) {
+    // threadInit: 每个线程启动时先调用(参数为线程序号)，用于绑定CPU等
+    explicit ThreadPool(size_t threadCount = 8, std::function<void(size_t)> threadInit = nullptr)
+        : m_pool(std::make_shared<Pool>()) {
         assert(threadCount > 0);
-        for(size_t i = 0; i < threadCount; i++) {
-            std::thread([pool = m_pool] {
+        m_pool->threadInit = std::move(threadInit);
+        Resize(threadCount);
+    }
+
+    ThreadPool() = default;
+
+    ThreadPool(ThreadPool&&) = default;
+    
+    // 执行完已有任务后等待所有线程退出(join)，之后任务引用的对象才可以析构
+    ~ThreadPool() {
+        if(static_cast<bool>(m_pool)) {
+            {
+                std::lock_guard<std::mutex> locker(m_pool->mtx);
+                m_pool->isClosed = true;
+            }
+            m_pool->cond.notify_all();
+        }
+        for(auto& t : m_threads) { t.join(); }
+    }
+
+    // 调整线程数: 扩容直接创建新线程，缩容时多余的线程在空闲时自行退出(下次调整时join)
+    // 只能在拥有线程池的线程中调用(与Shutdown、析构相同)
+    void Resize(size_t threadCount) {
+        assert(threadCount > 0);
+        size_t spawn = 0;
+        size_t first = 0;
+        {
+            std::lock_guard<std::mutex> locker(m_pool->mtx);
+            _Reap();
+            m_pool->target = threadCount;
+            if(threadCount > m_pool->workers) {
+                first = m_pool->workers;
+                spawn = threadCount - m_pool->workers;
+                m_pool->workers = threadCount;
+            }
+        }
+        if(spawn == 0) {
+            m_pool->cond.notify_all();
+        }
+        for(size_t i = 0; i < spawn; i++) {
+            m_threads.emplace_back([pool = m_pool, index = first + i] {
+                if(pool->threadInit) { pool->threadInit(index); }
                 std::unique_lock<std::mutex> locker(pool->mtx);
                 while(true) {
-                    if(!pool->tasks.empty()) {
+                    if(pool->workers > pool->target) {
+                        pool->workers--;
+                        pool->exitedIds.push_back(std::this_thread::get_id());
+                        pool->exited.notify_all();
+                        break;
+                    }
+                    else if(!pool->tasks.empty()) {
                         auto task = std::move(pool->tasks.front());
                         pool->tasks.pop();
                         locker.unlock();
                         task();
                         locker.lock();
                     } 
-                    else if(pool->isClosed) break;
+                    else if(pool->isClosed) {
+                        pool->workers--;
+                        pool->exited.notify_all();
+                        break;
+                    }
                     else pool->cond.wait(locker);
                 }
-            }).detach();
+            });
         }
     }
 
-    ThreadPool() = default;
-
-    ThreadPool(ThreadPool&&) = default;
-    
-    ~ThreadPool() {
-        if(static_cast<bool>(m_pool)) {
-            {
-                std::lock_guard<std::mutex> locker(m_pool->mtx);
-                m_pool->isClosed = true;
-            }
+    // 关闭线程池: 执行完已有任务后线程退出，最多等待timeout，返回是否所有线程都已退出(已退出时join)
+    // 超时返回false，析构时仍会join，调用者应先让执行中的任务尽快结束
+    bool Shutdown(std::chrono::milliseconds timeout) {
+        {
+            std::unique_lock<std::mutex> locker(m_pool->mtx);
+            m_pool->isClosed = true;
             m_pool->cond.notify_all();
+            if(!m_pool->exited.wait_for(locker, timeout, [this] { return m_pool->workers == 0; })) {
+                return false;
+            }
         }
+        for(auto& t : m_threads) { t.join(); }
+        m_threads.clear();
+        return true;
+    }
+
+    size_t ThreadCount() {
+        std::lock_guard<std::mutex> locker(m_pool->mtx);
+        return m_pool->target;
     }
 
     template<class F>
@@ -53,13 +117,32 @@ public:
     }
 
 private:
+    // 回收缩容时已经退出的线程(调用时持有锁)
+    void _Reap() {
+        for(auto& id : m_pool->exitedIds) {
+            auto it = std::find_if(m_threads.begin(), m_threads.end(),
+                                   [&id](const std::thread& t) { return t.get_id() == id; });
+            if(it != m_threads.end()) {
+                it->join();
+                m_threads.erase(it);
+            }
+        }
+        m_pool->exitedIds.clear();
+    }
+
     struct Pool {
         std::mutex mtx;
         std::condition_variable cond;
+        std::condition_variable exited;     // 线程退出时通知(Shutdown等待)
         bool isClosed;
+        size_t workers;     // 当前线程数
+        size_t target;      // 期望线程数
         std::queue<std::function<void()>> tasks;
+        std::function<void(size_t)> threadInit;
+        std::vector<std::thread::id> exitedIds;     // 缩容退出、尚未join的线程
     };
     std::shared_ptr<Pool> m_pool;
+    std::vector<std::thread> m_threads;
 };
 
 
@@ -0,0 +1,75 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "./define.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+// 请求级追踪：按 1/N 采样请求，在关键阶段记录时间片段(span)
+// 每个线程一个定长环形缓冲，写满后覆盖最旧的记录；收到 SIGUSR2 时导出为 Chrome trace-event JSON
+// (chrome://tracing 或 ui.perfetto.dev 打开)
+class Trace {
+public:
+    static Trace* Instance();
+
+    void Init(int sampleRate, size_t ringSize = 8192);
+    bool Enabled() const { return m_sampleRate > 0; }
+
+    // 为一个新请求做采样决定，返回非0的追踪id表示本请求被采样
+    uint64_t Sample();
+
+    void Span(uint64_t id, const char* name, uint64_t beginNs, uint64_t endNs, int64_t arg = 0);
+    void Instant(uint64_t id, const char* name, uint64_t ts, int64_t arg = 0);
+
+    bool Dump(const char* path);
+
+    static uint64_t NowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+private:
+    Trace();
+    ~Trace() = default;
+
+    struct Event {
+        const char* name;   // 只保存字符串字面量指针
+        uint64_t id;
+        uint64_t ts;
+        uint64_t dur;
+        int64_t arg;
+        char ph;            // 'X' 时间片段, 'i' 瞬时事件
+    };
+    struct Ring;
+
+    Ring* _Local_Ring();
+    void _Push(const Event& ev);
+
+    std::atomic<int> m_sampleRate;
+    std::atomic<uint64_t> m_counter;
+    size_t m_ringSize;
+    std::mutex m_mtx;                           // 只保护环形缓冲登记
+    std::vector<std::shared_ptr<Ring>> m_rings;
+};
+
+// 作用域内的时间片段，id为0(未采样)时什么也不做
+class TraceSpan {
+public:
+    TraceSpan(uint64_t id, const char* name, int64_t arg = 0)
+        : m_id(id), m_name(name), m_arg(arg), m_begin(id ? Trace::NowNs() : 0) {}
+    ~TraceSpan() {
+        if (m_id) { Trace::Instance()->Span(m_id, m_name, m_begin, Trace::NowNs(), m_arg); }
+    }
+    void SetArg(int64_t arg) { m_arg = arg; }
+
+private:
+    uint64_t m_id;
+    const char* m_name;
+    int64_t m_arg;
+    uint64_t m_begin;
+};
+
+#endif /* _TRACE_H */
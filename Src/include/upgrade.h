@@ -0,0 +1,27 @@
+#ifndef _UPGRADE_H
+#define _UPGRADE_H
+
+#include "./define.h"
+#include <string>
+#include <vector>
+
+// 不停机升级: 旧进程fork+exec新的可执行文件，通过Unix套接字(SCM_RIGHTS)把监听套接字交给新进程
+// 1. 旧进程收到SIGUSR1: Spawn() 启动新进程，Send_Fds() 发送监听套接字
+// 2. 新进程: Inherited_Fd() 得到与旧进程通信的套接字，Recv_Fds() 取得监听套接字，
+//    预热资源文件后 Notify_Ready() 通知旧进程
+// 3. 旧进程收到就绪通知后停止accept，处理完已有连接后退出
+class Upgrade {
+public:
+    static const char* ENV_FD;
+
+    static int Spawn(const std::vector<std::string>& args, pid_t* pid);
+    static int Inherited_Fd();
+
+    static bool Send_Fds(int sock, const std::vector<int>& fds);
+    static bool Recv_Fds(int sock, std::vector<int>* fds);
+
+    static bool Notify_Ready(int sock);
+    static size_t Warm_Files(const std::string& dir);
+};
+
+#endif /* _UPGRADE_H */
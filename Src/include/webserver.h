@@ -2,7 +2,9 @@
 #define _WEBSERVER_H
 
 #include "./define.h"
+#include "./config.h"
 #include <unordered_map>
+#include <list>
 #include <memory>
 
 #include "../include/httpconn.h"
@@ -10,50 +12,108 @@
 #include "../include/epoller.h"
 #include "../include/heaptimer.h"
 #include "../include/threadpool.h"
+#include "../include/log.h"
+#include "../include/trace.h"
+#include "../include/upgrade.h"
+#include "../include/overload.h"
+#include "../include/affinity.h"
+#include "../include/ratelimit.h"
+#include "../include/acl.h"
+#include "../include/listener.h"
+#include "../include/websocket.h"
+#include "../include/router.h"
+#include <chrono>
+#include <atomic>
+#include <sys/signalfd.h>
+#include <signal.h>
 
 class WebServer {
 public:
-    WebServer(int port, int trigMode, int timeout, int OptLinger,int threadNum, int connPoolNum,
-              int sqlPort, const char* sqlUser, const  char* sqlPwd, const char* dbName);
+    explicit WebServer(const Config& cfg);
 
     ~WebServer();
     void Run();
 
 private:
-    int m_port;
     int m_openLinger;
     int m_timeout;
     bool m_isClose;
-    int m_listenFd;
+    std::vector<Listener> m_listeners;  // 监听套接字(TCP端口、Unix域套接字)，排空后关闭
+    int m_signalFd;
+    int m_upgradeFd;        // 升级时与另一个进程通信的Unix套接字
+    pid_t m_upgradePid;
+    std::chrono::steady_clock::time_point m_drainDeadline;     // 排空(升级或退出)的截止时间
+    bool m_acceptPaused;    // 过载时暂停accept
+    int m_maxConn;          // 连接数上限
+    int m_evictWater;       // 超过这个连接数时淘汰空闲连接
+    Overload m_overload;
+    RateLimit m_rateLimit;
+    Acl m_acl;
+    Broadcaster m_hub;      // WebSocket订阅者(要在m_users之前构造、之后析构)
+    std::chrono::steady_clock::time_point m_nextStats;     // 下次广播服务器状态的时刻
+    uint64_t m_wakeNs;      // 本轮epoll_wait返回的时刻(追踪用)
     char* m_srcDir;
     
     uint32_t m_listenEvent;
     uint32_t m_connEvent;
 
+    Config m_cfg;           // 当前生效的配置(SIGHUP时与重新读取的配置比较)
+
   
     std::unique_ptr<HeapTimer> m_timer;
-    std::unique_ptr<ThreadPool> m_threadpool;
     std::unique_ptr<Epoller> m_epoller;
     std::unordered_map<int, HttpConn> m_users;
+    std::list<HttpConn*> m_lru;     // 按最近活动时间排序的连接(头部最久)，只由reactor线程访问
+    std::vector<int> m_batchClosed; // 处理本轮epoll事件时reactor关闭的连接fd
+    // 线程池在连接和epoll之后声明: 先析构(join线程)，任务访问的对象析构时已没有线程在运行
+    IoPool m_ioPool;        // 冷文件读取线程池
+    std::unique_ptr<ThreadPool> m_threadpool;
 
 
     static const int MAX_FD = 65536;
-    static int SetFdNonblock(int fd);
 
-    bool _Init_Socket(); 
+    static bool _Parse_Listeners(const Config& cfg, std::vector<Listener>* listeners);
+    bool _Init_Listeners(const std::vector<int>& inherited);
+    Listener* _Find_Listener(int fd);
+    bool _Init_Signal();
     void _Init_EventMode(int trigMode);
-    void _Add_Client(int fd, sockaddr_in addr);
+    void _Init_ConnLimit(const Config& cfg);
+    void _Init_Threads(const Config& cfg);
+    void _Init_Routes();
+    void _Add_Client(int fd, const sockaddr_storage& addr);
   
-    void _Deal_Listen();
+    void _Deal_Listen(Listener* listener);
+    void _Deal_Signal();
+    void _Reload_Config();
+    void _Start_Upgrade();
+    void _Deal_Upgrade();
+    void _Start_Drain(const char* reason);
+    bool _Check_Drain();
+    void _Shutdown_Conns();
+    [[noreturn]] void _Exit_Now(const char* what);
     void _Deal_Write(HttpConn* client);
     void _Deal_Read(HttpConn* client);
+    void _Deal_Ws(HttpConn* client);
+    void _Deal_Hub();
+    void _Deal_Io();
+    void _Publish_Stats();
+    std::string _Stats_Json();
+    void _Arm_Ws(HttpConn* client);
 
     void _Send_Error(int fd, const char*info);
     void _Extent_Time(HttpConn* client);
     void _Close_Conn(HttpConn* client);
+    void _Close_Idle(HttpConn* client);
+    void _Rearm(HttpConn* client, uint32_t events);
+    void _Touch(HttpConn* client);
+    void _Evict_Idle(int target);
+
+    uint64_t _Dequeued(uint64_t id, uint64_t enqueueNs);
+    void _Update_Admission();
 
-    void _Thread_Read(HttpConn* client);
+    void _Thread_Read(HttpConn* client, uint64_t sojournNs);
     void _Thread_Write(HttpConn* client);
+    void _Thread_Ws(HttpConn* client);
 
     void _On_Process(HttpConn* client);
 
@@ -0,0 +1,110 @@
+#ifndef _WEBSOCKET_H
+#define _WEBSOCKET_H
+
+#include "./define.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./buffer.h"
+#include "./httprequest.h"
+
+class HttpConn;
+
+// WebSocket(RFC 6455)连接: HTTP/1.1请求带 Upgrade: websocket 且路径为配置的路径时，回复101后切换到这里
+// 输入: 解析客户端的帧(必须带掩码，SIMD去掩码)，支持分片、ping/pong和关闭握手
+// 输出: 一个帧队列，元素是共享的只读帧(广播时一条消息只编码一次，所有订阅者的队列引用同一份数据)
+//
+// 与reactor的配合(EPOLLONESHOT): reactor分发事件前SetBusy()，工作线程处理完调用Release()重新注册事件;
+// 广播由reactor线程放进队列，连接不忙时由reactor注册EPOLLOUT，忙时由工作线程Release时注册
+class WebSocket {
+public:
+    enum { CONTINUATION = 0x0, TEXT = 0x1, BINARY = 0x2, CLOSE = 0x8, PING = 0x9, PONG = 0xa };
+
+    WebSocket();
+    ~WebSocket() = default;
+
+    // 握手: 回复101和Sec-WebSocket-Accept
+    static void Handshake(const HttpRequest& request, Buffer& out);
+    // 服务器发出的帧(不带掩码)
+    static std::shared_ptr<const std::string> Frame(int opcode, const char* data, size_t len);
+    static std::shared_ptr<const std::string> Close_Frame(uint16_t code);
+    // 按4字节掩码异或，AVX2/SSE2一次处理32/16字节
+    static void Unmask(uint8_t* data, size_t len, const uint8_t key[4]);
+    static bool Valid_Utf8(const uint8_t* data, size_t len);
+
+    // 工作线程: 处理输入buffer中完整的帧
+    void Process(Buffer& in);
+    // 工作线程: 发送队列中的帧直到发完或EAGAIN，出错返回-1
+    ssize_t Write(int fd, int* saveErrno);
+    // 加入一帧(广播，reactor线程)，返回true表示连接空闲、调用方需要注册EPOLLOUT
+    // 关闭帧之后不再接受新帧; 积压超过上限的消息丢弃(慢客户端只会少收几条，不会占满内存)
+    bool Push(const std::shared_ptr<const std::string>& frame, bool close = false);
+
+    void SetBusy();
+    // 处理完一次事件: 在锁内用arm(是否需要EPOLLOUT)重新注册，保证广播不会丢失唤醒
+    void Release(const std::function<void(bool out)>& arm);
+    // 关闭握手完成(或协议错误)且发送完，可以关闭TCP连接
+    bool Finished();
+
+    static std::string path;                // 握手路径(restart)
+    static std::atomic<int> maxMessage;     // 单条消息上限(字节)，超过时以1009关闭
+    static std::atomic<int> maxQueue;       // 每个连接积压的广播数据上限(字节)
+
+private:
+    enum { OPEN, CLOSING, CLOSED };     // CLOSING: 已发送关闭帧，等待对端的关闭帧
+
+    void _Enqueue(const std::shared_ptr<const std::string>& frame);
+    void _Fail(uint16_t code);
+    void _On_Close(const uint8_t* payload, size_t len);
+    void _On_Message(int opcode, const uint8_t* data, size_t len);
+
+    std::mutex m_mtx;       // 保护发送队列、状态和忙标记
+    std::deque<std::shared_ptr<const std::string>> m_queue;
+    size_t m_offset;        // 队首的帧已发送的字节数
+    size_t m_queued;        // 队列中未发送的字节数
+    bool m_busy;
+    bool m_outArmed;        // 已经为新数据注册过EPOLLOUT
+    int m_state;
+    size_t m_dropped;
+
+    int m_fragOpcode;       // 正在接收的分片消息的类型, 0表示没有
+    std::string m_message;
+};
+
+// 广播: 订阅连接的集合和待发布的消息; 可以在任意线程发布，reactor线程通过eventfd唤醒后分发
+class Broadcaster {
+public:
+    Broadcaster();
+    ~Broadcaster();
+
+    bool Init();
+    int Fd() const { return m_eventFd; }
+
+    void Subscribe(HttpConn* conn);
+    void Unsubscribe(HttpConn* conn);
+    size_t Subscribers() const { return m_count.load(std::memory_order_relaxed); }
+
+    // 任意线程: 消息编码成一个帧，之后由所有订阅者共享
+    void Publish(const std::string& text);
+    // reactor线程: 给所有订阅者发送关闭帧(排空)
+    void Close_All(uint16_t code, const std::function<void(HttpConn*)>& arm);
+    // reactor线程: 把待发布的帧放进订阅者的队列，对需要注册EPOLLOUT的连接调用arm
+    // arm在锁内调用: 连接关闭前先退订(同一把锁)，保证arm时连接的fd还没有关闭或被复用
+    void Flush(const std::function<void(HttpConn*)>& arm);
+
+private:
+    std::mutex m_mtx;
+    std::vector<HttpConn*> m_subs;
+    std::unordered_map<HttpConn*, size_t> m_index;      // 连接在m_subs中的位置(删除时与末尾交换)
+    std::vector<std::shared_ptr<const std::string>> m_outbox;
+    std::atomic<size_t> m_count;
+    int m_eventFd;
+};
+
+#endif /* _WEBSOCKET_H */
@@ -0,0 +1,319 @@
+#include "../include/listener.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include <sstream>
+#include <stddef.h>
+#include <netinet/tcp.h>
+using namespace std;
+
+Listener::Listener()
+    : m_fd(-1), m_addrLen(0), m_anyAddr(false), m_backlog(0), m_deferAccept(0),
+      m_fastOpen(0), m_v6only(0), m_mode(-1), m_ownsPath(false) {
+    memset(&m_addr, 0, sizeof(m_addr));
+}
+
+static bool Parse_Port(const string& text, int* port) {
+    char* end = nullptr;
+    long val = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || val < 1 || val > 65535) { return false; }
+    *port = static_cast<int>(val);
+    return true;
+}
+
+bool Listener::Parse(const string& spec, const Config& cfg) {
+    m_spec = spec;
+    m_backlog = cfg.m_backlog;
+    m_deferAccept = cfg.m_deferAccept;
+    m_fastOpen = cfg.m_fastOpen;
+    m_v6only = 0;
+    m_mode = -1;
+    m_anyAddr = false;
+    memset(&m_addr, 0, sizeof(m_addr));
+
+    istringstream in(spec);
+    string addr, opt;
+    if (!(in >> addr)) { return false; }
+    while (in >> opt) {
+        size_t eq = opt.find('=');
+        if (eq == string::npos) { return false; }
+        string key = opt.substr(0, eq);
+        const char* value = opt.c_str() + eq + 1;
+        if (key == "backlog") { m_backlog = atoi(value); }
+        else if (key == "defer_accept") { m_deferAccept = atoi(value); }
+        else if (key == "fastopen") { m_fastOpen = atoi(value); }
+        else if (key == "v6only") { m_v6only = atoi(value) ? 1 : 0; }
+        else if (key == "mode") { m_mode = static_cast<int>(strtol(value, nullptr, 8)); }
+        else { return false; }
+    }
+
+    if (addr.compare(0, 5, "unix:") == 0) {
+        // "@name" 表示抽象命名空间(不在文件系统中创建文件)
+        string path = addr.substr(5);
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&m_addr);
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) { return false; }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.data(), path.size());
+        m_addrLen = static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + path.size());
+        if (path[0] == '@') {
+            un->sun_path[0] = '\0';
+        } else {
+            m_addrLen += 1;
+        }
+        return true;
+    }
+
+    int port = 0;
+    size_t colon = addr.rfind(':');
+    if (addr[0] == '[') {
+        size_t close = addr.find(']');
+        struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&m_addr);
+        if (close == string::npos || close + 1 != colon || !Parse_Port(addr.substr(colon + 1), &port) ||
+            inet_pton(AF_INET6, addr.substr(1, close - 1).c_str(), &in6->sin6_addr) != 1) {
+            return false;
+        }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        m_addrLen = sizeof(*in6);
+    } else if (colon != string::npos) {
+        struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&m_addr);
+        if (!Parse_Port(addr.substr(colon + 1), &port) ||
+            inet_pton(AF_INET, addr.substr(0, colon).c_str(), &in4->sin_addr) != 1) {
+            return false;
+        }
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        m_addrLen = sizeof(*in4);
+    } else {
+        // 只有端口: IPv6任意地址(双栈)
+        struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&m_addr);
+        if (!Parse_Port(addr, &port)) { return false; }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        in6->sin6_addr = in6addr_any;
+        m_addrLen = sizeof(*in6);
+        m_anyAddr = true;
+    }
+    return true;
+}
+
+string Listener::Name() const {
+    char buf[INET6_ADDRSTRLEN] = {0};
+    if (m_addr.ss_family == AF_UNIX) {
+        const struct sockaddr_un* un = reinterpret_cast<const struct sockaddr_un*>(&m_addr);
+        size_t len = m_addrLen - offsetof(struct sockaddr_un, sun_path);
+        if (un->sun_path[0] == '\0') { return "unix:@" + string(un->sun_path + 1, len - 1); }
+        return "unix:" + string(un->sun_path);
+    }
+    if (m_addr.ss_family == AF_INET) {
+        const struct sockaddr_in* in4 = reinterpret_cast<const struct sockaddr_in*>(&m_addr);
+        inet_ntop(AF_INET, &in4->sin_addr, buf, sizeof(buf));
+        return string(buf) + ":" + to_string(ntohs(in4->sin_port));
+    }
+    const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&m_addr);
+    inet_ntop(AF_INET6, &in6->sin6_addr, buf, sizeof(buf));
+    return "[" + string(buf) + "]:" + to_string(ntohs(in6->sin6_port));
+}
+
+// 套接字文件已存在时，能连上说明还有进程在使用；连不上则是上次异常退出留下的，删除后重新bind
+bool Listener::_Bind_Unix() {
+    const struct sockaddr_un* un = reinterpret_cast<const struct sockaddr_un*>(&m_addr);
+    if (bind(m_fd, (const struct sockaddr*)&m_addr, m_addrLen) == 0) {
+        m_ownsPath = (un->sun_path[0] != '\0');
+        return true;
+    }
+    struct stat st;
+    if (errno != EADDRINUSE || un->sun_path[0] == '\0' ||
+        stat(un->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+        return false;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool alive = (probe >= 0 && (connect(probe, (const struct sockaddr*)&m_addr, m_addrLen) == 0 || errno != ECONNREFUSED));
+    if (probe >= 0) { close(probe); }
+    if (alive) {
+        errno = EADDRINUSE;
+        return false;
+    }
+    LOG_WARN("%s: remove stale socket file", Name().c_str());
+    unlink(un->sun_path);
+    if (bind(m_fd, (const struct sockaddr*)&m_addr, m_addrLen) < 0) { return false; }
+    m_ownsPath = true;
+    return true;
+}
+
+bool Listener::Open(bool linger) {
+    m_fd = socket(m_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0 && m_anyAddr && errno == EAFNOSUPPORT) {
+        // 系统不支持IPv6: 退回IPv4任意地址
+        in_port_t port = reinterpret_cast<struct sockaddr_in6*>(&m_addr)->sin6_port;
+        memset(&m_addr, 0, sizeof(m_addr));
+        struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&m_addr);
+        in4->sin_family = AF_INET;
+        in4->sin_port = port;
+        in4->sin_addr.s_addr = htonl(INADDR_ANY);
+        m_addrLen = sizeof(*in4);
+        m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (m_fd < 0) {
+        LOG_ERROR("%s: socket error: %s", Name().c_str(), strerror(errno));
+        return false;
+    }
+
+    struct linger optLinger = {0};
+    if (linger) {
+        // 优雅关闭: 直到所剩数据发送完毕或超时
+        optLinger.l_onoff = 1;
+        optLinger.l_linger = 1;
+    }
+    bool ok = (setsockopt(m_fd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)) == 0);
+    if (ok && !IsUnix()) {
+        // 端口复用
+        int val = 1;
+        ok = (setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) == 0);
+    }
+    if (ok && m_addr.ss_family == AF_INET6) {
+        ok = (setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &m_v6only, sizeof(m_v6only)) == 0);
+    }
+    if (!ok) {
+        LOG_ERROR("%s: setsockopt error: %s", Name().c_str(), strerror(errno));
+        Close();
+        return false;
+    }
+    ok = IsUnix() ? _Bind_Unix() : (bind(m_fd, (const struct sockaddr*)&m_addr, m_addrLen) == 0);
+    if (!ok) {
+        LOG_ERROR("%s: bind error: %s", Name().c_str(), strerror(errno));
+        Close();
+        return false;
+    }
+    if (IsUnix() && m_mode >= 0 && m_ownsPath) {
+        const struct sockaddr_un* un = reinterpret_cast<const struct sockaddr_un*>(&m_addr);
+        if (chmod(un->sun_path, static_cast<mode_t>(m_mode)) < 0) {
+            LOG_WARN("%s: chmod error: %s", Name().c_str(), strerror(errno));
+        }
+    }
+    _Set_Opts();
+    if (listen(m_fd, m_backlog) < 0) {
+        LOG_ERROR("%s: listen error: %s", Name().c_str(), strerror(errno));
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool Listener::Adopt(int fd) {
+    int accepting = 0;
+    socklen_t len = sizeof(accepting);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) < 0 || !accepting) {
+        LOG_ERROR("inherited fd %d is not a listening socket!", fd);
+        return false;
+    }
+    m_fd = fd;
+    // 以实际绑定的地址为准(只写端口时，旧进程可能退回了IPv4)
+    struct sockaddr_storage addr;
+    socklen_t addrLen = sizeof(addr);
+    if (!IsUnix() && getsockname(fd, (struct sockaddr*)&addr, &addrLen) == 0) {
+        m_addr = addr;
+        m_addrLen = addrLen;
+    }
+    // 旧版本可能没有以SOCK_NONBLOCK创建监听套接字
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL, 0) | O_NONBLOCK);
+    // 新版本的监听选项以本进程的配置为准
+    _Set_Opts();
+    if (listen(m_fd, m_backlog) < 0) {
+        LOG_ERROR("%s: listen error: %s", Name().c_str(), strerror(errno));
+        m_fd = -1;
+        return false;
+    }
+    // 套接字文件改由本进程负责删除
+    m_ownsPath = IsUnix() && reinterpret_cast<const struct sockaddr_un*>(&m_addr)->sun_path[0] != '\0';
+    return true;
+}
+
+bool Listener::Matches(int fd) const {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr*)&addr, &len) < 0) { return false; }
+    if (addr.ss_family == AF_UNIX || m_addr.ss_family == AF_UNIX) {
+        return addr.ss_family == m_addr.ss_family && len == m_addrLen &&
+               memcmp(&addr, &m_addr, len) == 0;
+    }
+    const struct sockaddr_in* a4 = reinterpret_cast<const struct sockaddr_in*>(&addr);
+    const struct sockaddr_in6* a6 = reinterpret_cast<const struct sockaddr_in6*>(&addr);
+    in_port_t port = addr.ss_family == AF_INET ? a4->sin_port : a6->sin6_port;
+    if (m_anyAddr) {
+        in_port_t want = reinterpret_cast<const struct sockaddr_in6*>(&m_addr)->sin6_port;
+        if (m_addr.ss_family == AF_INET) { want = reinterpret_cast<const struct sockaddr_in*>(&m_addr)->sin_port; }
+        bool any = addr.ss_family == AF_INET ? a4->sin_addr.s_addr == htonl(INADDR_ANY)
+                                             : IN6_IS_ADDR_UNSPECIFIED(&a6->sin6_addr);
+        return any && port == want;
+    }
+    if (addr.ss_family != m_addr.ss_family) { return false; }
+    if (addr.ss_family == AF_INET) {
+        const struct sockaddr_in* m4 = reinterpret_cast<const struct sockaddr_in*>(&m_addr);
+        return port == m4->sin_port && a4->sin_addr.s_addr == m4->sin_addr.s_addr;
+    }
+    const struct sockaddr_in6* m6 = reinterpret_cast<const struct sockaddr_in6*>(&m_addr);
+    return port == m6->sin6_port && memcmp(&a6->sin6_addr, &m6->sin6_addr, sizeof(m6->sin6_addr)) == 0;
+}
+
+// 对监听套接字再次listen只修改backlog
+bool Listener::Update(const Listener& other) {
+    bool changed = false;
+    if (other.m_backlog != m_backlog && other.m_backlog > 0 && listen(m_fd, other.m_backlog) == 0) {
+        LOG_INFO("reload: %s backlog %d -> %d", Name().c_str(), m_backlog, other.m_backlog);
+        m_backlog = other.m_backlog;
+        changed = true;
+    }
+    if (other.m_deferAccept != m_deferAccept || other.m_fastOpen != m_fastOpen) {
+        m_deferAccept = other.m_deferAccept;
+        m_fastOpen = other.m_fastOpen;
+        _Set_Opts();
+        LOG_INFO("reload: %s defer_accept %d, fastopen %d", Name().c_str(), m_deferAccept, m_fastOpen);
+        changed = true;
+    }
+    return changed;
+}
+
+// 监听套接字选项(TCP):
+// TCP_DEFER_ACCEPT: 连接收到数据(请求)后才放进全连接队列，空连接不占用描述符和reactor唤醒
+// TCP_FASTOPEN: 允许客户端在SYN中携带请求数据，省去一个RTT
+// TCP_NODELAY: 接收的连接继承这个选项; 响应由输出队列整批交给内核(需要合并时带MSG_MORE)，
+//              不需要Nagle再攒数据，最后一段立即发出，不等客户端的ACK
+void Listener::_Set_Opts() const {
+    if (!IsUnix()) {
+        int on = 1;
+        if (setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+            LOG_WARN("%s: setsockopt TCP_NODELAY error: %s", Name().c_str(), strerror(errno));
+        }
+        int defer = m_deferAccept > 0 ? m_deferAccept : 0;
+        if (setsockopt(m_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer)) < 0) {
+            LOG_WARN("%s: setsockopt TCP_DEFER_ACCEPT error: %s", Name().c_str(), strerror(errno));
+        }
+        if (m_fastOpen > 0) {
+            int qlen = m_fastOpen;
+            if (setsockopt(m_fd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) < 0) {
+                LOG_WARN("%s: setsockopt TCP_FASTOPEN error: %s", Name().c_str(), strerror(errno));
+            }
+        }
+    }
+    // backlog 会被内核截断到 net.core.somaxconn
+    FILE* fp = fopen("/proc/sys/net/core/somaxconn", "r");
+    int somaxconn = 0;
+    if (fp) {
+        if (fscanf(fp, "%d", &somaxconn) != 1) { somaxconn = 0; }
+        fclose(fp);
+    }
+    if (somaxconn > 0 && m_backlog > somaxconn) {
+        LOG_WARN("%s: backlog %d is capped by net.core.somaxconn=%d", Name().c_str(), m_backlog, somaxconn);
+    }
+}
+
+void Listener::Close() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (m_ownsPath) {
+        unlink(reinterpret_cast<const struct sockaddr_un*>(&m_addr)->sun_path);
+        m_ownsPath = false;
+    }
+}
@@ -0,0 +1,572 @@
+// loadgen: 多线程 + epoll 的 HTTP 压测工具(替代 webbench)
+// 1. 每个线程一个 epoll, 管理若干个非阻塞长连接(也可以每个请求重新连接)
+// 2. 支持管线化深度(每个连接同时在途的请求数)
+// 3. 支持 GET 和 POST(内置 /login.html, /register.html 请求体)
+// 4. 固定速率(开环)模式: 延迟从"计划发送时刻"开始计，避免协调遗漏(coordinated omission)
+// 5. 输出 p50/p90/p99/p99.9 等延迟分位数
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+// 对数线性直方图: 每个2的幂区间再分64个子桶, 相对误差 < 1.6%
+class Histogram {
+public:
+    static const int SUB_BITS = 6;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = SUB_COUNT + (64 - SUB_BITS) * SUB_COUNT;
+
+    Histogram() : m_counts(BUCKETS, 0), m_total(0), m_sum(0), m_max(0) {}
+
+    void Record(uint64_t v) {
+        m_counts[_Index(v)]++;
+        m_total++;
+        m_sum += v;
+        m_max = max(m_max, v);
+    }
+
+    void Merge(const Histogram& h) {
+        for (int i = 0; i < BUCKETS; i++) { m_counts[i] += h.m_counts[i]; }
+        m_total += h.m_total;
+        m_sum += h.m_sum;
+        m_max = max(m_max, h.m_max);
+    }
+
+    uint64_t Percentile(double p) const {
+        if (m_total == 0) { return 0; }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * m_total + 0.5);
+        if (rank < 1) { rank = 1; }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += m_counts[i];
+            if (seen >= rank) { return min(_Value(i), m_max); }
+        }
+        return m_max;
+    }
+
+    uint64_t Total() const { return m_total; }
+    uint64_t Max() const { return m_max; }
+    double Mean() const { return m_total ? static_cast<double>(m_sum) / m_total : 0; }
+
+private:
+    static int _Index(uint64_t v) {
+        if (v < SUB_COUNT) { return static_cast<int>(v); }
+        int e = 63 - __builtin_clzll(v);
+        int sub = static_cast<int>((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+        return SUB_COUNT + (e - SUB_BITS) * SUB_COUNT + sub;
+    }
+    // 桶的上界
+    static uint64_t _Value(int idx) {
+        if (idx < SUB_COUNT) { return idx; }
+        int e = (idx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+        uint64_t sub = (idx - SUB_COUNT) % SUB_COUNT;
+        return ((SUB_COUNT + sub + 1) << (e - SUB_BITS)) - 1;
+    }
+
+    vector<uint64_t> m_counts;
+    uint64_t m_total;
+    uint64_t m_sum;
+    uint64_t m_max;
+};
+
+struct Options {
+    string host = "127.0.0.1";
+    int port = 8092;
+    int threads = 2;
+    int connections = 64;
+    int duration = 10;
+    int pipeline = 1;
+    bool keepAlive = true;
+    double rate = 0;            // 总请求速率(req/s), 0 表示闭环压测
+    string workload = "static";
+    vector<string> paths;
+    string method = "GET";
+    string body;
+    bool json = false;
+};
+
+static Options g_opt;
+static vector<string> g_requests;   // 预先拼好的请求报文，按顺序轮流发送
+static sockaddr_in g_addr;
+
+static uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static string BuildRequest(const string& method, const string& path, const string& body) {
+    string req = method + " " + path + " HTTP/1.1\r\n";
+    req += "Host: " + g_opt.host + ":" + to_string(g_opt.port) + "\r\n";
+    req += g_opt.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    req += "User-Agent: loadgen\r\n";
+    if (method == "POST") {
+        req += "Content-Type: application/x-www-form-urlencoded\r\n";
+        req += "Content-Length: " + to_string(body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    req += body;
+    return req;
+}
+
+// 内置工作负载: static 静态页面, login 登录, register 注册, mix 三者按 8:1:1 混合
+static bool BuildWorkload() {
+    static const char* STATIC_PAGES[] = {
+        "/", "/index.html", "/picture.html", "/video.html", "/welcome.html",
+        "/login.html", "/register.html", "/404-not-found.html" };
+    vector<string> statics, logins, registers;
+    for (const char* page : STATIC_PAGES) {
+        statics.push_back(BuildRequest("GET", page, ""));
+    }
+    for (int i = 0; i < 64; i++) {
+        logins.push_back(BuildRequest("POST", "/login.html",
+            "username=user" + to_string(i) + "&password=pass" + to_string(i)));
+        registers.push_back(BuildRequest("POST", "/register.html",
+            "username=lg" + to_string(getpid()) + "_" + to_string(i) + "&password=pass" + to_string(i)));
+    }
+
+    if (!g_opt.paths.empty()) {
+        for (auto& path : g_opt.paths) {
+            g_requests.push_back(BuildRequest(g_opt.method, path, g_opt.body));
+        }
+    } else if (g_opt.workload == "static") {
+        g_requests = statics;
+    } else if (g_opt.workload == "login") {
+        g_requests = logins;
+    } else if (g_opt.workload == "register") {
+        g_requests = registers;
+    } else if (g_opt.workload == "mix") {
+        for (int i = 0; i < 64; i++) {
+            for (int j = 0; j < 8; j++) {
+                g_requests.push_back(statics[(i * 8 + j) % statics.size()]);
+            }
+            g_requests.push_back(logins[i]);
+            g_requests.push_back(registers[i]);
+        }
+    } else {
+        fprintf(stderr, "unknown workload: %s\n", g_opt.workload.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct Conn {
+    int fd = -1;
+    uint32_t gen = 0;           // 槽位复用代数，丢弃旧连接残留的事件
+    bool connected = false;
+    string out;
+    size_t outOff = 0;
+    string in;
+    size_t inOff = 0;
+    deque<uint64_t> inflight;   // 在途请求的计划发送时刻
+    size_t sent = 0;            // 本连接已发出的请求数(非长连接时只发一个)
+};
+
+struct Stats {
+    Histogram latency;          // 微秒
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t non2xx = 0;
+    uint64_t connectErrors = 0;
+    uint64_t ioErrors = 0;
+    uint64_t dropped = 0;       // 开环模式下压测结束时仍未发出的请求
+};
+
+class Worker {
+public:
+    Worker(int id, int conns, double rate, uint64_t endNs)
+        : m_id(id), m_conns(conns), m_rate(rate), m_endNs(endNs), m_next(0), m_rr(0) {}
+
+    void Run();
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    void _Connect(size_t idx);
+    void _Close(Conn& c, bool reconnect);
+    void _Send(Conn& c, uint64_t intended);
+    void _Flush(Conn& c);
+    void _Read(Conn& c);
+    bool _Parse_Response(Conn& c);
+    void _Fill(Conn& c);
+    void _Dispatch_Pending();
+    bool _Can_Send(const Conn& c) const;
+
+    int m_id;
+    int m_epfd;
+    int m_conns;
+    double m_rate;
+    uint64_t m_endNs;
+    uint64_t m_next;
+    size_t m_rr;
+    size_t m_reqIdx = 0;
+    vector<Conn> m_pool;
+    deque<uint64_t> m_pending;      // 开环模式下已到发送时刻但还没有空闲连接的请求
+    Stats m_stats;
+};
+
+void Worker::_Connect(size_t idx) {
+    Conn& c = m_pool[idx];
+    uint32_t gen = c.gen + 1;
+    c = Conn();
+    c.gen = gen;
+    c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c.fd < 0) {
+        m_stats.connectErrors++;
+        return;
+    }
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret = connect(c.fd, (sockaddr*)&g_addr, sizeof(g_addr));
+    if (ret < 0 && errno != EINPROGRESS) {
+        m_stats.connectErrors++;
+        close(c.fd);
+        c.fd = -1;
+        return;
+    }
+    c.connected = (ret == 0);
+    epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = (static_cast<uint64_t>(idx) << 32) | gen;
+    epoll_ctl(m_epfd, EPOLL_CTL_ADD, c.fd, &ev);
+}
+
+void Worker::_Close(Conn& c, bool reconnect) {
+    if (c.fd >= 0) {
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+    }
+    // 开环模式下，未完成的请求回到待发队列，延迟继续从原计划时刻计算
+    if (m_rate > 0) {
+        for (auto it = c.inflight.rbegin(); it != c.inflight.rend(); ++it) {
+            m_pending.push_front(*it);
+        }
+    }
+    uint32_t gen = c.gen;
+    c = Conn();
+    c.gen = gen;
+    if (reconnect && NowNs() < m_endNs) {
+        _Connect(&c - m_pool.data());
+    }
+}
+
+bool Worker::_Can_Send(const Conn& c) const {
+    if (c.fd < 0 || !c.connected) { return false; }
+    if (!g_opt.keepAlive) { return c.sent == 0; }
+    return static_cast<int>(c.inflight.size()) < g_opt.pipeline;
+}
+
+void Worker::_Send(Conn& c, uint64_t intended) {
+    const string& req = g_requests[m_reqIdx++ % g_requests.size()];
+    c.out.append(req);
+    c.inflight.push_back(intended);
+    c.sent++;
+}
+
+void Worker::_Flush(Conn& c) {
+    while (c.outOff < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.outOff, c.out.size() - c.outOff, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { return; }
+            if (errno == EINTR) { continue; }
+            m_stats.ioErrors++;
+            _Close(c, true);
+            return;
+        }
+        c.outOff += n;
+    }
+    c.out.clear();
+    c.outOff = 0;
+}
+
+// 闭环模式: 把连接的管线填满
+void Worker::_Fill(Conn& c) {
+    if (m_rate > 0) { return; }
+    while (_Can_Send(c) && NowNs() < m_endNs) {
+        _Send(c, NowNs());
+    }
+    _Flush(c);
+}
+
+// 开环模式: 把到期的请求分给有空位的连接
+void Worker::_Dispatch_Pending() {
+    size_t n = m_pool.size();
+    while (!m_pending.empty()) {
+        size_t tried = 0;
+        while (tried < n && !_Can_Send(m_pool[m_rr % n])) {
+            m_rr++;
+            tried++;
+        }
+        if (tried == n) { return; }
+        Conn& c = m_pool[m_rr++ % n];
+        _Send(c, m_pending.front());
+        m_pending.pop_front();
+        _Flush(c);
+    }
+}
+
+// 解析一个完整响应: 状态行 + 头部(取 Content-Length) + 响应体
+bool Worker::_Parse_Response(Conn& c) {
+    const char* begin = c.in.data() + c.inOff;
+    size_t avail = c.in.size() - c.inOff;
+    const char* hdrEnd = static_cast<const char*>(memmem(begin, avail, "\r\n\r\n", 4));
+    if (!hdrEnd) { return false; }
+    size_t hdrLen = hdrEnd - begin + 4;
+    long contentLen = 0;
+    bool closeConn = false;
+    int status = 0;
+    if (avail > 12 && strncmp(begin, "HTTP/1.", 7) == 0) {
+        status = atoi(begin + 9);
+    }
+    const char* line = static_cast<const char*>(memchr(begin, '\n', hdrLen));
+    while (line && line < hdrEnd) {
+        line++;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLen = atol(line + 15);
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char* v = line + 11;
+            while (*v == ' ') { v++; }
+            closeConn = (strncasecmp(v, "close", 5) == 0);
+        }
+        line = static_cast<const char*>(memchr(line, '\n', hdrEnd + 2 - line));
+    }
+    if (avail < hdrLen + contentLen) { return false; }
+
+    uint64_t now = NowNs();
+    if (!c.inflight.empty()) {
+        if (now <= m_endNs) {
+            m_stats.latency.Record((now - c.inflight.front()) / 1000);
+            m_stats.completed++;
+            m_stats.bytes += hdrLen + contentLen;
+            if (status < 200 || status >= 300) { m_stats.non2xx++; }
+        }
+        c.inflight.pop_front();
+    }
+    c.inOff += hdrLen + contentLen;
+    if (c.inOff == c.in.size()) {
+        c.in.clear();
+        c.inOff = 0;
+    }
+    if (closeConn || !g_opt.keepAlive) {
+        _Close(c, true);
+        return false;
+    }
+    return true;
+}
+
+void Worker::_Read(Conn& c) {
+    char buf[65536];
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            c.in.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+        if (n < 0 && errno == EINTR) { continue; }
+        // 对端关闭或出错: 先把已收齐的响应处理完
+        uint32_t gen = c.gen;
+        while (_Parse_Response(c)) {}
+        if (c.fd >= 0 && c.gen == gen) {
+            if (!c.inflight.empty()) { m_stats.ioErrors++; }
+            _Close(c, true);
+        }
+        return;
+    }
+    while (c.fd >= 0 && _Parse_Response(c)) {}
+    if (c.fd >= 0) { _Fill(c); }
+}
+
+void Worker::Run() {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    m_pool.resize(m_conns);
+    for (size_t i = 0; i < m_pool.size(); i++) { _Connect(i); }
+
+    // 开环模式: 每个线程按 rate/threads 的速率均匀产生请求，起始相位错开
+    double intervalNs = m_rate > 0 ? 1e9 / m_rate : 0;
+    m_next = NowNs() + static_cast<uint64_t>(intervalNs * m_id / max(1, g_opt.threads));
+
+    vector<epoll_event> events(1024);
+    while (true) {
+        uint64_t now = NowNs();
+        if (now >= m_endNs) { break; }
+        int timeout = 100;
+        if (m_rate > 0) {
+            while (m_next <= now) {
+                m_pending.push_back(m_next);
+                m_next += static_cast<uint64_t>(intervalNs);
+            }
+            _Dispatch_Pending();
+            timeout = static_cast<int>((m_next - now) / 1000000);
+        }
+        timeout = min<int>(timeout, (m_endNs - now) / 1000000 + 1);
+        int n = epoll_wait(m_epfd, events.data(), events.size(), timeout);
+        for (int i = 0; i < n; i++) {
+            Conn& c = m_pool[events[i].data.u64 >> 32];
+            uint32_t ev = events[i].events;
+            if (c.fd < 0 || c.gen != static_cast<uint32_t>(events[i].data.u64)) { continue; }
+            if (!c.connected && (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0 || (ev & EPOLLERR)) {
+                    m_stats.connectErrors++;
+                    _Close(c, false);
+                    continue;
+                }
+                c.connected = true;
+                _Fill(c);
+            }
+            if (c.fd >= 0 && (ev & EPOLLOUT)) { _Flush(c); }
+            if (c.fd >= 0 && (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) { _Read(c); }
+        }
+        // 连接失败的槽位稍后重连
+        for (size_t i = 0; i < m_pool.size(); i++) {
+            if (m_pool[i].fd < 0) { _Connect(i); }
+        }
+    }
+    m_stats.dropped = m_pending.size();
+    for (auto& c : m_pool) {
+        if (c.fd >= 0) { close(c.fd); }
+    }
+    close(m_epfd);
+}
+
+static void Usage() {
+    fprintf(stderr,
+        "loadgen [option]... [host:port]\n"
+        "  -c <n>      Total connections. Default 64.\n"
+        "  -t <n>      Worker threads. Default 2.\n"
+        "  -d <sec>    Duration in seconds. Default 10.\n"
+        "  -P <n>      Pipeline depth per connection. Default 1.\n"
+        "  -n          No keep-alive, one request per connection.\n"
+        "  -R <rps>    Fixed total request rate (open loop). Default 0 = closed loop.\n"
+        "  -w <name>   Workload: static | login | register | mix. Default static.\n"
+        "  -u <path>   Request path (repeatable), overrides -w.\n"
+        "  -X <method> Method used with -u. Default GET.\n"
+        "  -b <body>   Request body used with -u (form urlencoded).\n"
+        "  -j          Print one JSON result line instead of text.\n");
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:P:nR:w:u:X:b:jh?")) != -1) {
+        switch (opt) {
+            case 'c': g_opt.connections = atoi(optarg); break;
+            case 't': g_opt.threads = atoi(optarg); break;
+            case 'd': g_opt.duration = atoi(optarg); break;
+            case 'P': g_opt.pipeline = max(1, atoi(optarg)); break;
+            case 'n': g_opt.keepAlive = false; break;
+            case 'R': g_opt.rate = atof(optarg); break;
+            case 'w': g_opt.workload = optarg; break;
+            case 'u': g_opt.paths.push_back(optarg); break;
+            case 'X': g_opt.method = optarg; break;
+            case 'b': g_opt.body = optarg; break;
+            case 'j': g_opt.json = true; break;
+            default: Usage(); return 2;
+        }
+    }
+    if (optind < argc) {
+        string target = argv[optind];
+        size_t colon = target.rfind(':');
+        if (colon != string::npos) {
+            g_opt.port = atoi(target.c_str() + colon + 1);
+            target = target.substr(0, colon);
+        }
+        if (!target.empty()) { g_opt.host = target; }
+    }
+    if (g_opt.threads < 1 || g_opt.connections < g_opt.threads || g_opt.duration < 1) {
+        Usage();
+        return 2;
+    }
+
+    addrinfo hints = {0}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(g_opt.host.c_str(), nullptr, &hints, &res) != 0 || !res) {
+        fprintf(stderr, "cannot resolve %s\n", g_opt.host.c_str());
+        return 1;
+    }
+    g_addr = *reinterpret_cast<sockaddr_in*>(res->ai_addr);
+    g_addr.sin_port = htons(g_opt.port);
+    freeaddrinfo(res);
+
+    if (!BuildWorkload()) { return 2; }
+
+    uint64_t start = NowNs();
+    uint64_t end = start + static_cast<uint64_t>(g_opt.duration) * 1000000000ull;
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    for (int i = 0; i < g_opt.threads; i++) {
+        int conns = g_opt.connections / g_opt.threads + (i < g_opt.connections % g_opt.threads);
+        workers.emplace_back(new Worker(i, conns, g_opt.rate / g_opt.threads, end));
+    }
+    for (auto& w : workers) {
+        threads.emplace_back(&Worker::Run, w.get());
+    }
+    for (auto& t : threads) { t.join(); }
+    double secs = (min(NowNs(), end) - start) / 1e9;
+
+    Stats total;
+    for (auto& w : workers) {
+        const Stats& s = w->GetStats();
+        total.latency.Merge(s.latency);
+        total.completed += s.completed;
+        total.bytes += s.bytes;
+        total.non2xx += s.non2xx;
+        total.connectErrors += s.connectErrors;
+        total.ioErrors += s.ioErrors;
+        total.dropped += s.dropped;
+    }
+
+    const Histogram& h = total.latency;
+    if (g_opt.json) {
+        printf("{\"requests\":%llu,\"seconds\":%.3f,\"rps\":%.1f,\"mbps\":%.3f,"
+               "\"non2xx\":%llu,\"connect_errors\":%llu,\"io_errors\":%llu,\"dropped\":%llu,"
+               "\"lat_us\":{\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}}\n",
+               (unsigned long long)total.completed, secs, total.completed / secs,
+               total.bytes / secs / 1048576.0,
+               (unsigned long long)total.non2xx, (unsigned long long)total.connectErrors,
+               (unsigned long long)total.ioErrors, (unsigned long long)total.dropped,
+               h.Mean(), (unsigned long long)h.Percentile(50), (unsigned long long)h.Percentile(90),
+               (unsigned long long)h.Percentile(99), (unsigned long long)h.Percentile(99.9),
+               (unsigned long long)h.Max());
+        return 0;
+    }
+    printf("loadgen %s:%d, %d threads, %d connections, pipeline %d, %s, %s\n",
+           g_opt.host.c_str(), g_opt.port, g_opt.threads, g_opt.connections, g_opt.pipeline,
+           g_opt.keepAlive ? "keep-alive" : "close",
+           g_opt.rate > 0 ? ("open loop " + to_string((long)g_opt.rate) + " req/s").c_str() : "closed loop");
+    printf("Requests: %llu in %.2fs, non-2xx: %llu, connect errors: %llu, io errors: %llu, unsent: %llu\n",
+           (unsigned long long)total.completed, secs, (unsigned long long)total.non2xx,
+           (unsigned long long)total.connectErrors, (unsigned long long)total.ioErrors,
+           (unsigned long long)total.dropped);
+    printf("Requests/sec: %.1f\n", total.completed / secs);
+    printf("Transfer/sec: %.2f MB\n", total.bytes / secs / 1048576.0);
+    printf("Latency(us): mean %.1f, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, p99.99 %llu, max %llu\n",
+           h.Mean(), (unsigned long long)h.Percentile(50), (unsigned long long)h.Percentile(90),
+           (unsigned long long)h.Percentile(99), (unsigned long long)h.Percentile(99.9),
+           (unsigned long long)h.Percentile(99.99), (unsigned long long)h.Max());
+    return 0;
+}
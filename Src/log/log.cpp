@@ -0,0 +1,259 @@
+#include "../include/log.h"
+#include <sys/time.h>
+using namespace std;
+
+// 线程暂存区：单生产者(所属线程)单消费者(写线程)环形缓冲
+// 每条记录 = 4字节头(高8位通道, 低24位长度) + 日志行
+struct Log::Staging {
+    explicit Staging(size_t size) : buf(size), head(0), tail(0), owned(true) {}
+    vector<char> buf;
+    atomic<size_t> head;    // 生产者写位置(单调递增)
+    atomic<size_t> tail;    // 消费者读位置(单调递增)
+    bool owned;             // 有线程在使用(m_mtx保护); 线程退出后归还，由新线程复用
+};
+
+// 线程退出时归还暂存区(线程池缩容、冷读取线程等不会让暂存区越来越多)
+struct Log::LocalStaging {
+    Staging* staging = nullptr;
+    ~LocalStaging() {
+        if (staging) { Log::Instance()->_Release_Staging(staging); }
+    }
+};
+
+static const size_t LINE_MAX_LEN = 2048;
+static const char* LEVEL_TAG[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+static const char* CHANNEL_NAME[] = { "server", "access" };
+
+Log::Log() : m_isOpen(false), m_level(Log::INFO), m_dropped(0),
+    m_stagingSize(0), m_maxFileSize(0), m_flushReq(false) {}
+
+Log::~Log() {
+    Close();
+}
+
+Log* Log::Instance() {
+    static Log log;
+    return &log;
+}
+
+void Log::Init(int level, const char* dir, size_t stagingSize, size_t maxFileSize) {
+    assert(dir && stagingSize > 0);
+    if (m_isOpen) { return; }
+    // 暂存区大小取2的幂，方便取模
+    size_t size = 1024;
+    while (size < stagingSize) { size <<= 1; }
+    m_stagingSize = size;
+    m_maxFileSize = maxFileSize;
+    m_level = level;
+    m_dir = dir;
+    mkdir(m_dir.c_str(), 0777);
+
+    m_isOpen = true;
+    m_writer.reset(new thread(&Log::_Writer_Loop, this));
+}
+
+// 关闭日志：写线程把剩余暂存数据写完后退出
+void Log::Close() {
+    if (!m_isOpen) { return; }
+    {
+        lock_guard<mutex> locker(m_mtx);
+        m_isOpen = false;
+    }
+    m_cond.notify_one();
+    if (m_writer && m_writer->joinable()) {
+        m_writer->join();
+    }
+    m_writer.reset();
+    for (int i = 0; i < CHANNEL_NUM; i++) {
+        if (m_files[i].fd >= 0) {
+            close(m_files[i].fd);
+            m_files[i].fd = -1;
+        }
+    }
+}
+
+// 请求写线程尽快落盘(不等待)
+void Log::Flush() {
+    m_flushReq = true;
+    m_cond.notify_one();
+}
+
+// 得到本线程的暂存区，第一次使用时优先复用已退出线程归还的，没有时新建并登记到写线程
+// 复用的暂存区中还没写出的日志照常由写线程取走，生产者在锁内交接，从原来的写位置继续
+Log::Staging* Log::_Local_Staging() {
+    thread_local LocalStaging local;
+    if (!local.staging) {
+        lock_guard<mutex> locker(m_mtx);
+        for (auto& staging : m_stagings) {
+            if (!staging->owned) {
+                staging->owned = true;
+                local.staging = staging.get();
+                return local.staging;
+            }
+        }
+        m_stagings.push_back(make_shared<Staging>(m_stagingSize));
+        local.staging = m_stagings.back().get();
+    }
+    return local.staging;
+}
+
+void Log::_Release_Staging(Staging* staging) {
+    lock_guard<mutex> locker(m_mtx);
+    staging->owned = false;
+}
+
+// 把一行日志放进本线程暂存区，空间不够则丢弃计数，从不阻塞
+void Log::_Push(int channel, const char* line, size_t len) {
+    Staging* st = _Local_Staging();
+    const size_t cap = st->buf.size();
+    const size_t need = 4 + len;
+    size_t h = st->head.load(memory_order_relaxed);
+    size_t t = st->tail.load(memory_order_acquire);
+    if (cap - (h - t) < need) {
+        m_dropped++;
+        return;
+    }
+    uint32_t header = (static_cast<uint32_t>(channel) << 24) | static_cast<uint32_t>(len);
+    const char* parts[2] = { reinterpret_cast<const char*>(&header), line };
+    size_t lens[2] = { 4, len };
+    for (int i = 0; i < 2; i++) {
+        size_t pos = h & (cap - 1);
+        size_t first = min(lens[i], cap - pos);
+        memcpy(&st->buf[pos], parts[i], first);
+        memcpy(&st->buf[0], parts[i] + first, lens[i] - first);
+        h += lens[i];
+    }
+    st->head.store(h, memory_order_release);
+    // 暂存区过半时唤醒写线程
+    if (h - t > cap / 2) {
+        m_cond.notify_one();
+    }
+}
+
+void Log::_VFormat(int channel, int level, const char* format, va_list args) {
+    // 每个线程缓存秒级时间前缀，同一秒内只格式化微秒部分
+    thread_local time_t lastSec = 0;
+    thread_local char secStr[32] = {0};
+    char line[LINE_MAX_LEN];
+
+    struct timeval now = {0, 0};
+    gettimeofday(&now, nullptr);
+    if (now.tv_sec != lastSec) {
+        struct tm t;
+        localtime_r(&now.tv_sec, &t);
+        strftime(secStr, sizeof(secStr), "%Y-%m-%d %H:%M:%S", &t);
+        lastSec = now.tv_sec;
+    }
+    int n = snprintf(line, sizeof(line), "%s.%06ld %s", secStr, (long)now.tv_usec,
+                     channel == SERVER ? LEVEL_TAG[level] : "");
+    int m = vsnprintf(line + n, sizeof(line) - n - 1, format, args);
+    if (m < 0) { return; }
+    size_t len = min(static_cast<size_t>(n + m), sizeof(line) - 2);
+    line[len++] = '\n';
+    _Push(channel, line, len);
+}
+
+void Log::Write(int level, const char* format, ...) {
+    if (level < DEBUG || level > ERROR) { level = INFO; }
+    va_list args;
+    va_start(args, format);
+    _VFormat(SERVER, level, format, args);
+    va_end(args);
+}
+
+void Log::Access(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    _VFormat(ACCESS, INFO, format, args);
+    va_end(args);
+}
+
+// 写线程：定时或被唤醒时收集所有暂存区，按通道批量写文件
+void Log::_Writer_Loop() {
+    unique_lock<mutex> locker(m_mtx);
+    while (m_isOpen) {
+        m_cond.wait_for(locker, chrono::milliseconds(100));
+        locker.unlock();
+        _Drain();
+        locker.lock();
+    }
+    locker.unlock();
+    _Drain();
+}
+
+void Log::_Drain() {
+    vector<shared_ptr<Staging>> stagings;
+    {
+        lock_guard<mutex> locker(m_mtx);
+        stagings = m_stagings;
+    }
+    for (auto& st : stagings) {
+        const size_t cap = st->buf.size();
+        size_t t = st->tail.load(memory_order_relaxed);
+        size_t h = st->head.load(memory_order_acquire);
+        while (t < h) {
+            uint32_t header;
+            char* dst = reinterpret_cast<char*>(&header);
+            for (size_t i = 0; i < 4; i++) { dst[i] = st->buf[(t + i) & (cap - 1)]; }
+            t += 4;
+            int channel = header >> 24;
+            size_t len = header & 0xffffff;
+            string& batch = m_files[channel < CHANNEL_NUM ? channel : SERVER].batch;
+            size_t pos = t & (cap - 1);
+            size_t first = min(len, cap - pos);
+            batch.append(&st->buf[pos], first);
+            batch.append(&st->buf[0], len - first);
+            t += len;
+        }
+        st->tail.store(t, memory_order_release);
+    }
+    for (int i = 0; i < CHANNEL_NUM; i++) {
+        _Flush_Batch(i);
+    }
+    m_flushReq = false;
+}
+
+// 打开(或滚动到)新的日志文件: dir/server_2022_01_01.log, dir/server_2022_01_01-1.log ...
+void Log::_Open_File(int channel, const struct tm& t) {
+    File& f = m_files[channel];
+    int day = (t.tm_year + 1900) * 10000 + (t.tm_mon + 1) * 100 + t.tm_mday;
+    if (f.day != day) {
+        f.day = day;
+        f.index = 0;
+    } else {
+        f.index++;
+    }
+    char name[512];
+    if (f.index == 0) {
+        snprintf(name, sizeof(name), "%s/%s_%d.log", m_dir.c_str(), CHANNEL_NAME[channel], day);
+    } else {
+        snprintf(name, sizeof(name), "%s/%s_%d-%d.log", m_dir.c_str(), CHANNEL_NAME[channel], day, f.index);
+    }
+    if (f.fd >= 0) { close(f.fd); }
+    f.fd = open(name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    f.size = (f.fd >= 0 && fstat(f.fd, &st) == 0) ? st.st_size : 0;
+}
+
+void Log::_Flush_Batch(int channel) {
+    File& f = m_files[channel];
+    if (f.batch.empty()) { return; }
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+    int day = (t.tm_year + 1900) * 10000 + (t.tm_mon + 1) * 100 + t.tm_mday;
+    if (f.fd < 0 || f.day != day || (m_maxFileSize > 0 && f.size + f.batch.size() > m_maxFileSize && f.size > 0)) {
+        _Open_File(channel, t);
+    }
+    size_t off = 0;
+    while (f.fd >= 0 && off < f.batch.size()) {
+        ssize_t len = ::write(f.fd, f.batch.data() + off, f.batch.size() - off);
+        if (len < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        off += len;
+    }
+    f.size += off;
+    f.batch.clear();
+}
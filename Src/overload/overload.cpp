@@ -0,0 +1,46 @@
+#include "../include/overload.h"
+#include "../include/log.h"
+using namespace std;
+
+static const uint64_t NO_SAMPLE = UINT64_MAX;
+
+Overload::Overload()
+    : m_targetNs(0), m_intervalNs(0), m_intervalStart(0),
+      m_minSojourn(NO_SAMPLE), m_overloaded(false), m_shed(0) {}
+
+// targetMs为0时关闭过载控制
+void Overload::Init(int targetMs, int intervalMs) {
+    m_targetNs = targetMs > 0 ? static_cast<uint64_t>(targetMs) * 1000000 : 0;
+    m_intervalNs = static_cast<uint64_t>(intervalMs > 0 ? intervalMs : 100) * 1000000;
+    if (!Enabled()) { m_overloaded = false; }
+}
+
+void Overload::Observe(uint64_t sojournNs, uint64_t nowNs) {
+    if (!Enabled()) { return; }
+    uint64_t cur = m_minSojourn.load(memory_order_relaxed);
+    while (sojournNs < cur && !m_minSojourn.compare_exchange_weak(cur, sojournNs, memory_order_relaxed)) {}
+    _Roll(nowNs);
+}
+
+void Overload::Tick(uint64_t nowNs) {
+    if (!Enabled()) { return; }
+    _Roll(nowNs);
+}
+
+// interval结束: 由抢到结束权的线程根据最小等待时间更新过载状态
+void Overload::_Roll(uint64_t nowNs) {
+    uint64_t start = m_intervalStart.load(memory_order_relaxed);
+    if (nowNs - start < m_intervalNs.load(memory_order_relaxed)) { return; }
+    if (!m_intervalStart.compare_exchange_strong(start, nowNs, memory_order_relaxed)) { return; }
+    uint64_t minSojourn = m_minSojourn.exchange(NO_SAMPLE, memory_order_relaxed);
+    bool overloaded = (minSojourn != NO_SAMPLE && minSojourn > m_targetNs.load(memory_order_relaxed));
+    if (overloaded != m_overloaded.exchange(overloaded)) {
+        if (overloaded) {
+            LOG_WARN("overload: enter, min queue delay %.1fms over %dms",
+                     minSojourn / 1e6, IntervalMs());
+        } else {
+            LOG_WARN("overload: leave, shed %llu requests",
+                     (unsigned long long)m_shed.exchange(0));
+        }
+    }
+}
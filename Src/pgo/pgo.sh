@@ -0,0 +1,80 @@
+#!/bin/bash
+# PGO 流水线(在 Src 目录下执行 make pgo)
+# 1. 编译 release 版本，用 loadgen 混合负载测出优化前吞吐
+# 2. 编译插桩版本(-fprofile-generate)，依次用 静态页面/登录/注册/混合 负载驱动，退出时写出 profile
+# 3. 用 profile 重新编译 release 版本(-fprofile-use)，再测一次吞吐并输出对比
+# 可用环境变量: PGO_PORT, PGO_DURATION(测量秒数), PGO_TRAIN(每种训练负载秒数), PGO_CONNS, PGO_THREADS
+# 登录/注册负载需要 main.cpp 中配置的 MySQL 可用
+
+set -e
+cd "$(dirname "$0")/.."
+
+PORT=${PGO_PORT:-9190}
+DURATION=${PGO_DURATION:-10}
+TRAIN=${PGO_TRAIN:-5}
+CONNS=${PGO_CONNS:-64}
+THREADS=${PGO_THREADS:-2}
+MAKE=${MAKE:-make}
+LOADGEN="./loadgen/loadgen -t ${THREADS} -c ${CONNS}"
+PROFILE_DIR=./obj/pgo-profile
+SERVER_PID=
+
+start_server() {
+    ./bin/release/server -p ${PORT} -l 0 &
+    SERVER_PID=$!
+    for i in $(seq 100); do
+        if (echo > /dev/tcp/127.0.0.1/${PORT}) 2>/dev/null; then return 0; fi
+        sleep 0.1
+    done
+    echo "server did not start on port ${PORT}" >&2
+    exit 1
+}
+
+stop_server() {
+    kill -TERM ${SERVER_PID} 2>/dev/null || true
+    wait ${SERVER_PID} 2>/dev/null || true
+    SERVER_PID=
+}
+
+trap 'if [ -n "${SERVER_PID}" ]; then kill -KILL ${SERVER_PID} 2>/dev/null; fi' EXIT
+
+# 用混合负载测吞吐，输出 req/s
+measure() {
+    start_server
+    ${LOADGEN} -d 1 -w static 127.0.0.1:${PORT} > /dev/null
+    local result
+    result=$(${LOADGEN} -d ${DURATION} -w mix -j 127.0.0.1:${PORT})
+    stop_server
+    echo "${result}" | sed -E 's/.*"rps":([0-9.]+).*/\1/'
+}
+
+${MAKE} loadgen > /dev/null
+
+echo "== [1/3] release build"
+rm -rf ./obj/release ${PROFILE_DIR}
+${MAKE} BUILD=release all > /dev/null
+BEFORE=$(measure)
+echo "release: ${BEFORE} req/s"
+
+echo "== [2/3] instrumented build + training run"
+rm -rf ./obj/release
+${MAKE} BUILD=release PGO=gen all > /dev/null
+start_server
+for workload in static login register mix; do
+    ${LOADGEN} -d ${TRAIN} -w ${workload} 127.0.0.1:${PORT} > /dev/null
+done
+stop_server
+if [ -z "$(ls -A ${PROFILE_DIR} 2>/dev/null)" ]; then
+    echo "no profile written to ${PROFILE_DIR}" >&2
+    exit 1
+fi
+
+echo "== [3/3] profile-guided release build"
+rm -rf ./obj/release
+${MAKE} BUILD=release PGO=use all > /dev/null
+AFTER=$(measure)
+echo "release+pgo: ${AFTER} req/s"
+
+awk -v b="${BEFORE}" -v a="${AFTER}" 'BEGIN {
+    printf("PGO throughput: %.1f -> %.1f req/s (%+.1f%%)\n", b, a, b > 0 ? (a - b) / b * 100 : 0)
+}'
@@ -0,0 +1,64 @@
+#include "../include/arena.h"
+#include <algorithm>
+using namespace std;
+
+std::atomic<uint64_t> Arena::heapAllocs(0);
+const size_t Arena::MAX_BLOCK;
+
+Arena::Arena(size_t blockSize)
+    : m_block(nullptr), m_pos(0), m_cap(0), m_full(nullptr), m_used(0),
+      m_blockSize(blockSize), m_heapAllocs(0) {}
+
+// 直接释放所有块(Reset会为下次分配再申请一个块)
+Arena::~Arena() {
+    while (m_full) {
+        Block* next = m_full->next;
+        free(m_full);
+        m_full = next;
+    }
+    if (m_block) { free(m_block - sizeof(Block)); }
+}
+
+// 块的开头放链表指针，之后是可分配区域
+char* Arena::_New_Block(size_t size) {
+    char* raw = static_cast<char*>(malloc(sizeof(Block) + size));
+    if (!raw) { throw std::bad_alloc(); }
+    m_heapAllocs++;
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    return raw + sizeof(Block);
+}
+
+// 当前块不够: 当前块挂到已满链表，申请一个新块(至少blockSize，大对象单独一块)
+void* Arena::_Allocate_Slow(size_t size, size_t align) {
+    if (m_block) {
+        Block* block = reinterpret_cast<Block*>(m_block - sizeof(Block));
+        block->next = m_full;
+        m_full = block;
+        m_used += m_pos;
+    }
+    size_t cap = max(m_blockSize, size + align);
+    m_block = _New_Block(cap);
+    m_cap = cap;
+    m_pos = 0;
+    return Allocate(size, align);
+}
+
+void Arena::Reset() {
+    if (!m_full) {
+        m_pos = 0;
+        return;
+    }
+    // 本次用了多个块: 全部释放，换成一个能放下这次全部分配的块
+    size_t highWater = m_used + m_pos;
+    while (m_full) {
+        Block* next = m_full->next;
+        free(m_full);
+        m_full = next;
+    }
+    free(m_block - sizeof(Block));
+    m_blockSize = max(m_blockSize, min(MAX_BLOCK, highWater + highWater / 4));
+    m_block = _New_Block(m_blockSize);
+    m_cap = m_blockSize;
+    m_pos = 0;
+    m_used = 0;
+}
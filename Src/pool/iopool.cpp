@@ -0,0 +1,60 @@
+#include "../include/iopool.h"
+#include <sys/eventfd.h>
+using namespace std;
+
+std::atomic<uint64_t> IoPool::coldReads(0);
+std::atomic<uint64_t> IoPool::coldBytes(0);
+
+bool IoPool::Init(int threads) {
+    if (threads <= 0) { return true; }
+    m_state = make_shared<State>();
+    m_state->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_state->eventFd < 0) { return false; }
+    m_pool.reset(new ThreadPool(threads));
+    return true;
+}
+
+bool IoPool::Submit(int fd, off_t off, size_t len, HttpConn* client, uint64_t gen) {
+    assert(m_pool);
+    int dupFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dupFd < 0) { return false; }
+    coldReads.fetch_add(1, memory_order_relaxed);
+    coldBytes.fetch_add(len, memory_order_relaxed);
+    shared_ptr<State> state = m_state;
+    m_pool->AddTask([state, dupFd, off, len, client, gen] {
+        _Read(dupFd, off, len);
+        close(dupFd);
+        {
+            lock_guard<mutex> lock(state->mtx);
+            state->done.push_back(Done{ client, gen });
+        }
+        uint64_t one = 1;
+        ssize_t ret = write(state->eventFd, &one, sizeof(one));
+        (void)ret;
+    });
+    return true;
+}
+
+// 顺序读进每个线程自己的临时buffer(内容不用，只为让内核把页读进页缓存)
+void IoPool::_Read(int fd, off_t off, size_t len) {
+    static thread_local vector<char> scratch(128 * 1024);
+    while (len > 0) {
+        ssize_t n = pread(fd, scratch.data(), min(len, scratch.size()), off);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        off += n;
+        len -= n;
+    }
+}
+
+void IoPool::Drain(const function<void(HttpConn*, uint64_t)>& resume) {
+    uint64_t count;
+    ssize_t ret = read(m_state->eventFd, &count, sizeof(count));
+    (void)ret;
+    {
+        lock_guard<mutex> lock(m_state->mtx);
+        m_ready.swap(m_state->done);
+    }
+    for (auto& done : m_ready) { resume(done.client, done.gen); }
+    m_ready.clear();
+}
@@ -1,9 +1,14 @@
 #include "../include/sqlconnpool.h"
+#include "../include/log.h"
 using namespace std;
 
 SqlConnPool::SqlConnPool() {
     m_useCount = 0;
     m_freeCount = 0;
+    m_shrink = 0;
+    m_target = 0;
+    m_pending = 0;
+    MAX_CONN = 0;
 }
 
 SqlConnPool::~SqlConnPool() {
@@ -19,11 +24,16 @@ void SqlConnPool::Init(const char* host, int port,
             const char* user,const char* pwd, const char* dbName,
             int connSize = 10) {
     assert(connSize > 0);
+    m_host = host;
+    m_port = port;
+    m_user = user;
+    m_pwd = pwd;
+    m_dbName = dbName;
     for (int i = 0; i < connSize; i++) {
         MYSQL *sql = nullptr;
         sql = mysql_init(sql); // 获取或初始化一个MYSQL结构
         if (!sql) {
-            printf("mysql init error!\n");
+            LOG_ERROR("mysql init error!");
             assert(sql);
         }
         // mysql_real_connect：连接一个mysql服务器
@@ -31,11 +41,12 @@ void SqlConnPool::Init(const char* host, int port,
                                  user, pwd,
                                  dbName, port, nullptr, 0);
         if (!sql) {
-            printf("mysql connect error!\n");
+            LOG_ERROR("mysql connect error!");
         }
         m_connQue.push(sql);            // 将mysql连接放入连接池中（队列）
     }
     MAX_CONN = connSize;                // 连接池中的连接数
+    m_target = connSize;
     sem_init(&m_semId, 0, MAX_CONN);    // 用信号量管理连接池资源
 }
 
@@ -52,6 +63,68 @@ void SqlConnPool::ClosePool() {
     mysql_library_end();        
 }
 
+// 调整连接池大小(在reactor线程调用，不建立连接): 缩容先关闭空闲连接，不够的等连接归还时再关闭；
+// 扩容先抵消还没完成的缩容，剩下的返回给调用者，由后台线程调用Grow建立(连接数据库可能要很久)
+int SqlConnPool::Resize(int connSize) {
+    assert(connSize > 0);
+    lock_guard<mutex> locker(m_mtx);
+    m_target = connSize;
+    int grow = 0;
+    if (connSize > MAX_CONN) {
+        grow = connSize - MAX_CONN;
+        // 这些连接归还时不再关闭
+        int cancel = min(grow, m_shrink);
+        m_shrink -= cancel;
+        MAX_CONN += cancel;
+        // 正在建立的连接也算在内
+        grow = max(0, grow - cancel - m_pending);
+        m_pending += grow;
+    } else if (connSize < MAX_CONN) {
+        m_shrink += MAX_CONN - connSize;
+        while (m_shrink > 0 && sem_trywait(&m_semId) == 0) {
+            assert(!m_connQue.empty());
+            mysql_close(m_connQue.front());
+            m_connQue.pop();
+            m_shrink--;
+        }
+        MAX_CONN = connSize;
+    }
+    return grow;
+}
+
+// 后台线程: 不持锁建立count个连接，再加进连接池; 只有连上的连接计入MAX_CONN，
+// 期间目标又被调小时多出的连接直接关闭
+void SqlConnPool::Grow(int count) {
+    vector<MYSQL*> conns;
+    for (int i = 0; i < count; i++) {
+        MYSQL *sql = mysql_init(nullptr);
+        if (sql && !mysql_real_connect(sql, m_host.c_str(), m_user.c_str(), m_pwd.c_str(),
+                                       m_dbName.c_str(), m_port, nullptr, 0)) {
+            LOG_ERROR("mysql connect error!");
+            mysql_close(sql);
+            sql = nullptr;
+        }
+        if (sql) { conns.push_back(sql); }
+    }
+    lock_guard<mutex> locker(m_mtx);
+    m_pending -= count;
+    for (MYSQL* sql : conns) {
+        if (MAX_CONN >= m_target) {
+            mysql_close(sql);
+            continue;
+        }
+        m_connQue.push(sql);
+        sem_post(&m_semId);
+        MAX_CONN++;
+    }
+    LOG_INFO("sql pool: %d of %d new connections opened, %d connections", static_cast<int>(conns.size()), count, MAX_CONN);
+}
+
+int SqlConnPool::GetMaxConn() {
+    lock_guard<mutex> locker(m_mtx);
+    return MAX_CONN;
+}
+
 // 从后连接池中获取一个连接 
 MYSQL* SqlConnPool::GetConn() {
     MYSQL *sql = nullptr;
@@ -72,6 +145,12 @@ MYSQL* SqlConnPool::GetConn() {
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql);
     lock_guard<mutex> locker(m_mtx);
+    // 连接池缩容中，归还的连接直接关闭
+    if (m_shrink > 0) {
+        m_shrink--;
+        mysql_close(sql);
+        return;
+    }
     m_connQue.push(sql);        // 空闲连接放入连接池 
     sem_post(&m_semId);         // 信号量post操作 +1
 }
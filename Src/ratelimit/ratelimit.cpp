@@ -0,0 +1,175 @@
+#include "../include/ratelimit.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include <sstream>
+#include <algorithm>
+using namespace std;
+
+static inline uint64_t Mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// 客户地址 -> 键的地址部分: IPv4(含映射地址)直接取32位; IPv6取/64前缀的哈希(一个用户通常分到一个/64)，
+// 最高位置1与IPv4区分; Unix域套接字(同机代理)不限速，返回false
+static inline bool Addr_Bits(const struct sockaddr* addr, uint64_t* bits) {
+    if (addr->sa_family == AF_INET) {
+        *bits = ntohl(reinterpret_cast<const sockaddr_in*>(addr)->sin_addr.s_addr);
+        return true;
+    }
+    if (addr->sa_family != AF_INET6) { return false; }
+    const struct in6_addr* in6 = &reinterpret_cast<const sockaddr_in6*>(addr)->sin6_addr;
+    uint32_t v4;
+    if (IN6_IS_ADDR_V4MAPPED(in6)) {
+        memcpy(&v4, in6->s6_addr + 12, 4);
+        *bits = ntohl(v4);
+        return true;
+    }
+    uint64_t prefix;
+    memcpy(&prefix, in6->s6_addr, 8);
+    *bits = (Mix(prefix) & 0xffffffffull) | (1ull << 63);
+    return true;
+}
+
+// 键: 地址部分 | 类别(0连接、1请求、2起为路径规则)+1 放在32位之上，保证非0
+static inline uint64_t Key(uint64_t bits, uint32_t cls) {
+    return bits | (static_cast<uint64_t>(cls + 1) << 32);
+}
+
+void RateLimit::Limit::Set(double rate, int burstNum) {
+    intervalNs = rate > 0 ? static_cast<uint64_t>(1e9 / rate) : 0;
+    burst = static_cast<uint64_t>(max(1, burstNum));
+}
+
+RateLimit::RateLimit() : m_enabled(false), m_lines(nullptr), m_mask(0) {}
+
+RateLimit::~RateLimit() {
+    for (auto rule : m_rules) { delete rule; }
+    free(m_lines);
+}
+
+// 规则格式: 路径 每秒请求数 [突发量]，突发量默认等于每秒请求数
+bool RateLimit::_Parse_Rule(const string& text, string* path, double* rate, int* burst) {
+    istringstream in(text);
+    if (!(in >> *path >> *rate) || path->empty() || (*path)[0] != '/') { return false; }
+    if (!(in >> *burst)) { *burst = static_cast<int>(*rate); }
+    return true;
+}
+
+// 第一次调用时分配桶表(大小需要重启才能修改)，之后的调用(SIGHUP)只更新速率
+void RateLimit::Init(const Config& cfg) {
+    m_conn.Set(cfg.m_connRate, cfg.m_connBurst);
+    m_req.Set(cfg.m_reqRate, cfg.m_reqBurst);
+
+    bool first = (m_lines == nullptr);
+    bool enabled = m_conn.intervalNs || m_req.intervalNs;
+    for (auto& text : cfg.m_rateRules) {
+        string path;
+        double rate = 0;
+        int burst = 0;
+        if (!_Parse_Rule(text, &path, &rate, &burst)) {
+            LOG_WARN("ratelimit: bad rule \"%s\"", text.c_str());
+            continue;
+        }
+        auto it = find_if(m_rules.begin(), m_rules.end(), [&](const Rule* r) { return r->path == path; });
+        Rule* rule = nullptr;
+        if (it != m_rules.end()) {
+            rule = *it;
+        } else if (first) {
+            rule = new Rule;
+            rule->path = path;
+            m_rules.push_back(rule);
+        } else {
+            LOG_WARN("ratelimit: new rule for %s needs restart", path.c_str());
+            continue;
+        }
+        rule->limit.Set(rate, burst);
+        enabled = enabled || rule->limit.intervalNs;
+    }
+
+    if (first && enabled) {
+        // 每行4个桶，行数取2的幂
+        size_t lines = 1;
+        size_t want = static_cast<size_t>(max(cfg.m_rateSlots, 4)) / 4;
+        while (lines < want) { lines <<= 1; }
+        m_lines = static_cast<Line*>(aligned_alloc(alignof(Line), lines * sizeof(Line)));
+        assert(m_lines);
+        for (size_t i = 0; i < lines; i++) {
+            for (auto& slot : m_lines[i].slots) {
+                slot.key.store(0, memory_order_relaxed);
+                slot.tat.store(0, memory_order_relaxed);
+            }
+        }
+        m_mask = lines - 1;
+        LOG_INFO("ratelimit: %zu buckets, %zu path rules", lines * 4, m_rules.size());
+    }
+    // 启动时没有开启限速则不分配桶表，之后的重新加载也不能开启
+    if (enabled && m_lines == nullptr) {
+        LOG_WARN("ratelimit: enabling rate limit needs restart");
+        enabled = false;
+    }
+    m_enabled = enabled;
+}
+
+// 在键所属的缓存行内查找桶，没有则占用空槽或替换TAT最早(最久没有使用)的桶
+RateLimit::Slot* RateLimit::_Find(uint64_t key) {
+    Line& line = m_lines[Mix(key) & m_mask];
+    Slot* victim = nullptr;
+    uint64_t oldest = UINT64_MAX;
+    for (auto& slot : line.slots) {
+        uint64_t cur = slot.key.load(memory_order_acquire);
+        if (cur == key) { return &slot; }
+        if (cur == 0) {
+            if (slot.key.compare_exchange_strong(cur, key, memory_order_acq_rel) || cur == key) {
+                return &slot;
+            }
+            continue;
+        }
+        uint64_t tat = slot.tat.load(memory_order_relaxed);
+        if (tat < oldest) {
+            oldest = tat;
+            victim = &slot;
+        }
+    }
+    if (victim) {
+        victim->key.store(key, memory_order_release);
+        victim->tat.store(0, memory_order_relaxed);
+    }
+    return victim;
+}
+
+bool RateLimit::_Allow(uint64_t key, const Limit& limit, uint64_t nowNs) {
+    uint64_t interval = limit.intervalNs.load(memory_order_relaxed);
+    if (interval == 0) { return true; }
+    uint64_t window = interval * limit.burst.load(memory_order_relaxed);
+    Slot* slot = _Find(key);
+    if (!slot) { return true; }
+    uint64_t tat = slot->tat.load(memory_order_relaxed);
+    for (;;) {
+        uint64_t next = max(tat, nowNs) + interval;
+        if (next - nowNs > window) { return false; }
+        if (slot->tat.compare_exchange_weak(tat, next, memory_order_relaxed)) { return true; }
+    }
+}
+
+bool RateLimit::Allow_Conn(const struct sockaddr* addr, uint64_t nowNs) {
+    uint64_t ip;
+    if (!Enabled() || !Addr_Bits(addr, &ip)) { return true; }
+    return _Allow(Key(ip, 0), m_conn, nowNs);
+}
+
+bool RateLimit::Allow_Request(const struct sockaddr* addr, const char* path, size_t len, uint64_t nowNs) {
+    uint64_t ip;
+    if (!Enabled() || !Addr_Bits(addr, &ip)) { return true; }
+    for (size_t i = 0; i < m_rules.size(); i++) {
+        const string& rulePath = m_rules[i]->path;
+        if (rulePath.size() == len && memcmp(rulePath.data(), path, len) == 0) {
+            return _Allow(Key(ip, static_cast<uint32_t>(i) + 2), m_rules[i]->limit, nowNs);
+        }
+    }
+    return _Allow(Key(ip, 1), m_req, nowNs);
+}
@@ -0,0 +1,115 @@
+// 访问控制前缀树的测试: 插入时的分叉/中间节点、最长前缀匹配、IPv4直接索引和 ::/0 这样只落在根节点的条目
+//
+//   make check
+
+#include "../include/acl.h"
+#include "../include/config.h"
+#include "./check.h"
+
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 按地址的写法构造sockaddr(IPv4或IPv6)，查询是否允许
+static bool Allow(Acl& acl, const char* ip) {
+    struct sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    struct sockaddr_in* v4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+    struct sockaddr_in6* v6 = reinterpret_cast<struct sockaddr_in6*>(&addr);
+    if (inet_pton(AF_INET, ip, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+    } else if (inet_pton(AF_INET6, ip, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+    } else {
+        fprintf(stderr, "bad address %s\n", ip);
+        return false;
+    }
+    return acl.Allow(reinterpret_cast<struct sockaddr*>(&addr));
+}
+
+static void Load(Acl& acl, const vector<string>& allow, const vector<string>& deny) {
+    Config cfg;
+    cfg.m_aclAllow = allow;
+    cfg.m_aclDeny = deny;
+    CHECK(acl.Load(cfg));
+}
+
+int main() {
+    // 空表: 全部允许
+    {
+        Acl acl;
+        Load(acl, {}, {});
+        CHECK(Allow(acl, "1.2.3.4"));
+        CHECK(Allow(acl, "2001:db8::1"));
+    }
+    // 只有 ::/0: 动作落在根节点上，不能当作空表
+    {
+        Acl acl;
+        Load(acl, {}, { "::/0" });
+        CHECK(!Allow(acl, "1.2.3.4"));
+        CHECK(!Allow(acl, "2001:db8::1"));
+        CHECK(!Allow(acl, "::ffff:10.0.0.1"));
+    }
+    // 0.0.0.0/0 只覆盖IPv4(映射到 ::ffff:0:0/96)
+    {
+        Acl acl;
+        Load(acl, {}, { "0.0.0.0/0" });
+        CHECK(!Allow(acl, "8.8.8.8"));
+        CHECK(!Allow(acl, "::ffff:8.8.8.8"));
+        CHECK(Allow(acl, "2001:db8::1"));
+    }
+    // 嵌套前缀的最长匹配; 有allow条目时不匹配的地址拒绝
+    {
+        Acl acl;
+        Load(acl, { "10.0.0.0/8", "10.1.2.0/24" }, { "10.1.0.0/16", "10.1.2.3" });
+        CHECK(Allow(acl, "10.2.3.4"));
+        CHECK(!Allow(acl, "10.1.3.4"));
+        CHECK(Allow(acl, "10.1.2.9"));
+        CHECK(!Allow(acl, "10.1.2.3"));
+        CHECK(!Allow(acl, "11.0.0.1"));
+        CHECK(!Allow(acl, "2001:db8::1"));
+    }
+    // 插入顺序: 先插入长前缀，再插入分叉点上的短前缀(中间节点得到动作)，再插入更短的前缀
+    {
+        Acl acl;
+        Load(acl, {}, { "192.168.1.0/24", "192.168.2.0/24", "192.168.0.0/22", "192.168.1.128/25" });
+        CHECK(!Allow(acl, "192.168.1.1"));
+        CHECK(!Allow(acl, "192.168.2.1"));
+        CHECK(!Allow(acl, "192.168.3.1"));
+        CHECK(!Allow(acl, "192.168.1.200"));
+        CHECK(Allow(acl, "192.168.4.1"));
+        CHECK(Allow(acl, "192.169.0.1"));
+    }
+    // 在 /16 直接索引以内和以外分叉的IPv4前缀
+    {
+        Acl acl;
+        Load(acl, { "172.16.0.0/12" }, { "172.16.0.0/14", "172.17.5.0/24" });
+        CHECK(!Allow(acl, "172.16.9.9"));
+        CHECK(!Allow(acl, "172.17.5.1"));
+        CHECK(Allow(acl, "172.20.0.1"));
+        CHECK(Allow(acl, "172.31.255.255"));
+        CHECK(!Allow(acl, "172.32.0.1"));
+    }
+    // IPv6: 分叉和最长匹配
+    {
+        Acl acl;
+        Load(acl, {}, { "2001:db8::/32", "2001:db8:1::/48", "fe80::/10" });
+        CHECK(!Allow(acl, "2001:db8:1::5"));
+        CHECK(!Allow(acl, "2001:db8:ffff::1"));
+        CHECK(Allow(acl, "2001:db9::1"));
+        CHECK(!Allow(acl, "fe80::1"));
+        CHECK(Allow(acl, "fec0::1"));
+        CHECK(Allow(acl, "1.2.3.4"));
+    }
+    // 同一前缀同时在两张列表中: 拒绝; 重新加载后使用新的表
+    {
+        Acl acl;
+        Load(acl, { "10.0.0.0/8" }, { "10.0.0.0/8" });
+        CHECK(!Allow(acl, "10.0.0.1"));
+        Load(acl, { "10.0.0.0/8" }, {});
+        CHECK(Allow(acl, "10.0.0.1"));
+    }
+    return Check_Done("acltest");
+}
@@ -0,0 +1,148 @@
+// 请求体接收的测试: Content-Length、chunked(分多次到达)、Transfer-Encoding列表的检查、长度溢出和转存临时文件
+//
+//   make check
+
+#include "../include/httprequest.h"
+#include "./check.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 把请求分成几段依次解析; 返回最后一次parse的结果
+static bool Parse(HttpRequest& request, const vector<string>& parts) {
+    Buffer buff;
+    bool ok = true;
+    for (auto& part : parts) {
+        buff.Append(part);
+        ok = request.parse(buff);
+        if (!ok) { break; }
+    }
+    return ok;
+}
+
+static string Post(const string& headers, const string& body) {
+    return "POST /echo HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n" + body;
+}
+
+// 解析完整的请求，出错时返回状态码，成功时返回0并取出请求体
+static int Error(const string& text, string* body = nullptr) {
+    HttpRequest request;
+    bool ok = Parse(request, { text });
+    if (!ok) { return request.ErrorCode(); }
+    if (!request.IsFinished()) { return -1; }
+    if (body) { *body = request.Body(); }
+    return 0;
+}
+
+static string ReadFd(int fd) {
+    string data;
+    char buf[4096];
+    ssize_t n;
+    off_t off = 0;
+    while ((n = pread(fd, buf, sizeof(buf), off)) > 0) {
+        data.append(buf, n);
+        off += n;
+    }
+    return data;
+}
+
+static void Test_Length() {
+    string body;
+    CHECK(Error(Post("Content-Length: 5\r\n", "hello"), &body) == 0 && body == "hello");
+    CHECK(Error(Post("Content-Length: 0\r\n", ""), &body) == 0 && body.empty());
+    CHECK(Error(Post("Content-Length: 5x\r\n", "hello")) == 400);
+    CHECK(Error(Post("Content-Length: 99999999999999999999999\r\n", "")) == 400);
+    CHECK(Error(Post("Content-Length: " + to_string(HttpRequest::maxBody + 1) + "\r\n", "")) == 413);
+    // 请求体分几次到达
+    {
+        HttpRequest request;
+        CHECK(Parse(request, { Post("Content-Length: 11\r\n", "hel"), "lo w", "orld" }));
+        CHECK(request.IsFinished() && request.Body() == "hello world");
+    }
+}
+
+static void Test_Chunked() {
+    string body;
+    CHECK(Error(Post("Transfer-Encoding: chunked\r\n", "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n"), &body) == 0 &&
+          body == "hello world");
+    // 尾部字段忽略; 同时带Content-Length时以chunked为准
+    CHECK(Error(Post("Transfer-Encoding: chunked\r\nContent-Length: 100\r\n",
+                     "3\r\nabc\r\n0\r\nX-Trailer: 1\r\n\r\n"), &body) == 0 && body == "abc");
+    // 块大小行、数据、块结尾分多次到达
+    {
+        HttpRequest request;
+        CHECK(Parse(request, { Post("Transfer-Encoding: chunked\r\n", "A"), "\r\n0123", "456789\r", "\n0\r\n", "\r\n" }));
+        CHECK(request.IsFinished() && request.Body() == "0123456789");
+    }
+    // 块大小: 十六进制溢出64位是格式错误; 接近上限的大小不能与已收到的长度相加溢出
+    CHECK(Error(Post("Transfer-Encoding: chunked\r\n", "10000000000000000\r\n")) == 400);
+    CHECK(Error(Post("Transfer-Encoding: chunked\r\n", "3\r\nabc\r\nffffffffffffffff\r\n")) == 413);
+    CHECK(Error(Post("Transfer-Encoding: chunked\r\n", "xyz\r\n")) == 400);
+}
+
+// Transfer-Encoding是编码列表: chunked必须是最后一个且只出现一次，其他编码不支持
+static void Test_Encoding() {
+    const string body = "3\r\nabc\r\n0\r\n\r\n";
+    CHECK(Error(Post("Transfer-Encoding: Chunked\r\n", body)) == 0);
+    CHECK(Error(Post("Transfer-Encoding: , chunked \r\n", body)) == 0);
+    CHECK(Error(Post("Transfer-Encoding: gzip, chunked\r\n", body)) == 501);
+    CHECK(Error(Post("Transfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n", body)) == 501);
+    CHECK(Error(Post("Transfer-Encoding: chunked, gzip\r\n", body)) == 400);
+    CHECK(Error(Post("Transfer-Encoding: chunked, chunked\r\n", body)) == 400);
+    CHECK(Error(Post("Transfer-Encoding: gzip\r\n", body)) == 400);
+    CHECK(Error(Post("Transfer-Encoding: xchunked\r\n", body)) == 400);
+    CHECK(Error(Post("Transfer-Encoding: \r\n", body)) == 400);
+}
+
+// 超过spoolSize的请求体写进临时文件，内容与发送的一致
+static void Test_Spool() {
+    size_t spoolSize = HttpRequest::spoolSize;
+    HttpRequest::spoolSize = 1024;
+    string data;
+    for (int i = 0; i < 5000; i++) { data.push_back(static_cast<char>('a' + i % 26)); }
+    {
+        HttpRequest request;
+        CHECK(Parse(request, { Post("Content-Length: 5000\r\n", data.substr(0, 700)), data.substr(700, 2000),
+                               data.substr(2700) }));
+        CHECK(request.IsFinished() && request.BodyFd() >= 0 && request.Body().empty());
+        CHECK(request.BodyLen() == data.size() && ReadFd(request.BodyFd()) == data);
+    }
+    {
+        string chunked;
+        for (size_t i = 0; i < data.size(); i += 1000) {
+            char size[16];
+            snprintf(size, sizeof(size), "%zx\r\n", min<size_t>(1000, data.size() - i));
+            chunked += size + data.substr(i, 1000) + "\r\n";
+        }
+        HttpRequest request;
+        CHECK(Parse(request, { Post("Transfer-Encoding: chunked\r\n", chunked + "0\r\n\r\n") }));
+        CHECK(request.IsFinished() && request.BodyFd() >= 0 && ReadFd(request.BodyFd()) == data);
+    }
+    // 没有超过spoolSize的请求体留在内存里
+    {
+        HttpRequest request;
+        CHECK(Parse(request, { Post("Content-Length: 1024\r\n", data.substr(0, 1024)) }));
+        CHECK(request.IsFinished() && request.BodyFd() < 0 && request.Body() == data.substr(0, 1024));
+    }
+    HttpRequest::spoolSize = spoolSize;
+}
+
+// Expect: 100-continue: 请求头收完后只回复一次
+static void Test_Continue() {
+    HttpRequest request;
+    CHECK(Parse(request, { Post("Content-Length: 5\r\nExpect: 100-continue\r\n", "") }));
+    CHECK(!request.IsFinished() && request.InProgress());
+    CHECK(request.ClaimContinue());
+    CHECK(!request.ClaimContinue());
+}
+
+int main() {
+    Test_Length();
+    Test_Chunked();
+    Test_Encoding();
+    Test_Spool();
+    Test_Continue();
+    return Check_Done("bodytest");
+}
@@ -0,0 +1,25 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include <stdio.h>
+
+// 回归测试的检查宏: 失败时打印位置并计数，不中断后面的检查; main最后返回Check_Done的结果
+static int g_failed = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        g_failed++; \
+    } \
+} while (0)
+
+static inline int Check_Done(const char* name) {
+    if (g_failed) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, g_failed);
+        return 1;
+    }
+    fprintf(stderr, "%s: ok\n", name);
+    return 0;
+}
+
+#endif /* _CHECK_H */
@@ -0,0 +1,248 @@
+// HTTP/2的测试: HPACK解码(RFC 7541 附录C的示例)、帧大小错误、CONTINUATION顺序错误和连接是否空闲
+//
+//   make check
+
+#include "../include/hpack.h"
+#include "../include/http2.h"
+#include "../include/router.h"
+#include "./check.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 十六进制串转成字节，忽略空格
+static string Hex(const char* text) {
+    string bytes;
+    int hi = -1;
+    for (const char* p = text; *p; p++) {
+        int v;
+        if (*p >= '0' && *p <= '9') { v = *p - '0'; }
+        else if (*p >= 'a' && *p <= 'f') { v = *p - 'a' + 10; }
+        else { continue; }
+        if (hi < 0) {
+            hi = v;
+        } else {
+            bytes.push_back(static_cast<char>((hi << 4) | v));
+            hi = -1;
+        }
+    }
+    return bytes;
+}
+
+// 解码一个头部块，与期望的头部列表逐项比较
+static bool Decode(HpackDecoder& decoder, const char* hex, const vector<HeaderField>& expect) {
+    string block = Hex(hex);
+    vector<HeaderField> fields;
+    if (!decoder.Decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), &fields)) { return false; }
+    if (fields.size() != expect.size()) { return false; }
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (fields[i].name != expect[i].name || fields[i].value != expect[i].value) { return false; }
+    }
+    return true;
+}
+
+static void Test_Hpack() {
+    // C.2: 单个头部的各种表示
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572",
+                     { { "custom-key", "custom-header" } }));
+    }
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "040c 2f73 616d 706c 652f 7061 7468", { { ":path", "/sample/path" } }));
+    }
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "1008 7061 7373 776f 7264 0673 6563 7265 74", { { "password", "secret" } }));
+    }
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "82", { { ":method", "GET" } }));
+    }
+
+    // C.3 / C.4: 同一连接上的三个请求(不用/使用Huffman编码)，后面的请求引用动态表
+    const vector<HeaderField> req1 = { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+                                       { ":authority", "www.example.com" } };
+    vector<HeaderField> req2 = req1;
+    req2.push_back({ "cache-control", "no-cache" });
+    const vector<HeaderField> req3 = { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+                                       { ":authority", "www.example.com" }, { "custom-key", "custom-value" } };
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", req1));
+        CHECK(Decode(decoder, "8286 84be 5808 6e6f 2d63 6163 6865", req2));
+        CHECK(Decode(decoder, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65", req3));
+    }
+    {
+        HpackDecoder decoder;
+        CHECK(Decode(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff", req1));
+        CHECK(Decode(decoder, "8286 84be 5886 a8eb 1064 9cbf", req2));
+        CHECK(Decode(decoder, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf", req3));
+    }
+
+    // C.5 / C.6: 动态表上限256字节的三个响应，后两个响应会淘汰最旧的条目
+    const vector<HeaderField> resp1 = { { ":status", "302" }, { "cache-control", "private" },
+                                        { "date", "Mon, 21 Oct 2013 20:13:21 GMT" },
+                                        { "location", "https://www.example.com" } };
+    vector<HeaderField> resp2 = resp1;
+    resp2[0].value = "307";
+    const vector<HeaderField> resp3 = { { ":status", "200" }, { "cache-control", "private" },
+                                        { "date", "Mon, 21 Oct 2013 20:13:22 GMT" },
+                                        { "location", "https://www.example.com" }, { "content-encoding", "gzip" },
+                                        { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" } };
+    {
+        HpackDecoder decoder(256);
+        CHECK(Decode(decoder, "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133"
+                              "2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70"
+                              "6c65 2e63 6f6d", resp1));
+        CHECK(Decode(decoder, "4803 3330 37c1 c0bf", resp2));
+        CHECK(Decode(decoder, "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d"
+                              "54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049"
+                              "5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e"
+                              "3d31", resp3));
+    }
+    {
+        HpackDecoder decoder(256);
+        CHECK(Decode(decoder, "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6"
+                              "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3", resp1));
+        CHECK(Decode(decoder, "4883 640e ffc1 c0bf", resp2));
+        CHECK(Decode(decoder, "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab"
+                              "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f"
+                              "9587 3160 65c0 03ed 4ee5 b106 3d50 07", resp3));
+    }
+
+    // 错误的输入: 索引超出两张表、长度超出块、Huffman结尾填充不是全1
+    {
+        HpackDecoder decoder;
+        CHECK(!Decode(decoder, "be", {}));
+        CHECK(!Decode(decoder, "4005 6162", {}));
+        CHECK(!Decode(decoder, "0481 00", {}));
+    }
+}
+
+static string Frame(uint8_t type, uint8_t flags, uint32_t id, const string& payload) {
+    string frame;
+    frame.push_back(static_cast<char>(payload.size() >> 16));
+    frame.push_back(static_cast<char>(payload.size() >> 8));
+    frame.push_back(static_cast<char>(payload.size()));
+    frame.push_back(static_cast<char>(type));
+    frame.push_back(static_cast<char>(flags));
+    frame.push_back(static_cast<char>(id >> 24));
+    frame.push_back(static_cast<char>(id >> 16));
+    frame.push_back(static_cast<char>(id >> 8));
+    frame.push_back(static_cast<char>(id));
+    return frame + payload;
+}
+
+enum { DATA = 0, HEADERS = 1, SETTINGS = 4, PING = 6, GOAWAY = 7, WINDOW_UPDATE = 8, CONTINUATION = 9 };
+enum { END_STREAM = 0x1, END_HEADERS = 0x4 };
+
+// C.3.1 的请求头部块: GET http://www.example.com/
+static const string GET_BLOCK = Hex("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d");
+
+struct Result {
+    int goaway;                 // GOAWAY的错误码, -1表示没有发送GOAWAY
+    vector<uint32_t> headers;   // 发送了响应HEADERS的流
+};
+
+// 连接前言和SETTINGS之后处理frames，解析服务器的输出
+static Result Run(Http2Session& session, const vector<string>& frames) {
+    Buffer in, out;
+    string data = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + Frame(SETTINGS, 0, 0, "");
+    for (auto& frame : frames) { data += frame; }
+    in.Append(data);
+    session.Process(in, out);
+
+    Result result = { -1, {} };
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(out.Peek());
+    size_t left = out.ReadableBytes();
+    while (left >= 9) {
+        size_t len = (static_cast<size_t>(p[0]) << 16) | (p[1] << 8) | p[2];
+        uint32_t id = ((p[5] & 0x7f) << 24) | (p[6] << 16) | (p[7] << 8) | p[8];
+        if (left < 9 + len) { break; }
+        if (p[3] == GOAWAY && len >= 8) { result.goaway = (p[13] << 24) | (p[14] << 16) | (p[15] << 8) | p[16]; }
+        if (p[3] == HEADERS) { result.headers.push_back(id); }
+        p += 9 + len;
+        left -= 9 + len;
+    }
+    return result;
+}
+
+static Result Run(const vector<string>& frames) {
+    Http2Session session("127.0.0.1", "/nonexistent/");
+    return Run(session, frames);
+}
+
+static void Test_Frames() {
+    // 帧大小: 超过16384的帧、长度不对的PING/SETTINGS/WINDOW_UPDATE都是FRAME_SIZE_ERROR(6)
+    CHECK(Run({ Frame(PING, 0, 0, string(16385, 'x')) }).goaway == 6);
+    CHECK(Run({ Frame(PING, 0, 0, string(7, 'x')) }).goaway == 6);
+    CHECK(Run({ Frame(SETTINGS, 0, 0, string(5, '\0')) }).goaway == 6);
+    CHECK(Run({ Frame(WINDOW_UPDATE, 0, 0, string(3, '\0')) }).goaway == 6);
+    CHECK(Run({ Frame(PING, 0, 0, string(8, 'x')) }).goaway == -1);
+
+    // CONTINUATION: 头部块没有结束时插入其他帧、换了流、没有HEADERS就收到，都是PROTOCOL_ERROR(1)
+    string first = GET_BLOCK.substr(0, 5), rest = GET_BLOCK.substr(5);
+    CHECK(Run({ Frame(HEADERS, END_STREAM, 1, first), Frame(PING, 0, 0, string(8, 'x')) }).goaway == 1);
+    CHECK(Run({ Frame(HEADERS, END_STREAM, 1, first), Frame(CONTINUATION, END_HEADERS, 3, rest) }).goaway == 1);
+    CHECK(Run({ Frame(CONTINUATION, END_HEADERS, 1, GET_BLOCK) }).goaway == 1);
+    // 不断发送CONTINUATION超过头部块累计上限: ENHANCE_YOUR_CALM(11)
+    {
+        vector<string> frames = { Frame(HEADERS, END_STREAM, 1, first) };
+        for (int i = 0; i < 5; i++) { frames.push_back(Frame(CONTINUATION, 0, 1, string(16384, 'x'))); }
+        CHECK(Run(frames).goaway == 11);
+    }
+    // 正确拆分的头部块: 流1得到响应
+    {
+        Result result = Run({ Frame(HEADERS, END_STREAM, 1, first), Frame(CONTINUATION, END_HEADERS, 1, rest) });
+        CHECK(result.goaway == -1);
+        CHECK(result.headers.size() == 1 && result.headers[0] == 1);
+    }
+}
+
+// 连接上有流在等待请求体、或头部块没收完时不算空闲(不能被淘汰或在排空时关闭)
+static void Test_Active() {
+    {
+        Http2Session session("127.0.0.1", "/nonexistent/");
+        Run(session, {});
+        CHECK(!session.Active());
+    }
+    {
+        Http2Session session("127.0.0.1", "/nonexistent/");
+        Run(session, { Frame(HEADERS, END_HEADERS, 1, GET_BLOCK) });
+        CHECK(session.Active());
+    }
+    {
+        Http2Session session("127.0.0.1", "/nonexistent/");
+        Run(session, { Frame(HEADERS, END_STREAM, 1, GET_BLOCK.substr(0, 5)) });
+        CHECK(session.Active());
+    }
+    {
+        Http2Session session("127.0.0.1", "/nonexistent/");
+        Run(session, { Frame(HEADERS, END_HEADERS, 1, GET_BLOCK), Frame(DATA, END_STREAM, 1, "") });
+        CHECK(!session.Active());
+    }
+    // 对端的初始窗口为0: 响应体被流量控制挡住，窗口打开后发送完
+    {
+        Http2Session session("127.0.0.1", "/nonexistent/");
+        Run(session, { Frame(SETTINGS, 0, 0, string("\x00\x04\x00\x00\x00\x00", 6)),
+                       Frame(HEADERS, END_HEADERS | END_STREAM, 1, GET_BLOCK) });
+        CHECK(session.Active());
+        Buffer in, out;
+        string update = Frame(WINDOW_UPDATE, 0, 1, string("\x00\x01\x00\x00", 4));
+        in.Append(update);
+        session.Process(in, out);
+        CHECK(!session.Active());
+    }
+}
+
+int main() {
+    Router::Instance()->Compile();     // 没有路由: 请求都按静态文件响应(目录不存在，回复404)
+    Test_Hpack();
+    Test_Frames();
+    Test_Active();
+    return Check_Done("h2test");
+}
@@ -0,0 +1,86 @@
+// 请求头的测试: 常用头部的合并、字段行数上限(重复的常用头部也计数)和请求头总长度上限
+//
+//   make check
+
+#include "../include/headermap.h"
+#include "../include/httprequest.h"
+#include "./check.h"
+
+#include <string>
+
+using namespace std;
+
+static void Test_Merge() {
+    HeaderMap header;
+    CHECK(header.Add("Cookie", "a=1"));
+    CHECK(header.Add("cookie", "b=2"));
+    CHECK(header.Add("X-Custom", "x"));
+    CHECK(header.Add("Accept", "text/html"));
+    // 与其他头部交错出现: 值先搬到存储末尾再追加
+    CHECK(header.Add("COOKIE", "c=3"));
+    CHECK(header.Add("Accept", "*/*"));
+    CHECK(header.Add("Cookie", "d=4"));
+    CHECK(header.Get(HeaderMap::COOKIE) == Slice("a=1, b=2, c=3, d=4"));
+    CHECK(header.Get(HeaderMap::ACCEPT) == Slice("text/html, */*"));
+    CHECK(header.Get("x-custom", 8) == Slice("x"));
+    CHECK(header.Size() == 3);
+    // Clear之后不保留旧值
+    header.Clear();
+    CHECK(!header.Has(HeaderMap::COOKIE));
+    CHECK(header.Add("Cookie", "e=5"));
+    CHECK(header.Get(HeaderMap::COOKIE) == Slice("e=5"));
+}
+
+// 字段行数上限: 不同的头部、重复的常用头部都算一行
+static void Test_Fields() {
+    {
+        HeaderMap header;
+        for (size_t i = 0; i < HeaderMap::MAX_FIELDS; i++) { CHECK(header.Add("X-H" + to_string(i), "v")); }
+        CHECK(!header.Add("X-Extra", "v"));
+        CHECK(!header.Add("Cookie", "v"));
+    }
+    {
+        HeaderMap header;
+        for (size_t i = 0; i < HeaderMap::MAX_FIELDS; i++) { CHECK(header.Add("Cookie", "v")); }
+        CHECK(!header.Add("Cookie", "v"));
+        CHECK(!header.Add("X-Extra", "v"));
+        CHECK(header.Get(HeaderMap::COOKIE).len == HeaderMap::MAX_FIELDS * 3 - 2);
+    }
+}
+
+static int Parse(const string& headers) {
+    HttpRequest request;
+    Buffer buff;
+    buff.Append("GET / HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n");
+    if (!request.parse(buff)) { return request.ErrorCode(); }
+    return request.IsFinished() ? 0 : -1;
+}
+
+static void Test_Request() {
+    string lines;
+    for (int i = 0; i < 98; i++) { lines += "Cookie: c" + to_string(i) + "=1\r\n"; }
+    CHECK(Parse(lines) == 0);
+    CHECK(Parse(lines + "Cookie: x=1\r\nCookie: y=1\r\n") == 431);
+    // 大量重复的Cookie行: 在行数上限处停止，不会把整个请求都合并进来
+    {
+        string many;
+        for (int i = 0; i < 20000; i++) { many += "Cookie: k" + to_string(i) + "=v\r\n"; }
+        CHECK(Parse(many) == 431);
+    }
+    // 行数不多但总长度超过上限
+    {
+        string big;
+        for (int i = 0; i < 5; i++) { big += "X-Big" + to_string(i) + ": " + string(8000, 'a') + "\r\n"; }
+        CHECK(Parse(big) == 431);
+        CHECK(Parse(big.substr(0, big.size() / 5 * 3)) == 0);
+    }
+    // 一次到达的超长单行也计入总长度
+    CHECK(Parse("X-Long: " + string(40000, 'a') + "\r\n") == 431);
+}
+
+int main() {
+    Test_Merge();
+    Test_Fields();
+    Test_Request();
+    return Check_Done("headertest");
+}
@@ -0,0 +1,70 @@
+// WebSocket帧解析的回归测试: 恶意长度的帧必须以关闭帧拒绝，不能越界
+//
+//   make check
+
+#include "../include/websocket.h"
+#include "./check.h"
+
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 客户端帧(带掩码)，payload不超过125字节
+static string ClientFrame(bool fin, int opcode, const string& payload) {
+    static const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+    string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+    frame.push_back(static_cast<char>(0x80 | payload.size()));
+    frame.append(reinterpret_cast<const char*>(key), 4);
+    for (size_t i = 0; i < payload.size(); i++) { frame.push_back(static_cast<char>(payload[i] ^ key[i % 4])); }
+    return frame;
+}
+
+// 只有头部的帧: 127形式的8字节长度
+static string LongHeader(bool fin, int opcode, const uint8_t lenBytes[8]) {
+    string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+    frame.push_back(static_cast<char>(0x80 | 127));
+    frame.append(reinterpret_cast<const char*>(lenBytes), 8);
+    frame.append("\x12\x34\x56\x78", 4);
+    return frame;
+}
+
+// 处理输入并取出服务器发出的所有字节; 返回关闭码，没有发出关闭帧时返回0
+static int Run(const vector<string>& frames) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) { return -1; }
+    WebSocket ws;
+    Buffer in;
+    for (auto& frame : frames) {
+        in.Append(frame.data(), frame.size());
+        ws.Process(in);
+    }
+    int err = 0;
+    ws.Write(sv[0], &err);
+    close(sv[0]);
+    uint8_t out[64];
+    ssize_t n = ::read(sv[1], out, sizeof(out));
+    close(sv[1]);
+    if (n >= 4 && out[0] == 0x88 && out[1] == 2) { return (out[2] << 8) | out[3]; }
+    return 0;
+}
+
+int main() {
+    static const uint8_t ALL_ONES[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    static const uint8_t HUGE_LEN[8] = { 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+    // 正常的分片消息: 不关闭
+    CHECK(Run({ ClientFrame(false, WebSocket::TEXT, "he"), ClientFrame(true, WebSocket::CONTINUATION, "llo") }) == 0);
+
+    // 分片进行中，CONTINUATION声明0xffffffffffffffff: 最高位为1，协议错误
+    CHECK(Run({ ClientFrame(false, WebSocket::TEXT, "x"), LongHeader(true, WebSocket::CONTINUATION, ALL_ONES) }) == 1002);
+
+    // 最高位为0但超过上限(与已收到的部分相加会溢出): 消息太大
+    CHECK(Run({ ClientFrame(false, WebSocket::TEXT, "x"), LongHeader(true, WebSocket::CONTINUATION, HUGE_LEN) }) == 1009);
+    CHECK(Run({ LongHeader(true, WebSocket::BINARY, HUGE_LEN) }) == 1009);
+
+    return Check_Done("wstest");
+}
@@ -12,13 +12,12 @@ void HeapTimer::_Swap_Node(size_t i, size_t j) {
 // 较小节点向上调整
 void HeapTimer::_sift_up(size_t i) {
     assert(i >= 0 && i < m_heap.size());
-    size_t j = (i - 1) / 2;
-    // 小顶堆，较小值节点往上调整
-    while(j >= 0) {
+    // 小顶堆，较小值节点往上调整(size_t不会小于0，到根节点为止)
+    while(i > 0) {
+        size_t j = (i - 1) / 2;
         if(m_heap[j] < m_heap[i]) { break; }
         _Swap_Node(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 
@@ -0,0 +1,99 @@
+#include "../include/trace.h"
+#include <sys/syscall.h>
+using namespace std;
+
+// 线程环形缓冲：只有所属线程写，导出时由reactor线程读，用各自的锁保护(平时无竞争)
+struct Trace::Ring {
+    Ring(size_t size, int t) : events(size), head(0), tid(t) {}
+    vector<Event> events;
+    size_t head;
+    int tid;
+    mutex mtx;
+};
+
+Trace::Trace() : m_sampleRate(0), m_counter(0), m_ringSize(8192) {}
+
+Trace* Trace::Instance() {
+    static Trace trace;
+    return &trace;
+}
+
+void Trace::Init(int sampleRate, size_t ringSize) {
+    assert(ringSize > 0);
+    m_ringSize = ringSize;
+    m_sampleRate = sampleRate > 0 ? sampleRate : 0;
+}
+
+uint64_t Trace::Sample() {
+    int rate = m_sampleRate.load(memory_order_relaxed);
+    if (rate <= 0) { return 0; }
+    uint64_t n = m_counter.fetch_add(1, memory_order_relaxed) + 1;
+    return (n % rate == 0) ? n : 0;
+}
+
+Trace::Ring* Trace::_Local_Ring() {
+    thread_local Ring* local = nullptr;
+    if (!local) {
+        shared_ptr<Ring> ring = make_shared<Ring>(m_ringSize, static_cast<int>(syscall(SYS_gettid)));
+        lock_guard<mutex> locker(m_mtx);
+        m_rings.push_back(ring);
+        local = ring.get();
+    }
+    return local;
+}
+
+void Trace::_Push(const Event& ev) {
+    Ring* ring = _Local_Ring();
+    lock_guard<mutex> locker(ring->mtx);
+    ring->events[ring->head % ring->events.size()] = ev;
+    ring->head++;
+}
+
+void Trace::Span(uint64_t id, const char* name, uint64_t beginNs, uint64_t endNs, int64_t arg) {
+    if (!id) { return; }
+    _Push({name, id, beginNs, endNs > beginNs ? endNs - beginNs : 0, arg, 'X'});
+}
+
+void Trace::Instant(uint64_t id, const char* name, uint64_t ts, int64_t arg) {
+    if (!id) { return; }
+    _Push({name, id, ts, 0, arg, 'i'});
+}
+
+// 导出所有线程缓冲中的事件(Chrome trace-event JSON, 时间单位为微秒)
+bool Trace::Dump(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) { return false; }
+    vector<shared_ptr<Ring>> rings;
+    {
+        lock_guard<mutex> locker(m_mtx);
+        rings = m_rings;
+    }
+    int pid = getpid();
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (auto& ring : rings) {
+        vector<Event> events;
+        {
+            lock_guard<mutex> locker(ring->mtx);
+            size_t n = min(ring->head, ring->events.size());
+            for (size_t i = ring->head - n; i < ring->head; i++) {
+                events.push_back(ring->events[i % ring->events.size()]);
+            }
+        }
+        for (auto& ev : events) {
+            fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"%c\",\"ts\":%.3f,",
+                    first ? "" : ",\n", ev.name, ev.ph, ev.ts / 1000.0);
+            if (ev.ph == 'X') {
+                fprintf(fp, "\"dur\":%.3f,", ev.dur / 1000.0);
+            } else {
+                fprintf(fp, "\"s\":\"t\",");
+            }
+            fprintf(fp, "\"pid\":%d,\"tid\":%d,\"args\":{\"req\":%llu,\"arg\":%lld}}",
+                    pid, ring->tid, (unsigned long long)ev.id, (long long)ev.arg);
+            first = false;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
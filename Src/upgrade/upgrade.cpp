@@ -0,0 +1,173 @@
+#include "../include/upgrade.h"
+#include <dirent.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+using namespace std;
+
+extern char** environ;
+
+const char* Upgrade::ENV_FD = "LAI_UPGRADE_FD";
+
+static const char FDS_MAGIC[] = "LAIFDS";
+static const size_t MAX_FDS = 64;
+
+// 关闭子进程中除 keep 以外的所有描述符(fork之后只能用异步信号安全的调用)
+static void Close_Fds_Except(int keep, int maxFd) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, keep - 1, 0) == 0 &&
+        syscall(SYS_close_range, keep + 1, ~0U, 0) == 0) {
+        return;
+    }
+#endif
+    for (int fd = 3; fd < maxFd; fd++) {
+        if (fd != keep) { close(fd); }
+    }
+}
+
+// 启动新进程，返回旧进程一端的通信套接字(失败返回-1)
+int Upgrade::Spawn(const vector<string>& args, pid_t* pid) {
+    if (args.empty()) { return -1; }
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return -1;
+    }
+    // fork之前准备好argv和环境变量，子进程中不再分配内存
+    vector<char*> argv;
+    for (auto& arg : args) { argv.push_back(const_cast<char*>(arg.c_str())); }
+    argv.push_back(nullptr);
+
+    string envFd = string(ENV_FD) + "=" + to_string(sv[1]);
+    vector<char*> envp;
+    size_t prefix = strlen(ENV_FD) + 1;
+    for (char** env = environ; *env; env++) {
+        if (strncmp(*env, envFd.c_str(), prefix) != 0) { envp.push_back(*env); }
+    }
+    envp.push_back(const_cast<char*>(envFd.c_str()));
+    envp.push_back(nullptr);
+
+    struct rlimit rl = {0, 0};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    int maxFd = rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > 65536 ? 65536 : static_cast<int>(rl.rlim_cur);
+
+    // 调用线程(reactor)可能绑定了CPU，新进程从全部CPU开始重新分配
+    cpu_set_t allCpus;
+    memset(&allCpus, 0xff, sizeof(allCpus));
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (child == 0) {
+        // 子进程: 恢复信号屏蔽字(会被exec继承)，只保留通信套接字
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        sched_setaffinity(0, sizeof(allCpus), &allCpus);
+        Close_Fds_Except(sv[1], maxFd);
+        fcntl(sv[1], F_SETFD, 0);
+        if (strchr(argv[0], '/')) {
+            execve(argv[0], argv.data(), envp.data());
+        } else {
+            execvpe(argv[0], argv.data(), envp.data());
+        }
+        _exit(127);
+    }
+    close(sv[1]);
+    if (pid) { *pid = child; }
+    return sv[0];
+}
+
+// 新进程: 从环境变量取得与旧进程通信的套接字
+int Upgrade::Inherited_Fd() {
+    const char* env = getenv(ENV_FD);
+    if (!env) { return -1; }
+    int fd = atoi(env);
+    unsetenv(ENV_FD);
+    if (fd <= 2 || fcntl(fd, F_GETFD) < 0) { return -1; }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+bool Upgrade::Send_Fds(int sock, const vector<int>& fds) {
+    if (fds.empty() || fds.size() > MAX_FDS) { return false; }
+    char payload[sizeof(FDS_MAGIC) + sizeof(uint32_t)];
+    uint32_t count = fds.size();
+    memcpy(payload, FDS_MAGIC, sizeof(FDS_MAGIC));
+    memcpy(payload + sizeof(FDS_MAGIC), &count, sizeof(count));
+    struct iovec iov = { payload, sizeof(payload) };
+
+    vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()), 0);
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(payload));
+}
+
+bool Upgrade::Recv_Fds(int sock, vector<int>* fds) {
+    assert(fds);
+    // 旧进程fork后立即发送，最多等5秒
+    struct timeval tv = { 5, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char payload[sizeof(FDS_MAGIC) + sizeof(uint32_t)];
+    struct iovec iov = { payload, sizeof(payload) };
+    vector<char> control(CMSG_SPACE(sizeof(int) * MAX_FDS), 0);
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if (len != static_cast<ssize_t>(sizeof(payload)) || memcmp(payload, FDS_MAGIC, sizeof(FDS_MAGIC)) != 0) {
+        return false;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) { continue; }
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        fds->insert(fds->end(), data, data + n);
+    }
+    uint32_t count = 0;
+    memcpy(&count, payload + sizeof(FDS_MAGIC), sizeof(count));
+    return !fds->empty() && fds->size() == count;
+}
+
+// 新进程就绪(已预热、即将accept)后通知旧进程
+bool Upgrade::Notify_Ready(int sock) {
+    return send(sock, "R", 1, MSG_NOSIGNAL) == 1;
+}
+
+// 预热资源目录: 让内核提前把文件读进页缓存，返回预热的字节数
+size_t Upgrade::Warm_Files(const string& dir) {
+    size_t total = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) { return 0; }
+    while (struct dirent* ent = readdir(d)) {
+        if (ent->d_name[0] == '.') { continue; }
+        string path = dir + (dir.back() == '/' ? "" : "/") + ent->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0) { continue; }
+        if (S_ISDIR(st.st_mode)) {
+            total += Warm_Files(path);
+        } else if (S_ISREG(st.st_mode)) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) { continue; }
+            posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+            close(fd);
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+    return total;
+}
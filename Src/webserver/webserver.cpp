@@ -1,71 +1,212 @@
 #include "../include/webserver.h"
 #include <iostream>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <algorithm>
 using namespace std;
 
-WebServer::WebServer(int port, int trigMode, int timeout, int OptLinger, int threadNum, int connPoolNum,
-                    int sqlPort, const char* sqlUser, const  char* sqlPwd,
-                    const char* dbName)
-    : m_port(port), m_openLinger(OptLinger), m_timeout(timeout), m_isClose(false),
-    m_epoller(new Epoller()), m_timer(new HeapTimer()), m_threadpool(new ThreadPool(threadNum))
+WebServer::WebServer(const Config& cfg)
+    : m_openLinger(cfg.m_optLinger), m_timeout(cfg.m_timeout), m_isClose(false),
+    m_signalFd(-1), m_upgradeFd(-1), m_upgradePid(-1), m_acceptPaused(false),
+    m_wakeNs(0), m_cfg(cfg),
+    m_timer(new HeapTimer()), m_epoller(new Epoller())
 {
-    m_srcDir = getcwd(nullptr, 256);
-    assert(m_srcDir);
-    strncat(m_srcDir, "/resource/", 16);
+    // 信号要在创建线程(线程池、日志线程)之前屏蔽，线程继承屏蔽字，信号只从signalfd读出
+    if (!_Init_Signal()) {
+        m_isClose = true;
+    }
+
+    // 资源目录: 相对路径以当前工作目录为起点
+    std::string srcDir = cfg.m_root;
+    if (srcDir.empty() || srcDir[0] != '/') {
+        char* cwd = getcwd(nullptr, 0);
+        assert(cwd);
+        srcDir = std::string(cwd) + "/" + srcDir;
+        free(cwd);
+    }
+    if (srcDir.back() != '/') { srcDir += "/"; }
+    m_srcDir = strdup(srcDir.c_str());
     
     HttpConn::userCount = 0;
+    HttpConn::isDraining = false;
+    HttpConn::maxRequests = cfg.m_maxRequests;
+    HttpConn::keepAliveTimeout = m_timeout / 1000;
+    _Init_ConnLimit(cfg);
     HttpConn::srcDir = m_srcDir;
+    HttpConn::readBuffSize = cfg.m_readBuffSize;
+    HttpConn::writeBuffSize = cfg.m_writeBuffSize;
+    HttpConn::writeQuantum = cfg.m_writeQuantumKB * 1024;
+    HttpConn::writeQuantumUs = cfg.m_writeQuantumUs;
+    HttpConn::rateLimit = &m_rateLimit;
+    HttpRequest::maxBody = static_cast<size_t>(cfg.m_maxBodyKB) * 1024;
+    HttpRequest::spoolSize = static_cast<size_t>(cfg.m_spoolKB) * 1024;
+    HttpRequest::spoolDir = cfg.m_spoolDir;
+    Multipart::uploadDir = (!cfg.m_uploadDir.empty() && cfg.m_uploadDir[0] == '/') ? cfg.m_uploadDir : srcDir + cfg.m_uploadDir;
+    Http2Session::enabled = cfg.m_http2;
+    Http2Session::maxStreams = cfg.m_h2MaxStreams;
+    Http2Session::maxRequests = cfg.m_maxRequests;
+    HttpConn::hub = &m_hub;
+    WebSocket::path = cfg.m_wsPath;
+    WebSocket::maxMessage = cfg.m_wsMaxMessage;
+    WebSocket::maxQueue = cfg.m_wsQueueKB * 1024;
+
+    if (cfg.m_openLog) {
+        Log::Instance()->Init(cfg.m_logLevel, "./logs", cfg.m_logStagingKB * 1024);
+    }
+    Trace::Instance()->Init(cfg.m_traceSample);
+    m_overload.Init(cfg.m_overloadTargetMs, cfg.m_overloadIntervalMs);
+    m_rateLimit.Init(cfg);
+    m_acl.Load(cfg);
+    _Init_Routes();
+    _Init_Threads(cfg);
 
-    SqlConnPool::Instance()->Init("127.0.0.1", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    SqlConnPool::Instance()->Init(cfg.m_sqlHost.c_str(), cfg.m_sqlPort, cfg.m_sqlUser.c_str(),
+                                  cfg.m_sqlPwd.c_str(), cfg.m_dbName.c_str(), cfg.m_sqlPoolNum);
 
-    _Init_EventMode(trigMode);
-    if (!_Init_Socket()) {
+    _Init_EventMode(cfg.m_trigMode);
+    // 由旧进程升级启动时接管它的监听套接字，其余的自己创建
+    int upgradeFd = Upgrade::Inherited_Fd();
+    std::vector<int> inherited;
+    if (upgradeFd >= 0 && !Upgrade::Recv_Fds(upgradeFd, &inherited)) {
+        LOG_ERROR("upgrade: receive listen socket error!");
+        m_isClose = true;
+    } else if (!_Init_Listeners(inherited)) {
+        m_isClose = true;
+    }
+    if (m_signalFd >= 0 && !m_epoller->AddFd(m_signalFd, EPOLLIN)) {
+        m_isClose = true;
+    }
+    if (!m_hub.Init() || !m_epoller->AddFd(m_hub.Fd(), EPOLLIN)) {
+        LOG_ERROR("websocket: eventfd error!");
+        m_isClose = true;
+    }
+    if (!m_ioPool.Init(cfg.m_ioThreads) || (m_ioPool.Enabled() && !m_epoller->AddFd(m_ioPool.Fd(), EPOLLIN))) {
+        LOG_ERROR("io pool: eventfd error!");
         m_isClose = true;
     }
-	// 打印webserver服务器初始化信息
+    HttpConn::ioPool = m_ioPool.Enabled() ? &m_ioPool : nullptr;
+    m_nextStats = std::chrono::steady_clock::now();
+	// 记录webserver服务器初始化信息
     if (m_isClose) {
-        printf("========== Server Init Error ==========\n");
+        LOG_ERROR("========== Server Init Error ==========");
     } else {
-        printf("========== Server Init ==========\n");
-        printf("Port: %d, OpenLinger: %s\n", 
-               m_port, m_openLinger ? "true" : "false");
-        printf("ListenEvent: %s, ConnEvent: %s\n",
-               (m_listenEvent & EPOLLET ? "ET" : "LT"),
-               (m_connEvent & EPOLLET ? "ET" : "LT"));
-        printf("srcDir: %s\n", HttpConn::srcDir);
-        printf("ThreadPool Num: %d, SqlConnPool Num: %d\n\n",
-              threadNum, connPoolNum);
+        LOG_INFO("========== Server Init ==========");
+        std::string names;
+        for (auto& listener : m_listeners) { names += (names.empty() ? "" : ", ") + listener.Name(); }
+        LOG_INFO("Listen: %s, OpenLinger: %s",
+                 names.c_str(), m_openLinger ? "true" : "false");
+        LOG_INFO("ListenEvent: %s, ConnEvent: %s",
+                 (m_listenEvent & EPOLLET ? "ET" : "LT"),
+                 (m_connEvent & EPOLLET ? "ET" : "LT"));
+        LOG_INFO("LogLevel: %d, srcDir: %s", cfg.m_logLevel, HttpConn::srcDir);
+        LOG_INFO("ThreadPool Num: %d, SqlConnPool Num: %d, Backlog: %d",
+                 cfg.m_threadPoolNum, cfg.m_sqlPoolNum, cfg.m_backlog);
+        LOG_INFO("Max connections: %d, evict idle above: %d, max requests per connection: %d",
+                 m_maxConn, m_evictWater, cfg.m_maxRequests);
+        LOG_INFO("Write quantum: %dKB, %dus, cold read threads: %d", cfg.m_writeQuantumKB, cfg.m_writeQuantumUs, cfg.m_ioThreads);
+        LOG_INFO("Trace sample: %s", cfg.m_traceSample > 0 ? ("1/" + to_string(cfg.m_traceSample)).c_str() : "off");
+        LOG_INFO("Overload target: %dms, interval: %dms",
+                 cfg.m_overloadTargetMs, m_overload.IntervalMs());
+        if (!cfg.m_configFile.empty()) {
+            LOG_INFO("Config file: %s (SIGHUP to reload)", cfg.m_configFile.c_str());
+        }
+    }
+    // 先预热资源文件再通知旧进程，旧进程收到后停止accept
+    // 初始化失败时不通知，旧进程看到套接字关闭后继续服务
+    if (upgradeFd >= 0) {
+        if (!m_isClose) {
+            size_t bytes = Upgrade::Warm_Files(m_srcDir);
+            LOG_INFO("upgrade: warmed %zu bytes under %s", bytes, m_srcDir);
+            if (!Upgrade::Notify_Ready(upgradeFd)) {
+                LOG_ERROR("upgrade: notify old process error!");
+            }
+        }
+        close(upgradeFd);
     }
 }
 
 WebServer::~WebServer() {
-    close(m_listenFd);
+    for (auto& listener : m_listeners) { listener.Close(); }
+    if (m_upgradeFd >= 0) { close(m_upgradeFd); }
+    if (m_signalFd >= 0) { close(m_signalFd); }
     m_isClose = true;
+    // 先等工作线程退出(任务会访问连接、数据库连接池和日志)
+    _Shutdown_Conns();
+    m_threadpool.reset();
     free(m_srcDir);
-    SqlConnPool::Instance()->ClosePool();
+    // 关闭数据库连接要给服务器发消息，已经过了排空截止时间就不再关闭(进程退出时由内核关闭套接字)
+    if (HttpConn::isDraining && std::chrono::steady_clock::now() >= m_drainDeadline) {
+        LOG_WARN("drain deadline passed, skip closing sql pool");
+    } else {
+        SqlConnPool::Instance()->ClosePool();
+    }
+    Log::Instance()->Close();
 }
 
 void WebServer::Run() {
     int timeout = -1;
     if (!m_isClose) {
-        printf("========== Server Run ==========\n");
+        LOG_INFO("========== Server Run ==========");
     }
     while (!m_isClose) {
         if (m_timeout > 0) {
             timeout = m_timer->GetNextTick(); 
         }
+        // 排空期间定期检查连接是否都已结束
+        if (HttpConn::isDraining && (timeout < 0 || timeout > 100)) {
+            timeout = 100;
+        }
+        // 暂停accept期间定期检查是否恢复
+        if (m_acceptPaused && (timeout < 0 || timeout > m_overload.IntervalMs())) {
+            timeout = m_overload.IntervalMs();
+        }
+        // 有WebSocket订阅者时按时广播服务器状态
+        if (m_hub.Subscribers() > 0 && m_cfg.m_wsIntervalMs > 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(m_nextStats - std::chrono::steady_clock::now());
+            int ms = std::max(0, static_cast<int>(left.count()));
+            if (timeout < 0 || timeout > ms) { timeout = ms; }
+        }
         int nfd = m_epoller->Wait(timeout);
+        if (Trace::Instance()->Enabled()) { m_wakeNs = Trace::NowNs(); }
+        m_batchClosed.clear();
         for (int i = 0; i < nfd; ++i) {
             int fd = m_epoller->GetEventFd(i);
             uint32_t events = m_epoller->GetEvents(i);
             // 监听套接字事件， 有客户连接
-            if (fd == m_listenFd) {
-                _Deal_Listen();
+            Listener* listener = _Find_Listener(fd);
+            if (listener) {
+                _Deal_Listen(listener);
+            }
+            // 信号事件(signalfd)
+            else if (fd == m_signalFd) {
+                _Deal_Signal();
+            }
+            // 升级中新进程的通知
+            else if (fd == m_upgradeFd) {
+                _Deal_Upgrade();
+            }
+            // 有待广播的消息
+            else if (fd == m_hub.Fd()) {
+                _Deal_Hub();
+            }
+            // 冷文件读取完成
+            else if (fd == m_ioPool.Fd()) {
+                _Deal_Io();
+            }
+            // 本轮前面的事件(淘汰、排空)关闭了这个连接: 事件已经过期，fd可能已被本轮接收的新连接复用
+            else if (!m_batchClosed.empty() &&
+                     std::find(m_batchClosed.begin(), m_batchClosed.end(), fd) != m_batchClosed.end()) {
+                continue;
             }
             // 监听事件挂起或者出错
             else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 assert(m_users.count(fd) > 0);
                 _Close_Conn(&m_users[fd]);
             }
+            // WebSocket连接: 读写在同一个任务中处理
+            else if (m_users[fd].IsWebSocket()) {
+                _Deal_Ws(&m_users[fd]);
+            }
             // 监听读事件
             else if (events & EPOLLIN) {
                 assert(m_users.count(fd) > 0);
@@ -76,12 +217,43 @@ void WebServer::Run() {
                 assert(m_users.count(fd) > 0);
                 _Deal_Write(&m_users[fd]);
             } else {
-                printf("Unexpected event!\n");
+                LOG_ERROR("Unexpected event!");
             }
         }
+        if (m_overload.Enabled()) {
+            m_overload.Tick(Trace::NowNs());
+            _Update_Admission();
+        }
+        if (m_hub.Subscribers() > 0 && m_cfg.m_wsIntervalMs > 0 && std::chrono::steady_clock::now() >= m_nextStats) {
+            _Publish_Stats();
+        }
+        if (HttpConn::isDraining && _Check_Drain()) {
+            m_isClose = true;
+        }
+    }
+    // 排空结束: 剩余的连接不再等待，shutdown套接字让执行中的任务尽快结束，
+    // 在剩余的排空时间内等待工作线程和冷读取线程执行完已有任务，之后(析构中)join线程、关闭数据库连接池
+    // 截止时还有线程没退出(卡在数据库查询或磁盘上)时不再等待，直接退出进程: 析构连接对象会与这些线程冲突
+    if (HttpConn::isDraining) {
+        _Shutdown_Conns();
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(m_drainDeadline - std::chrono::steady_clock::now());
+        left = std::max(left, std::chrono::milliseconds(0));
+        if (!m_threadpool->Shutdown(left)) {
+            _Exit_Now("thread pool");
+        }
+        left = std::chrono::duration_cast<std::chrono::milliseconds>(m_drainDeadline - std::chrono::steady_clock::now());
+        if (!m_ioPool.Shutdown(std::max(left, std::chrono::milliseconds(0)))) {
+            _Exit_Now("io pool");
+        }
     }
 } 
 
+void WebServer::_Exit_Now(const char* what) {
+    LOG_WARN("%s did not stop before deadline, exit now", what);
+    Log::Instance()->Close();
+    _exit(1);
+}
+
 void WebServer::_Init_EventMode(int trigMode) {
     m_listenEvent = EPOLLRDHUP;
     m_connEvent = EPOLLONESHOT | EPOLLRDHUP;
@@ -110,80 +282,454 @@ void WebServer::_Init_EventMode(int trigMode) {
     HttpConn::isET = (m_connEvent & EPOLLET);
 }
 
-int WebServer::SetFdNonblock(int fd) {
-    assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+// 创建线程池，并按[cpu]配置绑定CPU:
+// 1. irq_iface: reactor放到网卡接收队列中断所在的CPU上(收包软中断和reactor共享缓存)，NUMA节点取该CPU所在节点
+// 2. numa_node: 线程只在该节点的CPU上运行，内存优先从该节点分配(连接缓冲区、日志/追踪的线程缓冲都是
+//    线程自己首次写入时分配，线程绑定后即为本节点内存)
+// 3. reactor / workers: 显式指定的CPU优先；工作线程按序号依次绑定列表中的一个CPU
+void WebServer::_Init_Threads(const Config& cfg) {
+    std::vector<int> allowed = Affinity::Allowed_Cpus();
+    std::vector<int> irqCpus;
+    int node = cfg.m_numaNode;
+    if (!cfg.m_irqIface.empty()) {
+        irqCpus = Affinity::Irq_Cpus(cfg.m_irqIface);
+        if (irqCpus.empty()) {
+            LOG_WARN("cpu: no rx irq found for %s", cfg.m_irqIface.c_str());
+        } else if (node < 0) {
+            node = Affinity::Cpu_Node(irqCpus[0]);
+        }
+    }
+    std::vector<int> nodeCpus;
+    if (node >= 0) {
+        for (int cpu : Affinity::Node_Cpus(node)) {
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) { nodeCpus.push_back(cpu); }
+        }
+        if (nodeCpus.empty()) {
+            LOG_WARN("cpu: numa node %d has no usable cpu, ignored", node);
+            node = -1;
+        } else if (!Affinity::Prefer_Node(node)) {
+            LOG_WARN("cpu: set_mempolicy for node %d error: %s", node, strerror(errno));
+        }
+    }
+
+    std::vector<int> reactorCpus;
+    if (cfg.m_reactorCpu >= 0) {
+        reactorCpus.push_back(cfg.m_reactorCpu);
+    } else if (!irqCpus.empty()) {
+        reactorCpus.push_back(irqCpus[0]);
+    } else {
+        reactorCpus = nodeCpus;
+    }
+
+    std::vector<int> workerCpus;
+    bool onePerWorker = false;
+    if (!cfg.m_workerCpus.empty()) {
+        if (Affinity::Parse_CpuList(cfg.m_workerCpus, &workerCpus)) {
+            onePerWorker = true;
+        } else {
+            LOG_WARN("cpu: bad worker cpu list \"%s\", ignored", cfg.m_workerCpus.c_str());
+        }
+    }
+    if (workerCpus.empty()) {
+        // 不指定时也要重新设置一次: 运行中扩容的线程由已绑定的reactor线程创建，会继承它的绑定
+        workerCpus = node >= 0 ? nodeCpus : allowed;
+    }
+    m_threadpool.reset(new ThreadPool(cfg.m_threadPoolNum, [workerCpus, onePerWorker](size_t index) {
+        if (onePerWorker) {
+            Affinity::Pin_Thread({workerCpus[index % workerCpus.size()]});
+        } else {
+            Affinity::Pin_Thread(workerCpus);
+        }
+    }));
+
+    if (!reactorCpus.empty() && !Affinity::Pin_Thread(reactorCpus)) {
+        LOG_WARN("cpu: pin reactor to %s error: %s", Affinity::To_CpuList(reactorCpus).c_str(), strerror(errno));
+    }
+    LOG_INFO("CPU: reactor %s, workers %s%s, numa node %d",
+             reactorCpus.empty() ? "any" : Affinity::To_CpuList(reactorCpus).c_str(),
+             Affinity::To_CpuList(workerCpus).c_str(), onePerWorker ? " (one each)" : "", node);
 }
 
-bool WebServer::_Init_Socket() {
-    int ret;
-    struct sockaddr_in addr;
-    if (m_port > 65535 || m_port < 1024) {
-        printf("Port:%d error!\n", m_port);
-        return false;
+// 连接数上限: 未配置时按描述符上限(RLIMIT_NOFILE)留出余量(日志、数据库连接等)
+// 连接数超过上限的evict_percent%时开始淘汰空闲连接
+void WebServer::_Init_ConnLimit(const Config& cfg) {
+    m_maxConn = cfg.m_maxConn;
+    if (m_maxConn <= 0) {
+        struct rlimit rl;
+        m_maxConn = MAX_FD;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+            int reserve = cfg.m_sqlPoolNum + 64;
+            m_maxConn = std::max(1, static_cast<int>(std::min<rlim_t>(rl.rlim_cur, MAX_FD)) - reserve);
+        }
     }
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(m_port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    m_maxConn = std::min(m_maxConn, static_cast<int>(MAX_FD));
+    int percent = (cfg.m_evictPercent > 0 && cfg.m_evictPercent <= 100) ? cfg.m_evictPercent : 100;
+    m_evictWater = std::max(1, static_cast<int>(static_cast<int64_t>(m_maxConn) * percent / 100));
+}
 
-    struct linger optLinger = {0};
-    if (m_openLinger) {
-        // 优雅关闭: 直到所剩数据发送完毕或超时
-        optLinger.l_onoff = 1;
-        optLinger.l_linger = 1;
+// 解析监听地址: 没有配置listen时监听port(双栈)
+bool WebServer::_Parse_Listeners(const Config& cfg, std::vector<Listener>* listeners) {
+    std::vector<std::string> specs = cfg.m_listen;
+    if (specs.empty()) { specs.push_back(to_string(cfg.m_port)); }
+    listeners->assign(specs.size(), Listener());
+    for (size_t i = 0; i < specs.size(); i++) {
+        if (!(*listeners)[i].Parse(specs[i], cfg)) {
+            LOG_ERROR("bad listen address \"%s\"", specs[i].c_str());
+            return false;
+        }
     }
+    return true;
+}
 
-    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_listenFd < 0) {
-        printf("socket error!\n");
-        return false;
+// 创建监听套接字并注册到epoll; 升级启动时先按地址接管旧进程交过来的套接字
+// 路由表: 页面的短路径、登录/注册表单和动态接口; 其余路径按静态文件处理
+// 处理函数在工作线程中执行，不能访问只属于reactor线程的状态
+void WebServer::_Init_Routes() {
+    Router* router = Router::Instance();
+    router->Add("", "/", Router::File("/index.html"));
+    for (const char* page : { "index", "register", "login", "welcome", "video", "picture" }) {
+        router->Add("", std::string("/") + page, Router::File(std::string("/") + page + ".html"));
+    }
+    // 表单提交到 login/register(页面的相对路径)，也兼容直接提交到.html
+    auto verify = [](bool isLogin) {
+        return [isLogin](const HttpRequest& request, const RouteParams&, Reply* reply) {
+            TraceSpan span(request.TraceId(), "user_verify", isLogin);
+            bool ok = HttpRequest::User_Verify(request.GetPost("username"), request.GetPost("password"), isLogin);
+            reply->File(ok ? "/welcome.html" : "/error.html");
+        };
+    };
+    for (const char* form : { "login", "register" }) {
+        bool isLogin = strcmp(form, "login") == 0;
+        router->Add("POST", std::string("/") + form, verify(isLogin));
+        router->Add("POST", std::string("/") + form + ".html", verify(isLogin));
+        router->Add("", std::string("/") + form + ".html", Router::File(std::string("/") + form + ".html"));
     }
+    router->Add("GET", "/api/stats", [this](const HttpRequest&, const RouteParams&, Reply* reply) {
+        reply->Json(_Stats_Json());
+    });
+    router->Compile();
+}
 
-    ret = setsockopt(m_listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
-    if (ret < 0) {
-        close(m_listenFd);
-        printf("setsockopt1 error!\n");
-        return false;
+bool WebServer::_Init_Listeners(const std::vector<int>& inherited) {
+    if (!_Parse_Listeners(m_cfg, &m_listeners)) { return false; }
+    std::vector<bool> used(inherited.size(), false);
+    bool ok = true;
+    for (auto& listener : m_listeners) {
+        bool adopted = false;
+        for (size_t i = 0; i < inherited.size() && !adopted; i++) {
+            if (used[i] || !listener.Matches(inherited[i])) { continue; }
+            used[i] = adopted = true;
+            if (!listener.Adopt(inherited[i])) {
+                close(inherited[i]);
+                return false;
+            }
+            LOG_INFO("upgrade: adopted listen socket %s (fd %d)", listener.Name().c_str(), listener.Fd());
+        }
+        if (!adopted && !listener.Open(m_openLinger)) {
+            ok = false;
+            break;
+        }
+        if (!m_epoller->AddFd(listener.Fd(), m_listenEvent | EPOLLIN)) {
+            LOG_ERROR("%s: add epoll error!", listener.Name().c_str());
+            ok = false;
+            break;
+        }
     }
-    // 设置端口复用
-    int val = 1;
-    ret = setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&val, sizeof(int));
-    if (ret < 0) {
-        close(m_listenFd);
-        printf("setsockopt2 error!\n");
-        return false;
+    // 新配置中已经没有的地址
+    for (size_t i = 0; i < inherited.size(); i++) {
+        if (used[i]) { continue; }
+        LOG_WARN("upgrade: inherited listen socket %d not in config, closed", inherited[i]);
+        close(inherited[i]);
+    }
+    return ok;
+}
+
+Listener* WebServer::_Find_Listener(int fd) {
+    for (auto& listener : m_listeners) {
+        if (listener.Fd() == fd) { return &listener; }
     }
-    // 绑定端口
-    ret = bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr));
-    if (ret < 0) {
-        printf("bind error!\n");
-        close(m_listenFd);
+    return nullptr;
+}
+
+// 屏蔽需要处理的信号，改由signalfd在epoll中统一处理
+// SIGHUP: 重新加载配置文件, SIGUSR1: 不停机升级, SIGUSR2: 导出请求追踪
+// SIGTERM/SIGINT: 优雅退出(再收到一次则立即退出)
+bool WebServer::_Init_Signal() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        LOG_ERROR("sigmask error!");
         return false;
     }
-    // 监听套接字 
-    ret = listen(m_listenFd, 10);
-    if (ret < 0) {
-        printf("listen error!\n");
-        close(m_listenFd);
-        return false; 
-    }
-    // 将监听套接字注册到epoll 
-    ret = m_epoller->AddFd(m_listenFd, m_listenEvent | EPOLLIN);
-    if (ret == 0) {
-        printf("m_listenFd Add epoll error!\n");
-        close(m_listenFd);
+    m_signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_signalFd < 0) {
+        LOG_ERROR("signalfd error!");
         return false;
     }
-    // 将监听套接字设置成非阻塞
-    SetFdNonblock(m_listenFd);
     return true;
 }
 
+// 处理信号事件
+void WebServer::_Deal_Signal() {
+    struct signalfd_siginfo info;
+    while (read(m_signalFd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGTERM || info.ssi_signo == SIGINT) {
+            if (HttpConn::isDraining) {
+                LOG_WARN("signal %d while draining, exit now", info.ssi_signo);
+                m_drainDeadline = std::chrono::steady_clock::now();
+                m_isClose = true;
+            } else {
+                _Start_Drain("shutdown");
+            }
+        }
+        else if (info.ssi_signo == SIGHUP) {
+            _Reload_Config();
+        }
+        else if (info.ssi_signo == SIGUSR1) {
+            _Start_Upgrade();
+        }
+        else if (info.ssi_signo == SIGUSR2) {
+            static int dumpCount = 0;
+            char path[256];
+            mkdir("./logs", 0777);
+            snprintf(path, sizeof(path), "./logs/trace_%d_%d.json", getpid(), ++dumpCount);
+            if (Trace::Instance()->Dump(path)) {
+                LOG_INFO("trace dumped to %s", path);
+            } else {
+                LOG_ERROR("trace dump to %s error!", path);
+            }
+        }
+    }
+}
+
+// 热加载配置: 只应用运行中可以安全修改的项，连接不受影响
+// 端口、触发模式、优雅关闭、资源目录、MySQL地址账号、日志开关需要重启才生效
+void WebServer::_Reload_Config() {
+    Config cfg = m_cfg;
+    if (!cfg.Reload()) {
+        LOG_ERROR("reload config %s error!", m_cfg.m_configFile.c_str());
+        return;
+    }
+    if (cfg.m_threadPoolNum != m_cfg.m_threadPoolNum && cfg.m_threadPoolNum > 0) {
+        m_threadpool->Resize(cfg.m_threadPoolNum);
+        LOG_INFO("reload: thread pool %d -> %d", m_cfg.m_threadPoolNum, cfg.m_threadPoolNum);
+    } else {
+        cfg.m_threadPoolNum = m_cfg.m_threadPoolNum;
+    }
+    if (cfg.m_sqlPoolNum != m_cfg.m_sqlPoolNum && cfg.m_sqlPoolNum > 0) {
+        // 新连接在工作线程中建立，不阻塞reactor
+        int grow = SqlConnPool::Instance()->Resize(cfg.m_sqlPoolNum);
+        if (grow > 0) {
+            m_threadpool->AddTask([grow] { SqlConnPool::Instance()->Grow(grow); });
+        }
+        LOG_INFO("reload: sql pool %d -> %d, opening %d connections", m_cfg.m_sqlPoolNum, cfg.m_sqlPoolNum, grow);
+    } else {
+        cfg.m_sqlPoolNum = m_cfg.m_sqlPoolNum;
+    }
+    // 超时时间只能在都开启定时器时修改(开关定时器需要给已有连接增删定时器)
+    if (cfg.m_timeout != m_timeout) {
+        if (cfg.m_timeout > 0 && m_timeout > 0) {
+            LOG_INFO("reload: timeout %d -> %d", m_timeout, cfg.m_timeout);
+            m_timeout = cfg.m_timeout;
+            HttpConn::keepAliveTimeout = m_timeout / 1000;
+        } else {
+            LOG_WARN("reload: enabling or disabling timeout needs restart");
+            cfg.m_timeout = m_timeout;
+        }
+    }
+    // 监听地址不变时修改各监听套接字的backlog和选项(增删地址需要重启)
+    std::vector<Listener> listeners;
+    bool sameListen = (cfg.m_listen == m_cfg.m_listen && (!cfg.m_listen.empty() || cfg.m_port == m_cfg.m_port));
+    if (sameListen && _Parse_Listeners(cfg, &listeners) && listeners.size() == m_listeners.size()) {
+        for (size_t i = 0; i < listeners.size(); i++) {
+            if (m_listeners[i].Fd() >= 0) { m_listeners[i].Update(listeners[i]); }
+        }
+    }
+    if (cfg.m_readBuffSize > 0 && cfg.m_writeBuffSize > 0) {
+        HttpConn::readBuffSize = cfg.m_readBuffSize;
+        HttpConn::writeBuffSize = cfg.m_writeBuffSize;
+    }
+    HttpConn::maxRequests = cfg.m_maxRequests;
+    HttpConn::writeQuantum = cfg.m_writeQuantumKB * 1024;
+    HttpConn::writeQuantumUs = cfg.m_writeQuantumUs;
+    HttpRequest::maxBody = static_cast<size_t>(cfg.m_maxBodyKB) * 1024;
+    HttpRequest::spoolSize = static_cast<size_t>(cfg.m_spoolKB) * 1024;
+    Http2Session::enabled = cfg.m_http2;
+    Http2Session::maxStreams = cfg.m_h2MaxStreams;
+    Http2Session::maxRequests = cfg.m_maxRequests;
+    WebSocket::maxMessage = cfg.m_wsMaxMessage;
+    WebSocket::maxQueue = cfg.m_wsQueueKB * 1024;
+    if (cfg.m_maxConn != m_cfg.m_maxConn || cfg.m_evictPercent != m_cfg.m_evictPercent) {
+        _Init_ConnLimit(cfg);
+        LOG_INFO("reload: max connections %d, evict idle above %d", m_maxConn, m_evictWater);
+    }
+    Log::Instance()->SetLevel(cfg.m_logLevel);
+    Trace::Instance()->Init(cfg.m_traceSample);
+    m_overload.Init(cfg.m_overloadTargetMs, cfg.m_overloadIntervalMs);
+    m_rateLimit.Init(cfg);
+    // 列表可能很大，在工作线程中编译，编译好后reactor下次accept时替换
+    m_threadpool->AddTask([this, cfg] { m_acl.Load(cfg); });
+
+    if (cfg.m_port != m_cfg.m_port || cfg.m_listen != m_cfg.m_listen || cfg.m_trigMode != m_cfg.m_trigMode ||
+        cfg.m_optLinger != m_cfg.m_optLinger || cfg.m_root != m_cfg.m_root ||
+        cfg.m_sqlHost != m_cfg.m_sqlHost || cfg.m_sqlPort != m_cfg.m_sqlPort ||
+        cfg.m_sqlUser != m_cfg.m_sqlUser || cfg.m_sqlPwd != m_cfg.m_sqlPwd ||
+        cfg.m_dbName != m_cfg.m_dbName || cfg.m_openLog != m_cfg.m_openLog ||
+        cfg.m_logStagingKB != m_cfg.m_logStagingKB || cfg.m_reactorCpu != m_cfg.m_reactorCpu ||
+        cfg.m_workerCpus != m_cfg.m_workerCpus || cfg.m_numaNode != m_cfg.m_numaNode ||
+        cfg.m_irqIface != m_cfg.m_irqIface || cfg.m_wsPath != m_cfg.m_wsPath || cfg.m_spoolDir != m_cfg.m_spoolDir ||
+        cfg.m_uploadDir != m_cfg.m_uploadDir) {
+        LOG_WARN("reload: port/listen/trig_mode/opt_linger/root/spool_dir/upload_dir/mysql/log open/cpu/websocket path settings need restart, ignored");
+        cfg.m_port = m_cfg.m_port;
+        cfg.m_listen = m_cfg.m_listen;
+        cfg.m_trigMode = m_cfg.m_trigMode;
+        cfg.m_optLinger = m_cfg.m_optLinger;
+        cfg.m_root = m_cfg.m_root;
+        cfg.m_sqlHost = m_cfg.m_sqlHost;
+        cfg.m_sqlPort = m_cfg.m_sqlPort;
+        cfg.m_sqlUser = m_cfg.m_sqlUser;
+        cfg.m_sqlPwd = m_cfg.m_sqlPwd;
+        cfg.m_dbName = m_cfg.m_dbName;
+        cfg.m_openLog = m_cfg.m_openLog;
+        cfg.m_logStagingKB = m_cfg.m_logStagingKB;
+        cfg.m_reactorCpu = m_cfg.m_reactorCpu;
+        cfg.m_workerCpus = m_cfg.m_workerCpus;
+        cfg.m_numaNode = m_cfg.m_numaNode;
+        cfg.m_irqIface = m_cfg.m_irqIface;
+        cfg.m_wsPath = m_cfg.m_wsPath;
+        cfg.m_spoolDir = m_cfg.m_spoolDir;
+        cfg.m_uploadDir = m_cfg.m_uploadDir;
+    }
+    m_cfg = cfg;
+    LOG_INFO("config %s reloaded", m_cfg.m_configFile.c_str());
+}
+
+// 不停机升级: 用原来的命令行参数启动新的可执行文件，把所有监听套接字交给它
+void WebServer::_Start_Upgrade() {
+    if (m_upgradeFd >= 0 || HttpConn::isDraining) {
+        LOG_WARN("upgrade: already in progress, ignored");
+        return;
+    }
+    m_upgradeFd = Upgrade::Spawn(m_cfg.Args(), &m_upgradePid);
+    if (m_upgradeFd < 0) {
+        LOG_ERROR("upgrade: spawn %s error!", m_cfg.Args().empty() ? "" : m_cfg.Args()[0].c_str());
+        return;
+    }
+    std::vector<int> fds;
+    for (auto& listener : m_listeners) { fds.push_back(listener.Fd()); }
+    if (!Upgrade::Send_Fds(m_upgradeFd, fds) ||
+        !m_epoller->AddFd(m_upgradeFd, EPOLLIN | EPOLLRDHUP)) {
+        LOG_ERROR("upgrade: send listen socket to process %d error!", m_upgradePid);
+        close(m_upgradeFd);
+        m_upgradeFd = -1;
+        return;
+    }
+    LOG_INFO("upgrade: started process %d, waiting for ready", m_upgradePid);
+}
+
+// 新进程就绪则开始排空；新进程退出(套接字关闭)则放弃升级继续服务
+void WebServer::_Deal_Upgrade() {
+    char ready = 0;
+    ssize_t len = read(m_upgradeFd, &ready, 1);
+    m_epoller->DelFd(m_upgradeFd);
+    close(m_upgradeFd);
+    m_upgradeFd = -1;
+    if (len == 1 && ready == 'R') {
+        LOG_INFO("upgrade: process %d ready", m_upgradePid);
+        // Unix套接字文件已由新进程使用，本进程退出时不能删除
+        for (auto& listener : m_listeners) { listener.Release_Path(); }
+        _Start_Drain("upgrade");
+    } else {
+        int status = 0;
+        waitpid(m_upgradePid, &status, WNOHANG);
+        LOG_ERROR("upgrade: process %d failed, keep serving", m_upgradePid);
+    }
+}
+
+// 停止accept(升级时新连接由新进程接收)，关闭空闲连接，正在处理的连接完成当前响应后关闭
+void WebServer::_Start_Drain(const char* reason) {
+    if (HttpConn::isDraining) { return; }
+    HttpConn::isDraining = true;
+    m_drainDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_cfg.m_drainTimeout);
+    for (auto& listener : m_listeners) {
+        if (listener.Fd() < 0) { continue; }
+        // 先接收全连接队列中已完成握手的连接，否则关闭监听套接字时它们会被内核重置
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        int fd;
+        while (HttpConn::userCount < m_maxConn &&
+               (fd = accept4(listener.Fd(), (struct sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            if (m_acl.Allow((struct sockaddr*)&addr)) {
+                _Add_Client(fd, addr);
+            } else {
+                close(fd);
+            }
+            len = sizeof(addr);
+        }
+        m_epoller->DelFd(listener.Fd());
+        listener.Close();
+    }
+    // WebSocket连接发送关闭帧，完成关闭握手后关闭
+    m_hub.Close_All(1001, [this](HttpConn* client) { _Arm_Ws(client); });
+    int idle = 0;
+    for (auto& user : m_users) {
+        if (user.second.IsWebSocket() || !user.second.ClaimIdle()) { continue; }
+        // 已经收到请求数据(还没分发)的连接留给reactor处理，响应后再关闭
+        char c;
+        if (recv(user.second.GetFd(), &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0) {
+            user.second.SetIdle(true);
+            continue;
+        }
+        _Close_Idle(&user.second);
+        idle++;
+    }
+    LOG_INFO("%s: draining, closed %d idle connections, %d in flight",
+             reason, idle, static_cast<int>(HttpConn::userCount));
+}
+
+// 所有连接结束或超过排空时间时返回true
+bool WebServer::_Check_Drain() {
+    if (HttpConn::userCount <= 0) {
+        LOG_INFO("drained, exit");
+        return true;
+    }
+    if (std::chrono::steady_clock::now() >= m_drainDeadline) {
+        LOG_WARN("drain timeout, exit with %d connections", static_cast<int>(HttpConn::userCount));
+        return true;
+    }
+    return false;
+}
+
+// shutdown剩余连接的套接字(不关闭fd，执行中和排队的任务仍可以访问)，任务的读写立即出错结束
+void WebServer::_Shutdown_Conns() {
+    for (auto& user : m_users) {
+        if (!user.second.IsClosed()) { shutdown(user.second.GetFd(), SHUT_RDWR); }
+    }
+}
+
+// 过载时暂停accept: 把监听套接字从epoll的读事件中去掉，新连接留在内核的全连接队列里
+// 退出过载后恢复(EPOLL_CTL_MOD会重新检查就绪状态，队列中已有的连接会立即触发)
+void WebServer::_Update_Admission() {
+    bool overloaded = m_overload.IsOverloaded();
+    if (overloaded == m_acceptPaused) { return; }
+    m_acceptPaused = overloaded;
+    for (auto& listener : m_listeners) {
+        if (listener.Fd() < 0) { continue; }
+        m_epoller->ModFd(listener.Fd(), overloaded ? m_listenEvent : (m_listenEvent | EPOLLIN));
+    }
+    LOG_INFO("overload: accept %s", overloaded ? "paused" : "resumed");
+}
+
 void WebServer::_Send_Error(int fd, const char*info) {
 	assert(fd > 0);
     int ret = send(fd, info, strlen(info), 0);
     if(ret < 0) {
-        printf("send error to client[%d] error!", fd);
+        LOG_WARN("send error to client[%d] error!", fd);
     }
     close(fd); 
 }
@@ -191,51 +737,205 @@ void WebServer::_Send_Error(int fd, const char*info) {
 // 关闭客户连接 (定时器用回调函数关闭)
 void WebServer::_Close_Conn(HttpConn* client) {
     assert(client);
+    client->EndTask();
     m_epoller->DelFd(client->GetFd());
     client->Close();
 }
 
-// 添加客户连接（初始化客户的fd和addr, 给客户加上定时器，把客户注册到epoll）
-void WebServer::_Add_Client(int fd, sockaddr_in addr) {
+// reactor线程关闭空闲连接(淘汰、排空): 连接仍注册在epoll中，本轮已经取出的事件要跳过
+void WebServer::_Close_Idle(HttpConn* client) {
+    m_batchClosed.push_back(client->GetFd());
+    _Close_Conn(client);
+}
+
+// 添加客户连接（初始化客户的fd和addr, 给客户加上定时器，把客户注册到epoll; fd由accept4设置为非阻塞）
+void WebServer::_Add_Client(int fd, const sockaddr_storage& addr) {
     assert(fd > 0);
     m_users[fd].init(fd, addr);     // 初始化客户的fd 和 addr
+    _Touch(&m_users[fd]);
     // 给客户加上定时器
     if (m_timeout > 0) {
         m_timer->add(fd, m_timeout, std::bind(&WebServer::_Close_Conn, this, &m_users[fd]));
     }
     m_epoller->AddFd(fd, EPOLLIN | m_connEvent);
-    SetFdNonblock(fd);
 }
 
 // 处理客户连接事件
-void WebServer::_Deal_Listen() {
-	struct sockaddr_in cli_addr;
-	socklen_t len = sizeof(cli_addr);
-	do {
-        // 接受一个客户连接
-		int fd = accept(m_listenFd, (struct sockaddr *)&cli_addr, &len);
-        if (fd < 0) { return ; }
-        else if (HttpConn::userCount >= MAX_FD) {
-            _Send_Error(fd, "Server busy!\n");
-            printf("client is full!\n");
+void WebServer::_Deal_Listen(Listener* listener) {
+	struct sockaddr_storage cli_addr;
+	socklen_t len;
+    // 每次唤醒最多接收accept_batch个连接，避免连接风暴时reactor长时间不处理已有连接的读写
+    int batch = m_cfg.m_acceptBatch > 0 ? m_cfg.m_acceptBatch : 1;
+	for (int i = 0; i < batch; i++) {
+        // 接受一个客户连接(直接得到非阻塞、exec时关闭的fd，省去两次fcntl)
+        len = sizeof(cli_addr);
+		int fd = accept4(listener->Fd(), (struct sockaddr *)&cli_addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // 描述符耗尽: 淘汰空闲连接腾出描述符，跳出循环重新注册，队列中的连接下次事件再接收
+            // (边沿触发时不重新注册就不会再有事件，直到有新的连接到达)
+            if (errno == EMFILE || errno == ENFILE) {
+                LOG_WARN("accept: %s, %d connections", strerror(errno), static_cast<int>(HttpConn::userCount));
+                _Evict_Idle(HttpConn::userCount - 1);
+                break;
+            }
             return ;
         }
+        // 访问控制: 被拒绝的地址直接关闭，不分配任何连接资源
+        if (!m_acl.Allow((struct sockaddr*)&cli_addr)) {
+            close(fd);
+            continue ;
+        }
+        // 超过高水位: 先关闭最久没有活动的空闲长连接(多淘汰一些，避免每次accept都淘汰)
+        if (HttpConn::userCount >= m_evictWater) {
+            _Evict_Idle(m_evictWater - std::max(1, m_evictWater / 32));
+        }
+        if (HttpConn::userCount >= m_maxConn) {
+            _Send_Error(fd, HttpResponse::Unavailable_Text(m_cfg.m_retryAfter).c_str());
+            LOG_WARN("client is full!");
+            continue ;
+        }
+        // 该IP新建连接太快: 回复429后关闭
+        if (!m_rateLimit.Allow_Conn((struct sockaddr*)&cli_addr, Trace::NowNs())) {
+            _Send_Error(fd, HttpResponse::TooMany_Text().c_str());
+            continue ;
+        }
         _Add_Client(fd, cli_addr);
-	} while (m_listenEvent & EPOLLET); // 边沿触发的话需要循环
+	}
+    // 达到批量上限或描述符耗尽而队列里可能还有连接: 边沿触发时重新注册，让epoll再报告一次就绪
+    if (m_listenEvent & EPOLLET) {
+        m_epoller->ModFd(listener->Fd(), m_listenEvent | EPOLLIN);
+    }
+}
+
+// 把连接移到活动链表尾部(最近活动)，只在reactor线程调用
+void WebServer::_Touch(HttpConn* client) {
+    if (client->inLru) {
+        m_lru.splice(m_lru.end(), m_lru, client->lruPos);
+    } else {
+        client->lruPos = m_lru.insert(m_lru.end(), client);
+        client->inLru = true;
+    }
+}
+
+// 从最久没有活动的连接开始，关闭空闲连接直到连接数不超过target
+// 正在处理请求的连接跳过；已关闭的连接顺便移出链表
+void WebServer::_Evict_Idle(int target) {
+    int evicted = 0;
+    auto it = m_lru.begin();
+    while (it != m_lru.end() && HttpConn::userCount > target) {
+        HttpConn* client = *it;
+        if (client->ClaimIdle()) {
+            _Close_Idle(client);
+            evicted++;
+        } else if (!client->IsClosed()) {
+            ++it;
+            continue;
+        }
+        client->inLru = false;
+        it = m_lru.erase(it);
+    }
+    if (evicted > 0) {
+        LOG_INFO("evicted %d idle connections, %d left", evicted, static_cast<int>(HttpConn::userCount));
+    }
 }
 
 // 处理客户读事件
 void WebServer::_Deal_Read(HttpConn* client) {
     assert(client);
+    client->SetIdle(false);
     _Extent_Time(client);   // 重新调整时间
-    m_threadpool->AddTask(std::bind(&WebServer::_Thread_Read, this, client));
+    _Touch(client);
+    // 新请求到达，决定是否采样追踪
+    uint64_t id = Trace::Instance()->Sample();
+    client->SetTraceId(id);
+    Trace::Instance()->Instant(id, "epoll_wakeup", m_wakeNs, client->GetFd());
+    uint64_t enqueue = Trace::NowNs();
+    m_threadpool->AddTask([this, client, id, enqueue] {
+        uint64_t sojourn = _Dequeued(id, enqueue);
+        client->BeginTask(enqueue + sojourn);
+        _Thread_Read(client, sojourn);
+    });
 }
 
 
 void WebServer::_Deal_Write(HttpConn* client) {
     assert(client);
     _Extent_Time(client);   // 重新调整时间
-    m_threadpool->AddTask(std::bind(&WebServer::_Thread_Write, this, client));
+    _Touch(client);
+    uint64_t id = client->GetTraceId();
+    Trace::Instance()->Instant(id, "epoll_wakeup", m_wakeNs, client->GetFd());
+    uint64_t enqueue = Trace::NowNs();
+    m_threadpool->AddTask([this, client, id, enqueue] {
+        client->BeginTask(enqueue + _Dequeued(id, enqueue));
+        _Thread_Write(client);
+    });
+}
+
+// WebSocket连接的事件(读、写或广播唤醒): 在工作线程中读帧、处理并发送队列
+void WebServer::_Deal_Ws(HttpConn* client) {
+    assert(client);
+    client->SetIdle(false);
+    _Extent_Time(client);
+    _Touch(client);
+    client->Ws()->SetBusy();
+    uint64_t enqueue = Trace::NowNs();
+    m_threadpool->AddTask([this, client, enqueue] {
+        client->BeginTask(enqueue + _Dequeued(0, enqueue));
+        _Thread_Ws(client);
+    });
+}
+
+// 把待广播的帧放进各订阅者的队列，空闲的连接注册EPOLLOUT
+void WebServer::_Deal_Hub() {
+    m_hub.Flush([this](HttpConn* client) { _Arm_Ws(client); });
+}
+
+// 冷读取完成的连接继续发送; 读取期间连接可能已被定时器关闭，fd甚至已被新连接复用(关闭和接收都在reactor线程，这里的检查没有竞争)
+void WebServer::_Deal_Io() {
+    m_ioPool.Drain([this](HttpConn* client, uint64_t gen) {
+        if (client->IsClosed() || client->Gen() != gen) { return; }
+        m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLOUT);
+    });
+}
+
+void WebServer::_Arm_Ws(HttpConn* client) {
+    m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLIN | EPOLLOUT);
+}
+
+// 服务器状态(JSON)，所有订阅者共享同一个帧
+void WebServer::_Publish_Stats() {
+    m_hub.Publish(_Stats_Json());
+    m_nextStats = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_cfg.m_wsIntervalMs);
+}
+
+// 服务器状态(JSON): WebSocket广播和 GET /api/stats 共用，只读原子变量，任何线程都可以调用
+std::string WebServer::_Stats_Json() {
+    char text[384];
+    snprintf(text, sizeof(text),
+             "{\"time\":%ld,\"connections\":%d,\"subscribers\":%zu,\"overloaded\":%s,\"draining\":%s,\"arena_blocks\":%llu,"
+             "\"worker_hold_ms\":%llu,\"worker_hold_max_us\":%llu,\"write_yields\":%llu,\"cold_reads\":%llu}",
+             static_cast<long>(time(nullptr)), static_cast<int>(HttpConn::userCount), m_hub.Subscribers(),
+             m_overload.IsOverloaded() ? "true" : "false", HttpConn::isDraining ? "true" : "false",
+             static_cast<unsigned long long>(Arena::heapAllocs.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(HttpConn::holdNs.load(std::memory_order_relaxed) / 1000000),
+             static_cast<unsigned long long>(HttpConn::holdMaxNs.load(std::memory_order_relaxed) / 1000),
+             static_cast<unsigned long long>(HttpConn::writeYields.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(IoPool::coldReads.load(std::memory_order_relaxed)));
+    return text;
+}
+
+// 任务被工作线程取出: 记录排队时间(过载检测和追踪)，返回排队时间(ns)
+uint64_t WebServer::_Dequeued(uint64_t id, uint64_t enqueueNs) {
+    uint64_t now = Trace::NowNs();
+    m_overload.Observe(now - enqueueNs, now);
+    Trace::Instance()->Span(id, "queue_wait", enqueueNs, now);
+    return now - enqueueNs;
+}
+
+// 工作线程交还连接: 结束占用计时，重新注册事件(之后连接可能立即被另一个工作线程处理)
+void WebServer::_Rearm(HttpConn* client, uint32_t events) {
+    client->EndTask();
+    m_epoller->ModFd(client->GetFd(), m_connEvent | events);
 }
 
 // 调整定时器时间 
@@ -245,15 +945,25 @@ void WebServer::_Extent_Time(HttpConn* client) {
 }
 
 // 线程的客户读任务
-void WebServer::_Thread_Read(HttpConn* client) {
+void WebServer::_Thread_Read(HttpConn* client, uint64_t sojournNs) {
     assert(client);
     int ret = -1;
     int readError = 0;
-    ret = client->read(&readError);
+    {
+        TraceSpan span(client->GetTraceId(), "read");
+        ret = client->read(&readError);
+        span.SetArg(ret);
+    }
     if (ret <= 0 && readError != EAGAIN) {
         _Close_Conn(client);
         return ;
     }
+    // 过载且本请求排队太久: 不再处理，回复503
+    if (m_overload.ShouldShed(sojournNs) && client->Shed(m_cfg.m_retryAfter)) {
+        m_overload.CountShed();
+        _Rearm(client, EPOLLOUT);
+        return ;
+    }
     _On_Process(client); // 处理请求
 }
 
@@ -265,26 +975,97 @@ void WebServer::_Thread_Write(HttpConn* client) {
     ret = client->write(&writeErrno);
     if (client->ToWriteBytes() == 0) {
         // 传输完成
-        if (client->IsKeepAlive()) {
+        client->LogAccess();
+        // 101已发送，开始处理帧和广播
+        if (client->IsWebSocket()) {
+            _Thread_Ws(client);
+            return ;
+        }
+        // 100 Continue发送完时请求还在接收中(第一个请求的响应还没有初始化，不看长连接标记)
+        if (client->IsKeepAlive() || client->InRequest()) {
             _On_Process(client); // 处理响应
             return ;
         }
+    } else if (ret < 0 && writeErrno == EINPROGRESS) {
+        // 文件页不在页缓存中: 交给冷读取线程池，读完后reactor重新注册EPOLLOUT
+        client->EndTask();
+        if (!client->Read_Cold()) { _Rearm(client, EPOLLOUT); }
+        return ;
+    } else if (ret > 0) {
+        // 用完写配额: 让出工作线程，套接字仍然可写，reactor马上再次派发，排在已经在等的任务后面
+        Trace::Instance()->Instant(client->GetTraceId(), "yield", Trace::NowNs(), client->GetFd());
+        _Rearm(client, EPOLLOUT);
+        return ;
     } else if (ret < 0) {
         if (writeErrno == EAGAIN) {
             // 继续传输 
-            m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLOUT);
+            Trace::Instance()->Instant(client->GetTraceId(), "rearm_out", Trace::NowNs(), client->GetFd());
+            _Rearm(client, EPOLLOUT);
             return ;
         }
     }
     _Close_Conn(client);
 }
 
+// WebSocket连接: 读取并处理帧，发送队列中的帧; 关闭握手完成或出错时关闭连接
+// 结束时在WebSocket的锁内重新注册事件(有积压时加上EPOLLOUT)，与reactor放入广播互斥
+void WebServer::_Thread_Ws(HttpConn* client) {
+    assert(client);
+    // 101响应还没有发送完
+    if (client->ToWriteBytes() > 0) {
+        _Thread_Write(client);
+        return ;
+    }
+    int err = 0;
+    ssize_t ret = client->read(&err);
+    if (ret == 0 || (ret < 0 && err != EAGAIN)) {
+        _Close_Conn(client);
+        return ;
+    }
+    client->process();
+    if (client->write(&err) < 0 && err != EAGAIN) {
+        _Close_Conn(client);
+        return ;
+    }
+    if (client->Ws()->Finished()) {
+        _Close_Conn(client);
+        return ;
+    }
+    client->EndTask();
+    client->SetIdle(true);
+    client->Ws()->Release([this, client](bool out) {
+        m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLIN | (out ? EPOLLOUT : 0));
+    });
+}
+
 void WebServer::_On_Process(HttpConn* client) {
+    // 限速检查在解析请求之前(不访问数据库)，长连接上缓冲的后续请求也会经过这里
+    const char* path;
+    size_t len;
+    if (m_rateLimit.Enabled() && client->PeekPath(&path, &len) &&
+        !m_rateLimit.Allow_Request(client->GetAddr(), path, len, Trace::NowNs()) &&
+        client->Throttle()) {
+        _Rearm(client, EPOLLOUT);
+        return ;
+    }
     // 如果客户请求 处理成功，那么将该客户从监听读事件改成监听写事件
+    uint64_t id = client->GetTraceId();
     if (client->process()) {
-        m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLOUT);
+        Trace::Instance()->Instant(id, "rearm_out", Trace::NowNs(), client->GetFd());
+        _Rearm(client, EPOLLOUT);
+    } else if (client->InRequest()) {
+        // 请求还没收完(比如正在上传)或HTTP/2连接上还有流在等待请求体、发送窗口: 不算空闲，不被淘汰，排空时也等它结束
+        _Rearm(client, EPOLLIN);
     } else {
-        m_epoller->ModFd(client->GetFd(), m_connEvent | EPOLLIN);
+        // 没有待处理的请求，连接空闲; 排空期间直接关闭(与reactor竞争时由取得空闲标记的一方关闭)
+        client->EndTask();
+        client->SetIdle(true);
+        if (HttpConn::isDraining) {
+            if (client->ClaimIdle()) { _Close_Conn(client); }
+            return;
+        }
+        Trace::Instance()->Instant(id, "rearm_in", Trace::NowNs(), client->GetFd());
+        _Rearm(client, EPOLLIN);
     }
 }
 
@@ -0,0 +1,425 @@
+#include "../include/websocket.h"
+#include "../include/httpconn.h"
+#include "../include/log.h"
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+std::string WebSocket::path = "/live";
+std::atomic<int> WebSocket::maxMessage(65536);
+std::atomic<int> WebSocket::maxQueue(1 << 20);
+
+static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// SHA-1(握手只用来计算Sec-WebSocket-Accept)
+static void Sha1(const string& text, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    string msg = text;
+    uint64_t bits = static_cast<uint64_t>(text.size()) * 8;
+    msg.push_back(static_cast<char>(0x80));
+    while (msg.size() % 64 != 56) { msg.push_back(0); }
+    for (int i = 7; i >= 0; i--) { msg.push_back(static_cast<char>(bits >> (i * 8))); }
+
+    auto rol = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+    for (size_t off = 0; off < msg.size(); off += 64) {
+        uint32_t w[80];
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.data() + off);
+        for (int i = 0; i < 16; i++) {
+            w[i] = (static_cast<uint32_t>(p[i * 4]) << 24) | (p[i * 4 + 1] << 16) | (p[i * 4 + 2] << 8) | p[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++) { w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1); }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) { digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8)); }
+}
+
+static string Base64(const uint8_t* data, size_t len) {
+    static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) { v |= data[i + 1] << 8; }
+        if (i + 2 < len) { v |= data[i + 2]; }
+        out.push_back(TABLE[(v >> 18) & 63]);
+        out.push_back(TABLE[(v >> 12) & 63]);
+        out.push_back(i + 1 < len ? TABLE[(v >> 6) & 63] : '=');
+        out.push_back(i + 2 < len ? TABLE[v & 63] : '=');
+    }
+    return out;
+}
+
+WebSocket::WebSocket()
+    : m_offset(0), m_queued(0), m_busy(true), m_outArmed(false), m_state(OPEN), m_dropped(0), m_fragOpcode(0) {}
+
+void WebSocket::Handshake(const HttpRequest& request, Buffer& out) {
+    uint8_t digest[20];
+    Sha1(request.GetHeader("Sec-WebSocket-Key") + GUID, digest);
+    out.Append("HTTP/1.1 101 Switching Protocols\r\n"
+               "Upgrade: websocket\r\n"
+               "Connection: Upgrade\r\n"
+               "Sec-WebSocket-Accept: " + Base64(digest, sizeof(digest)) + "\r\n\r\n");
+}
+
+shared_ptr<const string> WebSocket::Frame(int opcode, const char* data, size_t len) {
+    shared_ptr<string> frame = make_shared<string>();
+    frame->reserve(len + 10);
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if (len < 126) {
+        frame->push_back(static_cast<char>(len));
+    } else if (len <= 0xffff) {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(len >> 8));
+        frame->push_back(static_cast<char>(len));
+    } else {
+        frame->push_back(127);
+        for (int i = 7; i >= 0; i--) { frame->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8))); }
+    }
+    frame->append(data, len);
+    return frame;
+}
+
+shared_ptr<const string> WebSocket::Close_Frame(uint16_t code) {
+    char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code) };
+    return Frame(CLOSE, payload, sizeof(payload));
+}
+
+void WebSocket::Unmask(uint8_t* data, size_t len, const uint8_t key[4]) {
+    uint32_t k32;
+    memcpy(&k32, key, 4);
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i k256 = _mm256_set1_epi32(static_cast<int>(k32));
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_xor_si256(v, k256));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i k128 = _mm_set1_epi32(static_cast<int>(k32));
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(v, k128));
+    }
+#endif
+    // 上面每次处理4的倍数个字节，剩余部分的掩码仍从key[0]开始
+    uint64_t k64 = (static_cast<uint64_t>(k32) << 32) | k32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= k64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; i++) { data[i] ^= key[i & 3]; }
+}
+
+bool WebSocket::Valid_Utf8(const uint8_t* data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        // ASCII一次检查8字节
+        if (i + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, data + i, 8);
+            if (!(v & 0x8080808080808080ull)) {
+                i += 8;
+                continue;
+            }
+        }
+        uint8_t c = data[i];
+        if (c < 0x80) { i++; continue; }
+        int n;
+        uint32_t cp;
+        if ((c & 0xe0) == 0xc0) { n = 1; cp = c & 0x1f; }
+        else if ((c & 0xf0) == 0xe0) { n = 2; cp = c & 0x0f; }
+        else if ((c & 0xf8) == 0xf0) { n = 3; cp = c & 0x07; }
+        else { return false; }
+        if (i + n >= len) { return false; }
+        for (int j = 1; j <= n; j++) {
+            if ((data[i + j] & 0xc0) != 0x80) { return false; }
+            cp = (cp << 6) | (data[i + j] & 0x3f);
+        }
+        // 过长编码、代理对、超出范围
+        static const uint32_t MIN[4] = { 0, 0x80, 0x800, 0x10000 };
+        if (cp < MIN[n] || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) { return false; }
+        i += n + 1;
+    }
+    return true;
+}
+
+void WebSocket::Process(Buffer& in) {
+    for (;;) {
+        {
+            lock_guard<mutex> lock(m_mtx);
+            if (m_state == CLOSED) { break; }
+        }
+        size_t avail = in.ReadableBytes();
+        if (avail < 2) { break; }
+        uint8_t* p = reinterpret_cast<uint8_t*>(const_cast<char*>(in.Peek()));
+        bool fin = p[0] & 0x80;
+        int opcode = p[0] & 0x0f;
+        uint64_t len = p[1] & 0x7f;
+        size_t header = 2;
+        // 客户端的帧必须带掩码; 没有协商扩展，RSV位必须为0
+        if ((p[0] & 0x70) || !(p[1] & 0x80)) {
+            _Fail(1002);
+            break;
+        }
+        if (len == 126) {
+            if (avail < 4) { break; }
+            len = (p[2] << 8) | p[3];
+            header = 4;
+        } else if (len == 127) {
+            if (avail < 10) { break; }
+            len = 0;
+            // 64位长度的最高位必须为0(RFC 6455 5.2)
+            if (p[2] & 0x80) {
+                _Fail(1002);
+                break;
+            }
+            for (int i = 2; i < 10; i++) { len = (len << 8) | p[i]; }
+            header = 10;
+        }
+        if (opcode >= CLOSE && (!fin || len > 125)) {
+            _Fail(1002);
+            break;
+        }
+        // 消息超过上限时不等帧收完，立即关闭(用减法比较，len来自客户端，相加可能溢出)
+        uint64_t maxLen = static_cast<uint64_t>(max(maxMessage.load(), 0));
+        if (opcode < CLOSE && (m_message.size() > maxLen || len > maxLen - m_message.size())) {
+            _Fail(1009);
+            break;
+        }
+        if (avail < header + 4 || avail - header - 4 < len) { break; }
+        uint8_t* payload = p + header + 4;
+        Unmask(payload, len, p + header);
+
+        switch (opcode) {
+        case TEXT:
+        case BINARY:
+            if (m_fragOpcode) {
+                _Fail(1002);
+                break;
+            }
+            if (fin) {
+                _On_Message(opcode, payload, len);
+            } else {
+                m_fragOpcode = opcode;
+                m_message.assign(reinterpret_cast<const char*>(payload), len);
+            }
+            break;
+        case CONTINUATION:
+            if (!m_fragOpcode) {
+                _Fail(1002);
+                break;
+            }
+            m_message.append(reinterpret_cast<const char*>(payload), len);
+            if (fin) {
+                _On_Message(m_fragOpcode, reinterpret_cast<const uint8_t*>(m_message.data()), m_message.size());
+                m_fragOpcode = 0;
+                m_message.clear();
+            }
+            break;
+        case CLOSE:
+            _On_Close(payload, len);
+            break;
+        case PING: {
+            lock_guard<mutex> lock(m_mtx);
+            if (m_state == OPEN) { _Enqueue(Frame(PONG, reinterpret_cast<const char*>(payload), len)); }
+            break;
+        }
+        case PONG:
+            break;
+        default:
+            _Fail(1002);
+            break;
+        }
+        in.Retrieve(header + 4 + len);
+    }
+    lock_guard<mutex> lock(m_mtx);
+    if (m_state == CLOSED) { in.RetrieveAll(); }
+}
+
+// 仪表盘只由服务器推送，客户端发来的数据消息只检查文本是否为合法UTF-8，然后丢弃
+void WebSocket::_On_Message(int opcode, const uint8_t* data, size_t len) {
+    if (opcode == TEXT && !Valid_Utf8(data, len)) { _Fail(1007); }
+}
+
+void WebSocket::_On_Close(const uint8_t* payload, size_t len) {
+    uint16_t code = 1000;
+    if (len == 1) {
+        _Fail(1002);
+        return;
+    }
+    if (len >= 2) {
+        code = (payload[0] << 8) | payload[1];
+        if (code < 1000 || code == 1004 || code == 1005 || code == 1006 || (code > 1011 && code < 3000) || code >= 5000 ||
+            !Valid_Utf8(payload + 2, len - 2)) {
+            _Fail(1002);
+            return;
+        }
+    }
+    lock_guard<mutex> lock(m_mtx);
+    // 对端先关闭: 回复关闭帧; 本端先关闭: 握手完成
+    if (m_state == OPEN) { _Enqueue(Close_Frame(code)); }
+    m_state = CLOSED;
+}
+
+// 协议错误: 发送关闭帧后关闭连接，不再等待对端
+void WebSocket::_Fail(uint16_t code) {
+    lock_guard<mutex> lock(m_mtx);
+    if (m_state == OPEN) { _Enqueue(Close_Frame(code)); }
+    m_state = CLOSED;
+}
+
+void WebSocket::_Enqueue(const shared_ptr<const string>& frame) {
+    m_queue.push_back(frame);
+    m_queued += frame->size();
+}
+
+bool WebSocket::Push(const shared_ptr<const string>& frame, bool close) {
+    lock_guard<mutex> lock(m_mtx);
+    if (m_state != OPEN) { return false; }
+    if (!close && m_queued + frame->size() > static_cast<size_t>(maxQueue.load())) {
+        if (m_dropped++ % 1000 == 0) { LOG_DEBUG("websocket: slow subscriber, %zu messages dropped", m_dropped); }
+        return false;
+    }
+    _Enqueue(frame);
+    if (close) { m_state = CLOSING; }
+    if (m_busy || m_outArmed) { return false; }
+    m_outArmed = true;
+    return true;
+}
+
+ssize_t WebSocket::Write(int fd, int* saveErrno) {
+    ssize_t total = 0;
+    for (;;) {
+        // 队首之外的帧可能同时被reactor追加，deque尾部追加不会移动已有元素，锁外写出是安全的
+        struct iovec iov[64];
+        int cnt = 0;
+        {
+            lock_guard<mutex> lock(m_mtx);
+            for (auto it = m_queue.begin(); it != m_queue.end() && cnt < 64; ++it, ++cnt) {
+                size_t skip = cnt == 0 ? m_offset : 0;
+                iov[cnt].iov_base = const_cast<char*>((*it)->data()) + skip;
+                iov[cnt].iov_len = (*it)->size() - skip;
+            }
+        }
+        if (cnt == 0) { break; }
+        ssize_t len = writev(fd, iov, cnt);
+        if (len < 0) {
+            *saveErrno = errno;
+            return -1;
+        }
+        total += len;
+        lock_guard<mutex> lock(m_mtx);
+        m_queued -= len;
+        size_t left = len;
+        while (left > 0) {
+            size_t rest = m_queue.front()->size() - m_offset;
+            if (left < rest) {
+                m_offset += left;
+                break;
+            }
+            left -= rest;
+            m_offset = 0;
+            m_queue.pop_front();
+        }
+    }
+    return total;
+}
+
+void WebSocket::SetBusy() {
+    lock_guard<mutex> lock(m_mtx);
+    m_busy = true;
+    m_outArmed = false;
+}
+
+void WebSocket::Release(const function<void(bool out)>& arm) {
+    lock_guard<mutex> lock(m_mtx);
+    m_busy = false;
+    m_outArmed = m_queued > 0;
+    arm(m_outArmed);
+}
+
+bool WebSocket::Finished() {
+    lock_guard<mutex> lock(m_mtx);
+    return m_state == CLOSED && m_queued == 0;
+}
+
+/* ---------------- 广播 ---------------- */
+
+Broadcaster::Broadcaster() : m_count(0), m_eventFd(-1) {}
+
+Broadcaster::~Broadcaster() {
+    if (m_eventFd >= 0) { close(m_eventFd); }
+}
+
+bool Broadcaster::Init() {
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return m_eventFd >= 0;
+}
+
+void Broadcaster::Subscribe(HttpConn* conn) {
+    lock_guard<mutex> lock(m_mtx);
+    if (m_index.count(conn)) { return; }
+    m_index[conn] = m_subs.size();
+    m_subs.push_back(conn);
+    m_count = m_subs.size();
+}
+
+void Broadcaster::Unsubscribe(HttpConn* conn) {
+    lock_guard<mutex> lock(m_mtx);
+    auto it = m_index.find(conn);
+    if (it == m_index.end()) { return; }
+    size_t pos = it->second;
+    m_subs[pos] = m_subs.back();
+    m_index[m_subs[pos]] = pos;
+    m_subs.pop_back();
+    m_index.erase(conn);
+    m_count = m_subs.size();
+}
+
+void Broadcaster::Publish(const string& text) {
+    shared_ptr<const string> frame = WebSocket::Frame(WebSocket::TEXT, text.data(), text.size());
+    {
+        lock_guard<mutex> lock(m_mtx);
+        if (m_subs.empty()) { return; }
+        m_outbox.push_back(std::move(frame));
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(m_eventFd, &one, sizeof(one));
+    (void)ret;
+}
+
+void Broadcaster::Flush(const function<void(HttpConn*)>& arm) {
+    uint64_t count;
+    ssize_t ret = read(m_eventFd, &count, sizeof(count));
+    (void)ret;
+    lock_guard<mutex> lock(m_mtx);
+    for (auto& frame : m_outbox) {
+        for (HttpConn* conn : m_subs) {
+            if (conn->Ws()->Push(frame)) { arm(conn); }
+        }
+    }
+    m_outbox.clear();
+}
+
+void Broadcaster::Close_All(uint16_t code, const function<void(HttpConn*)>& arm) {
+    shared_ptr<const string> frame = WebSocket::Close_Frame(code);
+    lock_guard<mutex> lock(m_mtx);
+    for (HttpConn* conn : m_subs) {
+        if (conn->Ws()->Push(frame, true)) { arm(conn); }
+    }
+}